@@ -19,11 +19,13 @@
 #include <FileSys.h>
 #include <Game.h>
 #include <ConfigFile.h>
+#include <BitStream.h>
 
 extern FileSys *fs;
-extern Game *game;
+extern __thread Game *game;
 
 SDL_mutex *Animation::loadmutex;
+bool Animation::headless = false;
 
 static char *anim_name[] = {"normal", "walking", "eating", "appearing", "disappearing"};
 static char *direction_name[] = {"up", "down", "left", "right"};
@@ -35,6 +37,8 @@ Animation::Animation(const char *name)
 
     basename = strdup(name);
     pic = NULL;
+    pending = NULL;
+    reloadthread = NULL;
     loadstate = UNLOADED;
 
     if (!loadmutex) loadmutex = SDL_CreateMutex();
@@ -44,6 +48,7 @@ Animation::Animation(const char *name)
 
 Animation::~Animation()
 {
+    cancelReload();
     if (loadstate == LOADING) {
         finishLoading();
     }
@@ -55,10 +60,12 @@ Animation::~Animation()
     free(frames);
     free(mpf);
     free(pic);
+    free(pending);
 }
 
 void Animation::reloadPics()
 {
+    cancelReload();
     if (loadstate == LOADING) {
         finishLoading();
     }
@@ -69,6 +76,73 @@ void Animation::reloadPics()
     startLoading();
 }
 
+/* Scale the current pictures to w by h without smoothing, which is fast
+ * enough to do immediately, and start loading the proper pictures in the
+ * background. swapPics() puts them in place when they are ready. */
+void Animation::rescalePics(int w, int h)
+{
+    if (loadstate != LOADED) {
+        reloadPics();
+        return;
+    }
+    cancelReload();
+
+    for (int n=0; n<num_pics; n++) {
+        Picture &p = pic[0][n];
+        if (!p.linked && p.pic) {
+            SDL_Surface *tmp = zoomSurface(p.pic, (double)w / p.pic->w,
+                                           (double)h / p.pic->h,
+                                           SMOOTHING_OFF);
+            SDL_FreeSurface(p.pic);
+            p.pic = tmp;
+        }
+    }
+
+    reload_w = w;
+    reload_h = h;
+    reload_done = false;
+    reload_cancel = false;
+    reloadthread = SDL_CreateThread( (int (*)(void*))reloadThread, this);
+}
+
+/* Swap in the pictures loaded by rescalePics(), if they are ready. Returns
+ * true if anything changed. This never blocks. */
+bool Animation::swapPics()
+{
+    if (!reloadthread || !reload_done) {
+        return false;
+    }
+    SDL_WaitThread(reloadthread, NULL);
+    reloadthread = NULL;
+
+    for (int n=0; n<num_pics; n++) {
+        if (pending[n]) {
+            SDL_FreeSurface(pic[0][n].pic);
+            pic[0][n].pic = pending[n];
+            pending[n] = NULL;
+        }
+    }
+    printMsg(1, "animation %p, swapped in rescaled images\n", this);
+    return true;
+}
+
+void Animation::cancelReload()
+{
+    if (!reloadthread) {
+        return;
+    }
+    reload_cancel = true;
+    SDL_WaitThread(reloadthread, NULL);
+    reloadthread = NULL;
+
+    for (int n=0; n<num_pics; n++) {
+        if (pending[n]) {
+            SDL_FreeSurface(pending[n]);
+            pending[n] = NULL;
+        }
+    }
+}
+
 void Animation::reloadSounds()
 {
     if (loadstate == LOADING) {
@@ -83,7 +157,7 @@ void Animation::reloadSounds()
 
 void Animation::load()
 {
-    if (loadstate == UNLOADED) {
+    if (loadstate == UNLOADED && !headless) {
         startLoading();
     }
 }
@@ -119,6 +193,7 @@ SDL_Surface *Animation::getFrame(int i, int j, int k)
 
 Mix_Chunk *Animation::getSound(int i)
 {
+    if (headless) return NULL;
     if (loadstate == UNLOADED) startLoading();
     if (loadstate == LOADING) finishLoading();
     return sound[i];
@@ -145,6 +220,9 @@ void Animation::startLoading()
 
     SDL_mutexP(loadmutex);
     printMsg(1, "animation %p starting to load\n", this);
+    /* game is per thread, so the loading thread can't look at it */
+    load_w = game->getSquareWidth();
+    load_h = game->getSquareHeight();
     loadthread = SDL_CreateThread( (int (*)(void*))loadThread, this);
     //loadThread(this);
     loadstate = LOADING;
@@ -197,15 +275,9 @@ int Animation::loadThread(Animation *a)
         for (int j=0; j<DIR_NUM; j++) {
             for (int k=0; k < a->frame(i, j); k++) {
                 if (!a->p(i, j, k).linked && !a->p(i, j, k).pic) {
-                    filename = a->basename;
-                    filename += "__";
-                    filename += anim_name[i];
-                    filename += "_";
-                    filename += direction_name[j];
-                    filename += "_" + itostr(k, 2) + ".png";
+                    filename = a->picFile(i, j, k);
                     a->p(i, j, k).pic = fs->openAnimPic(filename.c_str(),
-                                                   game->getSquareWidth(),
-                                                   game->getSquareHeight());
+                                                        a->load_w, a->load_h);
                 }
             }
         }
@@ -225,6 +297,36 @@ int Animation::loadThread(Animation *a)
     return 0;
 }
 
+int Animation::reloadThread(Animation *a)
+{
+    for (int i=0; i<ANIM_NUM && !a->reload_cancel; i++) {
+        for (int j=0; j<DIR_NUM && !a->reload_cancel; j++) {
+            for (int k=0; k<a->frame(i, j) && !a->reload_cancel; k++) {
+                Picture &p = a->p(i, j, k);
+                if (!p.linked) {
+                    a->pending[&p - a->pic[0]] =
+                            fs->openAnimPic(a->picFile(i, j, k).c_str(),
+                                            a->reload_w, a->reload_h);
+                }
+            }
+        }
+    }
+    printMsg(1, "animation %p, rescaled images finished loading\n", a);
+    a->reload_done = true;
+    return 0;
+}
+
+string Animation::picFile(int i, int j, int k)
+{
+    string filename = basename;
+    filename += "__";
+    filename += anim_name[i];
+    filename += "_";
+    filename += direction_name[j];
+    filename += "_" + itostr(k, 2) + ".png";
+    return filename;
+}
+
 void Animation::loadConfig()
 {
     string tmp = basename;
@@ -253,6 +355,8 @@ void Animation::loadConfig()
     pic = (Picture**)calloc(1, sizeof(void*) * (ANIM_NUM*DIR_NUM)
                              + sizeof(Picture) * total_pics);
     Picture *layer2  = (Picture*)(pic + ANIM_NUM*DIR_NUM);
+    num_pics = total_pics;
+    pending = (SDL_Surface**)calloc(total_pics, sizeof(SDL_Surface*));
 
     for(i=0; i < ANIM_NUM*DIR_NUM; i++) {
         pic[i] = layer2;
@@ -390,6 +494,40 @@ void AnimationState::setDir(AnimationDirection new_dir)
     dir = new_dir;
 }
 
+/* For a saved game. The Animation itself isn't saved, since whoever owns
+ * the state sets that up, and the sound isn't started again. */
+void AnimationState::save(BitWriter &out, int now)
+{
+    out.write(type, 3);
+    out.write(dir, 2);
+    out.writeGamma(frame);
+    out.writeSigned(last - now);
+}
+
+bool AnimationState::load(BitReader &in, int now)
+{
+    int new_type = in.read(3);
+    int new_dir = in.read(2);
+    int new_frame = in.readGamma();
+    int new_last = now + in.readSigned();
+
+    if (in.overflow() || new_type >= ANIM_NUM) {
+        return false;
+    }
+    stopSound();
+    type  = (AnimationType)new_type;
+    dir   = (AnimationDirection)new_dir;
+    last  = new_last;
+    frame = 0;
+    if (anim) {
+        anim->ready();
+        if (new_frame < anim->frame(type, dir)) {
+            frame = new_frame;
+        }
+    }
+    return true;
+}
+
 void AnimationState::setAnim(Animation *anim_)
 {
     last  = SDL_GetTicks();
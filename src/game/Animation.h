@@ -20,6 +20,9 @@
 
 #include <Gnumch.h>
 
+class BitWriter;
+class BitReader;
+
 typedef enum {
     ANIM_NORMAL,
     ANIM_WALKING,
@@ -60,9 +63,15 @@ class Animation {
         int             frame       (int, int);
         void            load        ();
         void            reloadPics  ();
+        void            rescalePics (int w, int h);
+        bool            swapPics    ();
         void            reloadSounds();
         void            ready       ();
 
+        /* A headless Animation only has its timing information; pictures
+         * and sounds are never loaded. */
+        static void     setHeadless (bool h) {headless = h;}
+
         Animation(const char*);
         ~Animation();
 
@@ -82,7 +91,19 @@ class Animation {
         };
         int loadstate;
         SDL_Thread *loadthread;
+        int load_w, load_h;
         static SDL_mutex *loadmutex;
+        static bool headless;
+
+        /* after a resolution change we scale the old pictures quickly and
+         * then load proper ones in the background. The new pictures go in
+         * pending (indexed like the pic array) until swapPics() */
+        int num_pics;
+        SDL_Surface **pending;
+        SDL_Thread *reloadthread;
+        int reload_w, reload_h;
+        volatile bool reload_done;
+        volatile bool reload_cancel;
 
         Picture &p(int, int, int);
 
@@ -92,8 +113,11 @@ class Animation {
         void unloadSounds();
         void loadConfig();
         void parseLink(Picture*, const char *text);
+        string picFile(int, int, int);
+        void cancelReload();
 
         static int loadThread(Animation *a);
+        static int reloadThread(Animation *a);
 };
 
 class AnimationState {
@@ -109,6 +133,8 @@ class AnimationState {
         void            setAnim     (Animation*);
         AnimationType   getState    ();
         AnimationDirection getDir   ();
+        void            save        (BitWriter&, int now);
+        bool            load        (BitReader&, int now);
 
     protected:
         Animation *anim;
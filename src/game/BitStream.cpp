@@ -0,0 +1,147 @@
+/*
+ *  Copyright (C) 2005 Joe Neeman <spuzzzzzzz@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#include "BitStream.h"
+
+/* the number of bits needed for the numbers 0 to n-1 */
+int bitsFor(int n)
+{
+    int bits = 1;
+
+    while( (1 << bits) < n ) {
+        bits++;
+    }
+    return bits;
+}
+
+BitWriter::BitWriter(Uint8 *buf, int max)
+{
+    this->buf = buf;
+    this->max = max;
+    pos = 0;
+    over = false;
+}
+
+void BitWriter::write(Uint32 val, int bits)
+{
+    for( int i=bits-1; i>=0; i-- ) {
+        if( pos >= max*8 ) {
+            over = true;
+            return;
+        }
+        if( (pos & 7) == 0 ) {
+            buf[pos/8] = 0;
+        }
+        if( (val >> i) & 1 ) {
+            buf[pos/8] |= 0x80 >> (pos & 7);
+        }
+        pos++;
+    }
+}
+
+/* The code is for val+1, so the largest number has no code and is written
+ * as the one below it. */
+void BitWriter::writeGamma(Uint32 val)
+{
+    int bits = 0;
+
+    if( val == 0xffffffff ) {
+        val--;
+    }
+    val++;
+    while( (val >> bits) > 1 ) {
+        bits++;
+    }
+    write(0, bits);
+    write(val, bits+1);
+}
+
+/* The gamma code stops one short of 2^32, so the most negative number is
+ * written as the one after it. */
+void BitWriter::writeSigned(Sint32 val)
+{
+    if( val < -0x7fffffff ) {
+        val = -0x7fffffff;
+    }
+    writeGamma( val < 0 ? ((Uint32)-(val + 1) << 1) | 1 : (Uint32)val << 1 );
+}
+
+void BitWriter::writeString(const string &s)
+{
+    writeGamma( s.size() );
+    for( int i=0; i<(int)s.size(); i++ ) {
+        write( (Uint8)s[i], 8 );
+    }
+}
+
+BitReader::BitReader(const Uint8 *buf, int len)
+{
+    this->buf = buf;
+    this->len = len;
+    pos = 0;
+    over = false;
+}
+
+Uint32 BitReader::read(int bits)
+{
+    Uint32 ret = 0;
+
+    for( int i=0; i<bits; i++ ) {
+        if( pos >= len*8 ) {
+            over = true;
+            return 0;
+        }
+        ret = (ret << 1) | ((buf[pos/8] >> (7 - (pos & 7))) & 1);
+        pos++;
+    }
+    return ret;
+}
+
+Uint32 BitReader::readGamma()
+{
+    int bits = 0;
+
+    while( read(1) == 0 ) {
+        if( over || ++bits > 31 ) {
+            over = true;
+            return 0;
+        }
+    }
+    return ((1u << bits) | read(bits)) - 1;
+}
+
+Sint32 BitReader::readSigned()
+{
+    Uint32 val = readGamma();
+
+    return (val & 1) ? -(Sint32)(val >> 1) - 1 : (Sint32)(val >> 1);
+}
+
+string BitReader::readString(int max)
+{
+    string ret;
+    Uint32 n = readGamma();
+
+    if( n > (Uint32)max ) {
+        over = true;
+        return ret;
+    }
+    for( Uint32 i=0; i<n && !over; i++ ) {
+        ret += (char)read(8);
+    }
+    return ret;
+}
@@ -0,0 +1,74 @@
+/*
+ *  Copyright (C) 2005 Joe Neeman <spuzzzzzzz@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#ifndef BITSTREAM_H
+#define BITSTREAM_H
+
+#include "Gnumch.h"
+
+/* the number of bits needed for the numbers 0 to n-1 */
+int bitsFor(int n);
+
+/* Writes values of any width up to 32 bits, most significant bit first. If
+ * the buffer fills up, the rest is dropped and overflow() becomes true. */
+class BitWriter {
+    public:
+        BitWriter(Uint8 *buf, int max);
+
+        void    write(Uint32 val, int bits);
+        /* small numbers in few bits (Elias gamma code of val+1);
+         * 0xffffffff is written as 0xfffffffe */
+        void    writeGamma(Uint32 val);
+        /* small numbers of either sign in few bits (gamma code, with the
+         * sign in the lowest bit) */
+        void    writeSigned(Sint32 val);
+        /* the length in gamma code, then 8 bits a character */
+        void    writeString(const string&);
+
+        /* the number of bytes used so far, counting a partial one */
+        int     length()   {return (pos + 7) / 8;}
+        bool    overflow() {return over;}
+
+    private:
+        Uint8 *buf;
+        int max;
+        int pos;    /* in bits */
+        bool over;
+};
+
+/* The other end of BitWriter. Reading past the end gives zeros and makes
+ * overflow() true. */
+class BitReader {
+    public:
+        BitReader(const Uint8 *buf, int len);
+
+        Uint32  read(int bits);
+        Uint32  readGamma();
+        Sint32  readSigned();
+        /* a string that is longer than max counts as an overflow */
+        string  readString(int max);
+
+        bool    overflow() {return over;}
+
+    private:
+        const Uint8 *buf;
+        int len;
+        int pos;
+        bool over;
+};
+
+#endif
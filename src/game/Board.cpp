@@ -19,8 +19,12 @@
 #include <Game.h>
 #include <Level.h>
 #include <Player.h>
+#include <BitStream.h>
 
-extern Game *game;
+extern __thread Game *game;
+
+/* the longest number text that a saved board may have */
+#define SAVE_MAX_TEXT 256
 
 Board::Board(int w, int h, const vector<Player*> &players)
 {
@@ -213,6 +217,90 @@ void Board::setNum(int x, int y, Number *num, bool wincheck)
     dirty[x][y] = 1;
 }
 
+/* A saved board is its size, then each different number on it (its text,
+ * whether it is good and its value), then each square as the position of
+ * its number in that list plus one, or 0 if it is empty, in as few bits as
+ * the list allows. A level only uses a handful of numbers at once, so most
+ * squares take three or four bits. */
+void Board::save(BitWriter &out)
+{
+    vector<Number*> nums;
+    map<Number*, int> index;
+    int i, j;
+
+    for(i=0; i<width; i++) {
+        for(j=0; j<height; j++) {
+            Number *n = square[i][j]->getNum();
+            if(n && !index.count(n)) {
+                nums.push_back(n);
+                index[n] = nums.size();
+            }
+        }
+    }
+
+    out.writeGamma(width);
+    out.writeGamma(height);
+    out.writeGamma(nums.size());
+    for(i=0; i<(int)nums.size(); i++) {
+        out.writeString(nums[i]->getText());
+        out.write(nums[i]->good(), 1);
+        out.writeSigned(nums[i]->getValue());
+    }
+
+    int bits = bitsFor(nums.size() + 1);
+    for(i=0; i<width; i++) {
+        for(j=0; j<height; j++) {
+            Number *n = square[i][j]->getNum();
+            out.write(n ? index[n] : 0, bits);
+        }
+    }
+}
+
+bool Board::load(BitReader &in, Level *level)
+{
+    vector<string> text;
+    vector<bool> good;
+    vector<int> value;
+    vector<int> cells;
+    int i, j;
+
+    if((int)in.readGamma() != width || (int)in.readGamma() != height) {
+        return false;
+    }
+    Uint32 n = in.readGamma();
+    if(n > (Uint32)(width * height)) {
+        return false;
+    }
+    for(i=0; i<(int)n && !in.overflow(); i++) {
+        text.push_back(in.readString(SAVE_MAX_TEXT));
+        good.push_back(in.read(1));
+        value.push_back(in.readSigned());
+    }
+
+    int bits = bitsFor(n + 1);
+    for(i=0; i<width*height; i++) {
+        cells.push_back(in.read(bits));
+        if(cells.back() > (int)n) {
+            return false;
+        }
+    }
+    if(in.overflow()) {
+        return false;
+    }
+
+    /* it all makes sense, so now change the board */
+    for(i=0; i<width; i++) {
+        for(j=0; j<height; j++) {
+            int c = cells[i*height + j];
+            Number *num = c ? level->addNumber(text[c-1].c_str(), good[c-1],
+                                               value[c-1])
+                            : NULL;
+            game->setNum(i, j, num, false);
+        }
+    }
+    return true;
+}
+
 Number *Board::getNum(int x, int y)
 {
     return square[x][y]->getNum();
@@ -25,6 +25,9 @@
 class Number;
 class Player;
 class Muncher;
+class Level;
+class BitWriter;
+class BitReader;
 
 class Square {
     public:
@@ -69,6 +72,12 @@ class Board {
         Number *getNum(int, int);
         SDL_Surface  *getTextPic(int, int);
 
+        // write the numbers on the board for a saved game, and put them back
+        // from level's numbers. load() leaves the board alone and returns
+        // false if the data is garbled or for a board of another size.
+        void    save(BitWriter&);
+        bool    load(BitReader&, Level*);
+
     protected:
         bool **dirty;
         Square ***square;
@@ -16,54 +16,72 @@
  *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
  */
 #include "NetworkThread.h"
-#include "MultiPlayerServer.h"
 #include "MultiPlayerClient.h"
 
-void ClientNetThread::handleEvent(UDPpacket *p)
+ClientNetThread::ClientNetThread(MultiPlayerClient *game)
 {
-    int ts = SDLNet_Read32( &PACKET_TIME(p) );
-    switch( PACKET_DATA(p)[0] ) {
+    mpgame = game;
+    join_servers = NULL;
+    sock = new NetSocket(0);
+    if( !sock->ok() ) {
+        printError("couldn't open UDP socket\n");
+    }
+}
+
+ClientNetThread::~ClientNetThread()
+{
+    cancelThreads();
+}
+
+void ClientNetThread::cancelThreads()
+{
+    if( join_servers ) {
+        SDL_WaitThread(join_servers, NULL);
+        join_servers = NULL;
+    }
+    NetThread::cancelThreads();
+}
+
+/* the event has already been decoded according to event_format */
+void ClientNetThread::handleEvent(UDPpacket *p, enum NetEvent e,
+                                  const WireArgs &a)
+{
+    int ts = packetTime(p);
+    const Sint32 *n = a.n;
+
+    switch( e ) {
         case PLAYER_MOVE:
-            NETASSERT( PACKET_TYPE(p) == PT_EVENT5 );
-            mpgame->doPlayerMove( PACKET_DATA(p)[1],
-                                  PACKET_DATA(p)[2],
-                                  PACKET_DATA(p)[3],
-                                  PACKET_DATA(p)[4],
-                                  PACKET_DATA(p)[5], ts);
+            mpgame->doPlayerMove(n[0], n[1], n[2], n[3], n[4], ts);
             break;
         case PLAYER_STOP:
-            NETASSERT( PACKET_TYPE(p) == PT_EVENT3 );
-            mpgame->doPlayerStop( PACKET_DATA(p)[1],
-                                  PACKET_DATA(p)[2],
-                                  PACKET_DATA(p)[3], ts);
+            mpgame->doPlayerStop(n[0], n[1], n[2], ts);
             break;
         case PLAYER_EAT:
-            NETASSERT( PACKET_TYPE(p) == PT_EVENT3 );
-            mpgame->doPlayerMunch( PACKET_DATA(p)[1],
-                                   PACKET_DATA(p)[2],
-                                   PACKET_DATA(p)[3], ts);
+            mpgame->doPlayerMunch(n[0], n[1], n[2], ts);
             break;
         case PLAYER_DIE:
-            NETASSERT( PACKET_TYPE(p) == PT_EVENT0 );
-            mpgame->doPlayerDie( PACKET_DATA(p)[1], ts );
+            mpgame->doPlayerDie(n[0], ts);
             break;
         case PLAYER_SPAWN:
-            NETASSERT( PACKET_TYPE(p) == PT_EVENT0 );
-            mpgame->doPlayerSpawn( PACKET_DATA(p)[1], ts );
+            mpgame->doPlayerSpawn(n[0], n[1], n[2], ts);
             break;
         case PLAYER_SCORE:
-            NETASSERT( PACKET_TYPE(p) == PT_EVENT4 );
-            mpgame->doUpdateScore( SDLNet_Read32(PACKET_DATA(p)+1), ts );
+            mpgame->doUpdateScore(n[0], n[1], ts);
             break;
         case GAME_NEXTLEVEL:
-            NETASSERT( PACKET_TYPE(p) == PT_EVENT0 );
-            mpgame->doNextLevel( ts );
+            mpgame->doNextLevel(ts);
             break;
         case GAME_TROGWARN:
-            NETASSERT( PACKET_TYPE(p) == PT_EVENT0 );
-            mpgame->showTrogWarning();
+            mpgame->doTrogWarning(true);
+            break;
+        case GAME_TROGHIDE:
+            mpgame->doTrogWarning(false);
+            break;
+        case GAME_SETNUM:
+            mpgame->doSetNum(n[0], n[1], n[2], a.s[0], ts);
+            break;
         default:
-            printWarning("Unknown NetEvent\n");
+            printWarning("Unexpected NetEvent %d\n", e);
     }
 }
 
@@ -72,49 +90,91 @@ void ClientNetThread::handlePing(UDPpacket *p)
     queueSend( createAckPacket(p) );
 }
 
-void ClientNetThread::handleRegister(UDPpacket *p)
+void ClientNetThread::handleRegister(UDPpacket*)
 {
     printWarning("warning: client got unexpected register packet\n");
 }
 
-void ClientNetThread::findServers()
+/* decode a format 5 packet (described in NetworkThread.cpp) and ack it, so
+ * that the server sends the next one as changes from this one */
+void ClientNetThread::handleSnapshot(UDPpacket *p)
 {
-    find_servers = SDL_CreateThread(findServersThread, this);
+    WireArgs a;
+    int start = readFields(p, &a);
+    int len = p->len - PACKET_HEADER_LEN - start;
+
+    if( start == -1 || len < 1 ) {
+        printMsg(1, "dropping runt snapshot\n");
+        return;
+    }
+
+    Uint16 id = a.n[0];
+    Uint32 input = a.n[2];
+    const Snapshot *s = snapshots.decode( id, a.n[1],
+                                          PACKET_DATA(p) + start, len );
+    if( !s ) {
+        return;
+    }
+
+    mpgame->doSnapshot( *s, input, packetTime(p) );
+    queueSend( createEventPacket(SNAPSHOT_ACK, (int)id) );
 }
 
-void ClientNetThread::joinServer(IPaddress *a)
+/* collect a format 7 packet, and once the whole join state is here, start
+ * the game from it and ack it like a snapshot */
+void ClientNetThread::handleJoin(UDPpacket *p)
 {
-    if( SDLNet_UDP_Bind(listen, 1, a) != 1 ) {
-        printWarning("Couldn't bind server address to socket\n");
-    } else {
-        join_servers = SDL_CreateThread(joinServerThread, this);
+    WireArgs a;
+    JoinState js;
+    int start = readFields(p, &a);
+
+    if( start == -1 ||
+        !joining.add( a.n[0], a.n[2], a.n[3], PACKET_DATA(p) + start,
+                      p->len - PACKET_HEADER_LEN - start ) ) {
+        return;
+    }
+    if( !js.decode(joining.data(), joining.length()) ) {
+        printMsg(1, "dropping malformed join state %d\n", a.n[0]);
+        return;
     }
+
+    js.snap.id = a.n[0];
+    snapshots.add(js.snap);
+    mpgame->doJoinState( js, a.n[1], packetTime(p) );
+    queueSend( createEventPacket(SNAPSHOT_ACK, (int)js.snap.id) );
 }
 
-int findServersThread(void *c)
+void ClientNetThread::handleDisconnect(playerInfo_t *pi)
 {
-    ClientNetThread *cnet = (ClientNetThread*)c;
-    UDPpacket *sendpacket = cnet->createDetailsPacket();
-    UDPpacket *recvpacket = cnet->createGenericPacket();
-
-    /* wait 5 seconds in 1/4 second blocks */
-    for( int i=0; i<20; i++ ) {
-        SDLNet_UDP_Send(cnet->listen, -1, sendpacket);
-        SDL_Delay(250);
-
-        while( SDLNet_UDP_Recv( cnet->listen, recvpacket ) == 1 ) {
-            if( PACKET_TYPE(recvpacket) != PT_DETAILS ) {
-                printMsg(0, "unexpected packet type\n"); 
-                continue;
-            }
-
-            mpgame->addServer(new ServerDetails(recvpacket));
-        }
-    }
-    return 0;
+    printWarning("the server has stopped answering\n");
+    NetThread::handleDisconnect(pi);
+}
+
+void ClientNetThread::sendKey(enum Key key, Uint32 seq)
+{
+    queueSend( createEventPacket(PLAYER_KEY, (int)key, (int)seq) );
+}
+
+void ClientNetThread::joinServer(IPaddress *a)
+{
+    playerInfo_t *server = new playerInfo_t;
+    server->id = -1;
+    server->channel = -1;
+    server->room = 0;
+    server->address = *a;
+    server->name = "server";
+    server->conn = new Connection(pool);
+    server->watching = -1;
+
+    SDL_mutexP(active_player_mutex);
+    active_players.push_back(server);
+    SDL_mutexV(active_player_mutex);
+
+    sock->bind(0, a);
+    join_servers = SDL_CreateThread(joinServerThread, this);
 }
 
-int joinServerThread(void *c)
+int joinServerThread(void*)
 {
     return 0;
 }
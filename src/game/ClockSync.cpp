@@ -0,0 +1,140 @@
+/*
+ *  Copyright (C) 2005 Joe Neeman <spuzzzzzzz@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#include "ClockSync.h"
+#include <math.h>
+
+ClockSync::ClockSync()
+{
+    count = 0;
+    seeded = false;
+    base = 0;
+    offset = 0;
+    drift = 0;
+    rtt = 0;
+    last_ping = 0;
+}
+
+void ClockSync::seed(Uint32 remote, Uint32 now)
+{
+    base = now;
+    offset = (Sint32)(remote - now);
+    seeded = true;
+}
+
+bool ClockSync::wantsPing(Uint32 now)
+{
+    Uint32 interval = count < CLOCK_SAMPLES ? CLOCK_PING_FAST
+                                            : CLOCK_PING_SLOW;
+
+    if( last_ping && now - last_ping < interval ) {
+        return false;
+    }
+    last_ping = now;
+    return true;
+}
+
+void ClockSync::sample(Uint32 t0, Uint32 t1, Uint32 t3)
+{
+    int i = count % CLOCK_SAMPLES;
+
+    /* an answer from before a wrap, or one that was never asked for */
+    if( (Sint32)(t3 - t0) < 0 ) {
+        return;
+    }
+
+    samples[i].local = t0 + (t3 - t0) / 2;
+    samples[i].offset = (Sint32)(t1 - samples[i].local);
+    samples[i].rtt = t3 - t0;
+    count++;
+    estimate();
+}
+
+int ClockSync::getOffset(Uint32 now)
+{
+    return (int)(offset + drift * (Sint32)(now - base));
+}
+
+Uint32 ClockSync::toLocal(Uint32 remote)
+{
+    /* the offset changes so slowly that it hardly matters whether we look
+     * it up at the remote or local time */
+    return remote - getOffset(remote - (Sint32)offset);
+}
+
+Uint32 ClockSync::toRemote(Uint32 local)
+{
+    return local + getOffset(local);
+}
+
+/*_________________________________private__________________________________*/
+
+void ClockSync::estimate()
+{
+    int n = min(count, CLOCK_SAMPLES);
+    int best = 0;
+
+    for( int i=1; i<n; i++ ) {
+        if( samples[i].rtt < samples[best].rtt ) {
+            best = i;
+        }
+    }
+
+    /* Fit a line through the samples whose round trip was not much worse
+     * than the best. The others were probably held up in a queue on one
+     * leg, which skews them by up to half the extra delay. */
+    Uint32 limit = samples[best].rtt * 2 + 2;
+    double sx = 0, sy = 0, sxx = 0, sxy = 0;
+    int m = 0;
+
+    for( int i=0; i<n; i++ ) {
+        if( samples[i].rtt > limit ) {
+            continue;
+        }
+        double x = (Sint32)(samples[i].local - samples[best].local);
+        double y = samples[i].offset - samples[best].offset;
+        sx += x; sy += y; sxx += x*x; sxy += x*y;
+        m++;
+    }
+
+    double new_drift = drift;
+    double spread = sxx - sx*sx/m;
+    if( m >= 4 && spread > 1e6 ) {
+        new_drift = (sxy - sx*sy/m) / spread;
+        new_drift = max(-CLOCK_MAX_DRIFT / 1e6,
+                        min(CLOCK_MAX_DRIFT / 1e6, new_drift));
+        /* one window is too short to measure drift well, so average it
+         * over several once we have a full one */
+        if( count > CLOCK_SAMPLES ) {
+            new_drift = drift + (new_drift - drift) / 8;
+        }
+    }
+
+    Uint32 now = samples[(count - 1) % CLOCK_SAMPLES].local;
+    double old = count > 1 ? offset + drift * (Sint32)(now - base) : 0;
+    double est = samples[best].offset +
+                 new_drift * (Sint32)(now - samples[best].local);
+
+    if( count == 1 || fabs(est - old) > CLOCK_STEP ) {
+        offset = est;
+    } else {
+        offset = old + (est - old) / 4;
+    }
+    base = now;
+    drift = new_drift;
+    rtt = samples[best].rtt;
+}
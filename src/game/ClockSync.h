@@ -0,0 +1,88 @@
+/*
+ *  Copyright (C) 2005 Joe Neeman <spuzzzzzzz@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#ifndef CLOCKSYNC_H
+#define CLOCKSYNC_H
+
+#include "Gnumch.h"
+
+/* the number of ping exchanges we keep for filtering */
+#define CLOCK_SAMPLES 16
+
+/* how often we ping: quickly until the window is full, then slowly */
+#define CLOCK_PING_FAST 100
+#define CLOCK_PING_SLOW 2000
+
+/* a new estimate that is further than this from the old one (in ms) is
+ * jumped to; smaller changes are eased in so that times don't jitter */
+#define CLOCK_STEP 50
+
+/* the most drift we believe in, in parts per million */
+#define CLOCK_MAX_DRIFT 1000
+
+/* An NTP-style estimate of another computer's clock. We ping it at time t0,
+ * it stamps its answer with its own time t1, and we get the answer at t3.
+ * If the network is symmetric, the other clock is ahead of ours by
+ * t1 - (t0 + t3)/2, give or take half the round trip. So, as in NTP, we
+ * trust the sample with the shortest round trip most, and work out the
+ * drift between the clocks from the trend of the good samples. */
+class ClockSync {
+    public:
+        ClockSync();
+
+        /** Make a first guess from one timestamp, assuming it took no time
+         *  to arrive. */
+        void    seed(Uint32 remote, Uint32 now);
+
+        /** @return true if it is time to send another ping. */
+        bool    wantsPing(Uint32 now);
+
+        /** Add the result of a ping.
+         *  @param t0 when we sent the ping, by our clock
+         *  @param t1 when the other end answered it, by its clock
+         *  @param t3 when we got the answer, by our clock */
+        void    sample(Uint32 t0, Uint32 t1, Uint32 t3);
+
+        /** Translate between the other clock and ours. */
+        Uint32  toLocal(Uint32 remote);
+        Uint32  toRemote(Uint32 local);
+
+        /* the current estimates */
+        int     getOffset(Uint32 now);  /* ms that the other clock is ahead */
+        double  getDrift() {return drift;}      /* ms per ms */
+        int     getRTT() {return rtt;}          /* of the best sample */
+        bool    synced() {return seeded || count > 0;}
+
+    private:
+        void    estimate();
+
+        struct {
+            Uint32 local;   /* the midpoint of the exchange, by our clock */
+            Sint32 offset;
+            Uint32 rtt;
+        } samples[CLOCK_SAMPLES];
+        int count;      /* how many samples there have been */
+        bool seeded;
+
+        Uint32 base;    /* the local time that offset applies to */
+        double offset;
+        double drift;
+        Uint32 rtt;
+        Uint32 last_ping;
+};
+
+#endif
@@ -0,0 +1,332 @@
+/*
+ *  Copyright (C) 2005 Joe Neeman <spuzzzzzzz@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#include "Connection.h"
+#include "PacketPool.h"
+#include "NetSocket.h"
+
+/* sequence numbers wrap around, so a is newer than b if it is less than half
+ * way round ahead of it */
+static inline bool seqNewer(Uint16 a, Uint16 b)
+{
+    return (Sint16)(a - b) > 0;
+}
+
+Connection::Connection(PacketPool *pool)
+{
+    this->pool = pool;
+    fail = false;
+
+    local_seq = 0;
+    loss_checked = 0;
+    memset( &counters, 0, sizeof(counters) );
+    memset( &sampled, 0, sizeof(sampled) );
+    unreliable_out = 0;
+    reliable_head = reliable_tail = 0;
+    memset( sent, 0, sizeof(sent) );
+    memset( reliable, 0, sizeof(reliable) );
+
+    have_rtt = false;
+    srtt = rttvar = 0;
+    rto = NET_INITIAL_RTO;
+
+    have_remote = false;
+    remote_seq = 0;
+    recv_bits = 0;
+    ack_pending = false;
+    ack_since = 0;
+    have_unreliable = false;
+    unreliable_in = 0;
+    reliable_in = 0;
+    memset( early, 0, sizeof(early) );
+}
+
+Connection::~Connection()
+{
+    for (int i=0; i<NET_RELIABLE_WINDOW; i++) {
+        if (reliable[i].p) pool->unref(reliable[i].p);
+        if (early[i]) pool->unref(early[i]);
+    }
+}
+
+void Connection::writeUnreliable(Uint8 *buf, Uint32 now)
+{
+    writeHeader(buf, CHAN_UNRELIABLE, unreliable_out++, now, false);
+}
+
+void Connection::writeAck(Uint8 *buf, Uint32 now)
+{
+    writeHeader(buf, CHAN_ACK, 0, now, false);
+}
+
+void Connection::writeOOB(Uint8 *buf)
+{
+    memset( buf, 0, NET_HEADER_LEN );
+    buf[8] = CHAN_OOB;
+}
+
+bool Connection::queueReliable(UDPpacket *p)
+{
+    if ((Uint16)(reliable_head - reliable_tail) >= NET_RELIABLE_WINDOW) {
+        return false;
+    }
+
+    ReliableInfo *r = &reliable[reliable_head % NET_RELIABLE_WINDOW];
+    pool->ref(p);
+    r->p = p;
+    r->msg = reliable_head++;
+    r->retries = 0;
+    r->next_send = 0;
+    return true;
+}
+
+/* Each resend backs off exponentially from the current timeout, so a
+ * connection that has stalled doesn't get flooded. */
+UDPpacket *Connection::nextResend(Uint8 *buf, Uint32 now)
+{
+    for (Uint16 m = reliable_tail; m != reliable_head; m++) {
+        ReliableInfo *r = &reliable[m % NET_RELIABLE_WINDOW];
+
+        if (!r->p || (r->retries && (Sint32)(now - r->next_send) < 0)) {
+            continue;
+        }
+        if (r->retries > NET_MAX_RETRIES) {
+            fail = true;
+            return NULL;
+        }
+        r->next_send = now + min(rto << min(r->retries, 4), NET_MAX_RTO);
+        if (r->retries++) {
+            counters.retransmits++;
+        }
+        writeHeader(buf, CHAN_RELIABLE, r->msg, now, true);
+        return r->p;
+    }
+    return NULL;
+}
+
+bool Connection::wantsAck(Uint32 now)
+{
+    return ack_pending && (Sint32)(now - ack_since) >= NET_ACK_DELAY;
+}
+
+bool Connection::receive(UDPpacket *p, Uint32 now)
+{
+    /* nothing we send is bigger than a pool packet, and early reliable
+     * ones get copied into one */
+    if (p->len < NET_HEADER_LEN || p->len > NET_HEADER_LEN + NET_PACKET_SIZE) {
+        return false;
+    }
+    counters.packets_in++;
+    counters.bytes_in += p->len;
+
+    Uint16 seq      = SDLNet_Read16(&p->data[0]);
+    Uint16 ack      = SDLNet_Read16(&p->data[2]);
+    Uint32 ack_bits = SDLNet_Read32(&p->data[4]);
+    int    chan     = p->data[8];
+    Uint16 chan_seq = SDLNet_Read16(&p->data[9]);
+
+    if (chan == CHAN_OOB) {
+        stripHeader(p);
+        return true;
+    }
+
+    /* whatever else it is, it carries acks for us */
+    handleAck(ack, now);
+    for (int i=0; i<32; i++) {
+        if (ack_bits & (1u << i)) {
+            handleAck(ack - 1 - i, now);
+        }
+    }
+    countLosses(ack);
+
+    /* note that we've had it, and drop duplicates */
+    if (!have_remote || seqNewer(seq, remote_seq)) {
+        Uint16 shift = seq - remote_seq;
+        if (!have_remote || shift > 32) {
+            recv_bits = 0;
+        } else {
+            recv_bits = (shift == 32 ? 0 : recv_bits << shift)
+                        | (1u << (shift - 1));
+        }
+        remote_seq = seq;
+        have_remote = true;
+    } else {
+        Uint16 back = remote_seq - seq;
+        if (back == 0 || back > 32 || (recv_bits & (1u << (back - 1)))) {
+            return false;
+        }
+        recv_bits |= 1u << (back - 1);
+    }
+    if (chan != CHAN_ACK && !ack_pending) {
+        ack_pending = true;
+        ack_since = now;
+    }
+
+    stripHeader(p);
+    switch (chan) {
+        case CHAN_UNRELIABLE:
+            if (have_unreliable && !seqNewer(chan_seq, unreliable_in)) {
+                return false;
+            }
+            have_unreliable = true;
+            unreliable_in = chan_seq;
+            return true;
+
+        case CHAN_RELIABLE:
+            if (chan_seq == reliable_in) {
+                reliable_in++;
+                return true;
+            }
+            /* hold on to it until the ones before it turn up */
+            if (seqNewer(chan_seq, reliable_in) &&
+                (Uint16)(chan_seq - reliable_in) < NET_RELIABLE_WINDOW) {
+                UDPpacket **e = &early[chan_seq % NET_RELIABLE_WINDOW];
+                if (!*e) {
+                    *e = pool->get();
+                    memcpy( (*e)->data, p->data, p->len );
+                    (*e)->len = p->len;
+                    (*e)->address = p->address;
+                    (*e)->channel = p->channel;
+                }
+            }
+            return false;
+
+        default:
+            return false;
+    }
+}
+
+UDPpacket *Connection::nextReady()
+{
+    UDPpacket **e = &early[reliable_in % NET_RELIABLE_WINDOW];
+    UDPpacket *ret = *e;
+
+    if (ret) {
+        *e = NULL;
+        reliable_in++;
+    }
+    return ret;
+}
+
+void Connection::sampleCounters(ConnCounters *total, ConnCounters *recent)
+{
+    *total = counters;
+    recent->packets_out = counters.packets_out - sampled.packets_out;
+    recent->packets_in  = counters.packets_in - sampled.packets_in;
+    recent->bytes_out   = counters.bytes_out - sampled.bytes_out;
+    recent->bytes_in    = counters.bytes_in - sampled.bytes_in;
+    recent->retransmits = counters.retransmits - sampled.retransmits;
+    recent->delivered   = counters.delivered - sampled.delivered;
+    recent->lost        = counters.lost - sampled.lost;
+    recent->dropped_in  = counters.dropped_in - sampled.dropped_in;
+    recent->dropped_out = counters.dropped_out - sampled.dropped_out;
+    sampled = counters;
+}
+
+int Connection::stripHeader(UDPpacket *p)
+{
+    if (p->len < NET_HEADER_LEN) {
+        return -1;
+    }
+    int chan = p->data[8];
+    p->len -= NET_HEADER_LEN;
+    memmove( p->data, p->data + NET_HEADER_LEN, p->len );
+    return chan;
+}
+
+/*_________________________________private___________________________________*/
+
+void Connection::writeHeader(Uint8 *buf, int chan, Uint16 chan_seq,
+                             Uint32 now, bool is_reliable)
+{
+    SentInfo *s = &sent[local_seq % NET_SENT_WINDOW];
+
+    s->seq = local_seq;
+    s->used = true;
+    s->acked = false;
+    s->reliable = is_reliable;
+    s->ack_only = chan == CHAN_ACK;
+    s->msg = chan_seq;
+    s->time = now;
+
+    SDLNet_Write16(local_seq++, &buf[0]);
+    SDLNet_Write16(remote_seq, &buf[2]);
+    SDLNet_Write32(recv_bits, &buf[4]);
+    buf[8] = chan;
+    SDLNet_Write16(chan_seq, &buf[9]);
+
+    /* this datagram carries our acks */
+    ack_pending = false;
+}
+
+void Connection::handleAck(Uint16 seq, Uint32 now)
+{
+    SentInfo *s = &sent[seq % NET_SENT_WINDOW];
+
+    if (!s->used || s->acked || s->seq != seq) {
+        return;
+    }
+    s->acked = true;
+    updateRTT(now - s->time);
+
+    if (s->reliable) {
+        ReliableInfo *r = &reliable[s->msg % NET_RELIABLE_WINDOW];
+        if (r->p && r->msg == s->msg) {
+            pool->unref(r->p);
+            r->p = NULL;
+        }
+        while (reliable_tail != reliable_head &&
+               !reliable[reliable_tail % NET_RELIABLE_WINDOW].p) {
+            reliable_tail++;
+        }
+    }
+}
+
+/* the smoothed round trip time and timeout from RFC 2988 */
+void Connection::updateRTT(int sample)
+{
+    if (!have_rtt) {
+        srtt = sample;
+        rttvar = sample / 2;
+        have_rtt = true;
+    } else {
+        rttvar = (3*rttvar + abs(srtt - sample)) / 4;
+        srtt = (7*srtt + sample) / 8;
+    }
+    rto = max(NET_MIN_RTO, min(srtt + 4*rttvar, NET_MAX_RTO));
+}
+
+/* Everything more than 32 behind the newest ack has had its last chance to
+ * be acked, so it was either delivered or lost. Datagrams that only carry
+ * acks don't get acked themselves, so they are left out. */
+void Connection::countLosses(Uint16 ack)
+{
+    Uint16 horizon = ack - 32;
+
+    while (seqNewer(horizon, loss_checked) && loss_checked != local_seq) {
+        SentInfo *s = &sent[loss_checked % NET_SENT_WINDOW];
+
+        if (s->used && s->seq == loss_checked && !s->ack_only) {
+            if (s->acked) {
+                counters.delivered++;
+            } else {
+                counters.lost++;
+            }
+        }
+        loss_checked++;
+    }
+}
@@ -0,0 +1,198 @@
+/*
+ *  Copyright (C) 2005 Joe Neeman <spuzzzzzzz@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#ifndef CONNECTION_H
+#define CONNECTION_H
+
+#include "Gnumch.h"
+#include <SDL_net.h>
+
+class PacketPool;
+
+/* Every datagram starts with this header, ahead of the packet header that is
+ * described in NetworkThread.cpp:
+ * ---------------------------------------------------------------------------
+ * | Seq (16) | Ack (16) | Ack bits (32) | Channel (8) | Channel seq (16) | ...
+ * ---------------------------------------------------------------------------
+ *
+ * Seq numbers every datagram sent on a connection. Ack is the newest seq we
+ * have had from the other end, and bit n of Ack bits is set if we have also
+ * had Ack - 1 - n. So every datagram acks the last 33 that came in, and a
+ * lost ack doesn't matter much.
+ *
+ * Channel says how the payload should be delivered (see NetChannel) and
+ * Channel seq numbers the payloads on that channel. A reliable payload that
+ * is resent goes in a new datagram with a new seq, but keeps its channel
+ * seq. */
+#define NET_HEADER_LEN 11
+
+enum NetChannel {
+    CHAN_UNRELIABLE = 0,    /* newest wins; late or lost ones are dropped */
+    CHAN_RELIABLE   = 1,    /* resent until acked and handled in order */
+    CHAN_OOB        = 0xFE, /* not part of a connection; the header is empty */
+    CHAN_ACK        = 0xFF  /* no payload, just acks */
+};
+
+/* the number of datagrams we remember sending, for matching acks */
+#define NET_SENT_WINDOW 256
+
+/* the most reliable payloads that can be waiting for acks */
+#define NET_RELIABLE_WINDOW 256
+
+/* how long we wait for something to piggyback acks on before we send them
+ * on their own */
+#define NET_ACK_DELAY 30
+
+/* limits on the retransmit timeout, in ms */
+#define NET_INITIAL_RTO 250
+#define NET_MIN_RTO 50
+#define NET_MAX_RTO 2000
+
+/* give up on the connection after resending a payload this many times */
+#define NET_MAX_RETRIES 10
+
+/* running totals for one connection, from when it was made */
+typedef struct {
+    Uint32 packets_out, packets_in;
+    Uint64 bytes_out, bytes_in;     /* including the connection header */
+    Uint32 retransmits;
+    Uint32 delivered, lost;         /* datagrams that were acked, or that
+                                     * can't be any more */
+    Uint32 dropped_in, dropped_out; /* datagrams dropped by the network
+                                     * thread's rate limits; dropped_in
+                                     * aren't counted in packets_in */
+} ConnCounters;
+
+/* One end of a connection: it writes and reads the header above, works out
+ * the round trip time, and resends reliable payloads that go unacked for
+ * longer than the retransmit timeout. It doesn't touch the socket, and all of
+ * its functions must be called from the network thread. */
+class Connection {
+    public:
+        Connection(PacketPool*);
+        ~Connection();
+
+        /** Write the header for an unreliable payload into buf. */
+        void        writeUnreliable(Uint8 *buf, Uint32 now);
+
+        /** Write the header for a datagram that just carries acks. */
+        void        writeAck(Uint8 *buf, Uint32 now);
+
+        /** Write the header for a datagram outside of any connection. */
+        static void writeOOB(Uint8 *buf);
+
+        /** Keep a reference to p and send it reliably (see nextResend).
+         *  @return false if too many payloads are already waiting. */
+        bool        queueReliable(UDPpacket *p);
+
+        /** Get the next reliable payload that is due to be sent or resent,
+         *  and write its header into buf.
+         *  @return the payload, or NULL when there are no more. */
+        UDPpacket  *nextResend(Uint8 *buf, Uint32 now);
+
+        /** @return whether we owe the other end some acks and haven't
+         *  had anything to send them with for a while. */
+        bool        wantsAck(Uint32 now);
+
+        /** Read and strip the header of a datagram from the other end.
+         *  @return whether p should be handled now. */
+        bool        receive(UDPpacket *p, Uint32 now);
+
+        /** Get the next reliable payload that arrived early and can now be
+         *  handled. It belongs to the pool: unref it when done.
+         *  @return the payload, or NULL when there are no more. */
+        UDPpacket  *nextReady();
+
+        /** Read the channel of a datagram and strip its header. */
+        static int  stripHeader(UDPpacket *p);
+
+        /** Count a datagram of the given length (header and all) that was
+         *  sent on this connection. Received ones are counted by receive(). */
+        void        countSent(int bytes)
+            {counters.packets_out++; counters.bytes_out += bytes;}
+        /** Count a datagram that was dropped for going over a rate limit. */
+        void        countDropped(bool in)
+            {if (in) counters.dropped_in++; else counters.dropped_out++;}
+        /** Get the totals so far, and what they have gone up by since the
+         *  last call. */
+        void        sampleCounters(ConnCounters *total, ConnCounters *recent);
+
+        bool        failed() {return fail;}
+        void        setFailed() {fail = true;}
+        int         getRTT() {return srtt;}
+        int         getRTO() {return rto;}
+        int         getRTTVar() {return rttvar;}
+        /* the reliable payloads that are waiting for acks */
+        int         getBacklog() {return (Uint16)(reliable_head - reliable_tail);}
+
+    private:
+        typedef struct {
+            Uint16 seq;
+            bool   used;
+            bool   acked;
+            bool   reliable;
+            bool   ack_only;    /* not acked itself, so not counted */
+            Uint16 msg;     /* the channel seq of a reliable payload */
+            Uint32 time;
+        } SentInfo;
+
+        typedef struct {
+            UDPpacket *p;
+            Uint16 msg;
+            int    retries;
+            Uint32 next_send;
+        } ReliableInfo;
+
+        void        writeHeader(Uint8 *buf, int chan, Uint16 chan_seq,
+                                Uint32 now, bool reliable);
+        void        handleAck(Uint16 seq, Uint32 now);
+        void        updateRTT(int sample);
+        void        countLosses(Uint16 ack);
+
+        PacketPool *pool;
+        bool        fail;
+        ConnCounters counters;
+        ConnCounters sampled;   /* counters at the last sampleCounters() */
+
+        /* sending */
+        Uint16       local_seq;
+        Uint16       loss_checked;      /* the oldest seq not yet counted */
+        SentInfo     sent[NET_SENT_WINDOW];
+        Uint16       unreliable_out;
+        Uint16       reliable_head;     /* the next reliable seq to use */
+        Uint16       reliable_tail;     /* the oldest unacked one */
+        ReliableInfo reliable[NET_RELIABLE_WINDOW];
+
+        /* round trip time */
+        bool        have_rtt;
+        int         srtt;
+        int         rttvar;
+        int         rto;
+
+        /* receiving */
+        bool        have_remote;
+        Uint16      remote_seq;
+        Uint32      recv_bits;
+        bool        ack_pending;
+        Uint32      ack_since;
+        bool        have_unreliable;
+        Uint16      unreliable_in;
+        Uint16      reliable_in;        /* the next reliable seq to handle */
+        UDPpacket  *early[NET_RELIABLE_WINDOW];
+};
+
+#endif
@@ -102,12 +102,12 @@ Number *EqualityLevel::randomNumber()
     int val;
     bool good;
 
-    if (rand() > RAND_MAX/2) {
+    if (gnumchRand() > RAND_MAX/2) {
         val = curlevel;
         good = true;
     } else {
         int error = RANDLT(c->max_error)+1;
-        if (rand() > RAND_MAX/2) {
+        if (gnumchRand() > RAND_MAX/2) {
             val = curlevel+error;
         } else {
             val = curlevel-error;
@@ -150,12 +150,12 @@ Number *InequalityLevel::randomNumber()
     int val;
     bool good;
 
-    if (rand() > RAND_MAX/2) {
+    if (gnumchRand() > RAND_MAX/2) {
         val = curlevel;
         good = false;
     } else {
         int error = RANDLT(c->max_error)+1;
-        if (rand() > RAND_MAX/2) {
+        if (gnumchRand() > RAND_MAX/2) {
             val = curlevel+error;
         } else {
             val = max(curlevel-error, 1);
@@ -188,12 +188,8 @@ void InequalityLevel::nextLevel()
 EqualityGUI::EqualityGUI(EqualityConfig *c):
     ExpressionLevelGUI(c),
     lab_error(_("Maximum error")),
-    spin_error(MAX_ERROR)
+    spin_error(MAX_ERROR, MIN_ERROR, MAX_ERROR - c->max_error)
 {
-    for (int i=MAX_ERROR-1; i >= MIN_ERROR; i--) {
-        spin_error.addItem(i);
-    }
-    spin_error.setItem(MAX_ERROR - c->max_error);
     options.add(&lab_error, &spin_error);
     apply.setCallback(reinterpret_cast<Clickable::Callback>(applyChanges), this);
 }
@@ -156,13 +156,8 @@ int FactorLevel::numFactors(int n)
 FactorGUI::FactorGUI(FactorConfig *c):
     LevelGUI(c),
     min_factors_label(_("Minimum number of factors")),
-    min_factors_spin(MAX_FACTORS)
+    min_factors_spin(MAX_FACTORS, MIN_FACTORS, MAX_FACTORS - c->min_num_factors)
 {
-    for (int i=MAX_FACTORS-1; i >= MIN_FACTORS; i--) {
-        min_factors_spin.addItem(i);
-    }
-    min_factors_spin.setItem(MAX_FACTORS - c->min_num_factors);
-
     options.add(&min_factors_label, &min_factors_spin);
     apply.setCallback((Clickable::Callback)applyChanges, this);
 }
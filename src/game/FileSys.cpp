@@ -19,9 +19,12 @@
 #include <Game.h>
 #include <ConfigFile.h>
 
-extern Game *game;
+extern __thread Game *game;
 
 SDL_mutex *FileSys::fs_mutex;
+map<string, FileSys::FontFace> FileSys::font_faces;
+map<pair<string, int>, TTF_Font*> FileSys::fonts;
+map<TTF_Font*, FileSys::FontRef> FileSys::font_refs;
 
 FileSys::FileSys()
 {
@@ -37,8 +40,20 @@ FileSys::FileSys()
     } else {
         base = new Directory(main, NULL);
     }
+    openDirs();
+}
+
+/* Use home and data instead of the user's own directory and the installed
+ * data. Both must end in a slash. */
+FileSys::FileSys(const char *home, const char *data)
+{
+    base = new Directory(home, data);
+    openDirs();
+}
 
-    /* set up the directory structure */
+/* set up the directory structure under base */
+void FileSys::openDirs()
+{
     anim        = new Directory(base, "animation"   );
     anim_pic    = new Directory(    anim, "pics"    );
     anim_sound  = new Directory(    anim, "sounds"  );
@@ -51,6 +66,19 @@ FileSys::FileSys()
 
 FileSys::~FileSys()
 {
+    map<TTF_Font*, FontRef>::iterator f;
+    for (f=font_refs.begin(); f!=font_refs.end(); f++) {
+        TTF_CloseFont(f->first);
+    }
+    font_refs.clear();
+    fonts.clear();
+
+    map<string, FontFace>::iterator i;
+    for (i=font_faces.begin(); i!=font_faces.end(); i++) {
+        free(i->second.data);
+    }
+    font_faces.clear();
+
     delete base;
     delete anim;
     delete anim_pic;
@@ -62,19 +90,90 @@ FileSys::~FileSys()
 TTF_Font *FileSys::openFont(const char *name, int size)
 {
     TTF_Font *ret;
-    string filename;
+    pair<string, int> key(name, size);
 
     SDL_mutexP(fs_mutex);
-    getFile(font, filename, name);
-    SDL_mutexV(fs_mutex);
+    map<pair<string, int>, TTF_Font*>::iterator i = fonts.find(key);
+    if (i != fonts.end()) {
+        ret = i->second;
+        font_refs[ret].refs++;
+        SDL_mutexV(fs_mutex);
+        return ret;
+    }
 
-    ret = TTF_OpenFont(filename.c_str(), size);
+    const FontFace *face;
+    try {
+        face = &getFontFace(name);
+    } catch (int e) {
+        SDL_mutexV(fs_mutex);
+        throw;
+    }
+
+    /* SDL_ttf reads the face lazily, so the data must stay around for as
+     * long as the font is open. It is only freed in ~FileSys() */
+    ret = TTF_OpenFontRW(SDL_RWFromConstMem(face->data, face->len), 1, size);
     if(!ret) {
         printError("Couldn't open font: %s\n", TTF_GetError());
     }
+    printMsg(2, "opened font %s at size %d\n", name, size);
+
+    FontRef ref;
+    ref.name = name;
+    ref.size = size;
+    ref.refs = 1;
+    fonts[key] = ret;
+    font_refs[ret] = ref;
+    SDL_mutexV(fs_mutex);
     return ret;
 }
 
+void FileSys::closeFont(TTF_Font *f)
+{
+    if (!f) return;
+
+    SDL_mutexP(fs_mutex);
+    map<TTF_Font*, FontRef>::iterator i = font_refs.find(f);
+    if (i == font_refs.end()) {
+        printWarning("closing a font that wasn't opened by openFont()\n");
+        TTF_CloseFont(f);
+    } else if (--i->second.refs == 0) {
+        fonts.erase(make_pair(i->second.name, i->second.size));
+        font_refs.erase(i);
+        TTF_CloseFont(f);
+    }
+    SDL_mutexV(fs_mutex);
+}
+
+/* read a font file into memory, unless we already have it. Must be called
+ * with fs_mutex held */
+const FileSys::FontFace &FileSys::getFontFace(const char *name)
+{
+    map<string, FontFace>::iterator i = font_faces.find(name);
+    if (i != font_faces.end()) {
+        return i->second;
+    }
+
+    string filename;
+    FontFace face;
+    getFile(font, filename, name);
+
+    FILE *f = fopen(filename.c_str(), "rb");
+    if (!f) {
+        printError("Couldn't open font %s: %s\n", filename.c_str(),
+                   strerror(errno));
+    }
+    fseek(f, 0, SEEK_END);
+    face.len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    face.data = (char*)malloc(face.len);
+    if ((int)fread(face.data, 1, face.len, f) != face.len) {
+        printError("Couldn't read font %s\n", filename.c_str());
+    }
+    fclose(f);
+
+    return font_faces[name] = face;
+}
+
 SDL_Surface *FileSys::openPic(const char *name, int w, int h)
 {
     if(!name) return NULL;
@@ -259,6 +358,56 @@ void FileSys::saveScore(const char *name, int score)
     fout.close();
 }
 
+/* the saved game goes straight in the user's directory, without looking in
+ * the shared one */
+string FileSys::savedGameFile(const char *kind)
+{
+    return string(base->name()) + "saved-game-" + kind;
+}
+
+bool FileSys::loadGame(const char *kind, vector<Uint8> *data)
+{
+    FILE *f = fopen(savedGameFile(kind).c_str(), "rb");
+    Uint8 buf[4096];
+    size_t n;
+
+    if(!f) {
+        return false;
+    }
+    data->clear();
+    while( (n = fread(buf, 1, sizeof(buf), f)) > 0 ) {
+        data->insert(data->end(), buf, buf + n);
+    }
+    fclose(f);
+    return true;
+}
+
+void FileSys::saveGame(const char *kind, const Uint8 *data, int len)
+{
+    string filename = savedGameFile(kind);
+    string tmp = filename + ".tmp";
+    FILE *f = fopen(tmp.c_str(), "wb");
+    bool ok = f && fwrite(data, 1, len, f) == (size_t)len;
+
+    /* the data has to be on the disk before the new name is, or losing
+     * power could leave an empty file in place of the last save */
+    if(f && (fflush(f) != 0 || fsync(fileno(f)) != 0)) {
+        ok = false;
+    }
+    if(f && fclose(f) != 0) {
+        ok = false;
+    }
+    if(!ok || rename(tmp.c_str(), filename.c_str()) != 0) {
+        printWarning("couldn't save the game to %s\n", filename.c_str());
+        remove(tmp.c_str());
+    }
+}
+
+void FileSys::forgetGame(const char *kind)
+{
+    remove(savedGameFile(kind).c_str());
+}
+
 void FileSys::getCfg(string &ret, const string &name) throw (int)
 {
     getFile(base, ret, name);
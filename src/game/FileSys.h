@@ -55,8 +55,16 @@ class FileSys {
         };
 
         FileSys();
+        FileSys(const char *home, const char *data);
         ~FileSys();
+        /// Open a font, or share one that is already open.
+
+        /** Fonts are reference counted: every call to openFont() should
+         *  be matched by a call to closeFont(). The font file itself is
+         *  only read once and is shared between all sizes.
+         */
         TTF_Font *openFont(const char *name, int size);
+        void closeFont(TTF_Font*);
         SDL_Surface *openPic(const char *name, int w, int h);
         SDL_Surface *openAnimPic(const char *name, int w, int h);
         Mix_Chunk *openSound(const char *name);
@@ -69,6 +77,17 @@ class FileSys {
         bool checkScore(int);
         void saveScore(const char *name, int);
 
+        /* A game in progress, as from TroggleGame::saveState(). There is
+         * one for each kind of level (see Level::getKind()), so starting
+         * a different kind doesn't overwrite it. It is written under
+         * another name, synced and then renamed, so a crash part way
+         * through leaves the last one whole. saveGame() can take a while
+         * and may be called from any thread. loadGame() returns false if
+         * there isn't one. */
+        bool loadGame(const char *kind, vector<Uint8>*);
+        void saveGame(const char *kind, const Uint8*, int len);
+        void forgetGame(const char *kind);
+
         void getFullPath(string*, const char *name, int dir) throw (int);
 
     protected:
@@ -83,8 +102,26 @@ class FileSys {
         SDL_Surface *openAnimPic(const string&, int width, int height);
         vector<string> *scanDir(Directory*, string);
         void getFile(Directory*, string&, const string&) throw (int);
+        string savedGameFile(const char *kind);
+        void openDirs();
 
         static SDL_mutex *fs_mutex;
+
+        /* the font registry; all of this is protected by fs_mutex */
+        struct FontFace {
+            char *data;
+            int len;
+        };
+        struct FontRef {
+            string name;
+            int size;
+            int refs;
+        };
+        static map<string, FontFace> font_faces;
+        static map<pair<string, int>, TTF_Font*> fonts;
+        static map<TTF_Font*, FontRef> font_refs;
+
+        const FontFace &getFontFace(const char *name);
 };
 
 #endif
@@ -25,6 +25,7 @@
 
 #include <Troggle.h>
 #include <Muncher.h>
+#include <BitStream.h>
 
 /* all routines in SDL_gfx expect the color to be 0xRRGGBBAA */
 Uint32 white = 0xffffffff;
@@ -40,6 +41,12 @@ extern Container *enter_score_menu;
 #define FONT_MESSAGE_DIV 45
 #define FONT_SQUARE_DIV 55
 
+/* how many numbers to re-render per frame after a resolution change */
+#define RERENDER_PER_FRAME 4
+
+/* the longest level kind that a saved game can name */
+#define SAVE_MAX_KIND 256
+
 SDL_Color color_black = {0, 0, 0};
 extern FileSys *fs;
 
@@ -64,12 +71,16 @@ Game::Game(const GameSettings &set, const Menu::VideoSettings &video,
   background_file  = "menu_back.png";
   background       = NULL;
   board_bg         = NULL;
+  asset_thread        = NULL;
+  pending_background  = NULL;
+  pending_trogwarning = NULL;
   message          = NULL;
   message_button   = NULL;
   message_stop     = 0;
 
   board = NULL;
   level = NULL;
+  rand_seed = rand();
 
   /* font settings */
   fontname[FONT_SQUARE] = fontname[FONT_MESSAGE] = "URWPalladioL-Roma.ttf";
@@ -145,6 +156,7 @@ void Game::readSettings(GameSettings *set,
 
 Game::~Game()
 {
+  cancelAssetReload();
   delete k1;
   delete k2;
 }
@@ -163,7 +175,7 @@ int Game::getEatTime()
 int Game::getTrogSpawnDelay()
 {
   int delay = (int) 
-    (((double)rand()/(RAND_MAX+1.0)) * (trog_spawn_max - trog_spawn_min)
+    (((double)random()/(RAND_MAX+1.0)) * (trog_spawn_max - trog_spawn_min)
      +  trog_spawn_min);
 
   printMsg(1, "setting trogSpawnDelay = %d\n", delay);
@@ -460,6 +472,7 @@ void Game::changeVideoSettings(const Menu::VideoSettings &settings)
   if (video == settings)
     return;
 
+  int old_w = video.w, old_h = video.h, old_right = right;
   video = settings;
 
   square_width    = video.w / (set.width+2);
@@ -478,27 +491,121 @@ void Game::changeVideoSettings(const Menu::VideoSettings &settings)
   fontsize[FONT_MESSAGE] = video.w/FONT_MESSAGE_DIV;
   for(int i=0; i<FONT_NUM; i++) {
     if(font[i]) { // if !font[i], the game hasn't started yet
-      TTF_CloseFont(font[i]);
+      /* open the new one first, so that an unchanged size is just shared */
+      TTF_Font *old = font[i];
       font[i] = fs->openFont(fontname[i], fontsize[i]);
+      fs->closeFont(old);
     }
   }
+
+  if (video.w == old_w && video.h == old_h) {
+    return;  // only the depth or the flags changed
+  }
+
+  /* Everything below is done in two steps: first we scale what we have
+   * without smoothing, which is quick, so that the game can carry on
+   * straight away. Then the proper versions are loaded or rendered in the
+   * background and updateAssets() swaps them in as they become ready. */
   if (level) {
-    level->reRender();
+    level->rescale((double)video.w / old_w);
   }
 
+  cancelAssetReload();
   if(background) {
-    SDL_FreeSurface(background);
-    background = fs->openPic(background_file, video.w, video.h);
+    quickScale(&background, (double)video.w / old_w, (double)video.h / old_h);
     drawBoardBg();
   }
   if(trogwarning) {
-    SDL_FreeSurface(trogwarning);
-    trogwarning = fs->openPic(trogwarning_file, right, -1);
+    double zoom = (double)right / old_right;
+    quickScale(&trogwarning, zoom, zoom);
+  }
+  if (background || trogwarning) {
+    pending_w = video.w;
+    pending_h = video.h;
+    pending_warn_w = right;
+    assets_ready = false;
+    asset_thread = SDL_CreateThread((int (*)(void*))assetThread, this);
   }
 
   vector<Animation*>::iterator an, an_end = anim.end();
   for(an=anim.begin(); an<an_end; an++)
-    (*an)->reloadPics();
+    (*an)->rescalePics(square_width, square_height);
+}
+
+void Game::updateAssets()
+{
+  bool redraw = false;
+
+  if (asset_thread && assets_ready) {
+    SDL_WaitThread(asset_thread, NULL);
+    asset_thread = NULL;
+    if (pending_background) {
+      SDL_FreeSurface(background);
+      background = pending_background;
+      pending_background = NULL;
+      drawBoardBg();
+    }
+    if (pending_trogwarning) {
+      SDL_FreeSurface(trogwarning);
+      trogwarning = pending_trogwarning;
+      pending_trogwarning = NULL;
+    }
+    redraw = true;
+  }
+
+  vector<Animation*>::iterator an, an_end = anim.end();
+  for(an=anim.begin(); an<an_end; an++) {
+    if ((*an)->swapPics()) {
+      redraw = true;
+    }
+  }
+
+  if (level && level->refineRender(RERENDER_PER_FRAME)) {
+    redraw = true;
+  }
+
+  if (redraw) {
+    redrawAll();
+    SDL_Flip(screen);
+  }
+}
+
+int Game::assetThread(Game *g)
+{
+  if (g->background) {
+    g->pending_background = fs->openPic(g->background_file,
+					g->pending_w, g->pending_h);
+  }
+  if (g->trogwarning) {
+    g->pending_trogwarning = fs->openPic(g->trogwarning_file,
+					 g->pending_warn_w, -1);
+  }
+  g->assets_ready = true;
+  return 0;
+}
+
+void Game::cancelAssetReload()
+{
+  if (!asset_thread) {
+    return;
+  }
+  SDL_WaitThread(asset_thread, NULL);
+  asset_thread = NULL;
+  if (pending_background) {
+    SDL_FreeSurface(pending_background);
+    pending_background = NULL;
+  }
+  if (pending_trogwarning) {
+    SDL_FreeSurface(pending_trogwarning);
+    pending_trogwarning = NULL;
+  }
+}
+
+void Game::quickScale(SDL_Surface **s, double zoomx, double zoomy)
+{
+  SDL_Surface *tmp = zoomSurface(*s, zoomx, zoomy, SMOOTHING_OFF);
+  SDL_FreeSurface(*s);
+  *s = tmp;
 }
 
 void Game::changeSoundSettings(const Menu::SoundSettings &s)
@@ -597,6 +704,9 @@ SDL_Surface *Game::renderText(const char *text, FontType type)
 {
   SDL_Surface *ret;
 
+  if (!font[type]) {
+    return NULL;  // no fonts on a headless server
+  }
   ret = renderString(font[type], text, color_black);
   if(ret->w > square_width || ret->h > square_height) {
     double zoomx, zoomy, zoom;
@@ -851,6 +961,7 @@ void Game::freeGame()
   vector<Animation*>::iterator an;
   vector<Player*>::iterator p;
 
+  cancelAssetReload();
   for(an=anim.begin(); an<anim.end(); an++) {
     delete *an;
   }
@@ -861,7 +972,7 @@ void Game::freeGame()
   if(background) SDL_FreeSurface(background), background=NULL;
   if(board_bg) SDL_FreeSurface(board_bg), board_bg=NULL;
   for(int i=0; i<FONT_NUM; i++) {
-    TTF_CloseFont(font[i]);
+    fs->closeFont(font[i]);
     font[i] = NULL;
   }
 
@@ -1000,7 +1111,9 @@ void TroggleGame::setupTroggles()
   }
   fclose(cfg);
 
-  trogwarning = fs->openPic(trogwarning_file, right, -1);
+  if (screen) {
+    trogwarning = fs->openPic(trogwarning_file, right, -1);
+  }
 
   for( int i=0; i<set.trog_number; i++ ) {
     troggles.push_back( new Troggle() );
@@ -1017,6 +1130,7 @@ void TroggleGame::freeTroggles()
   for (td=trogdef.begin(); td<trogdef.end(); td++) {
     delete *td;
   }
+  cancelAssetReload();
   if (trogwarning) {
     SDL_FreeSurface(trogwarning);
     trogwarning=NULL;
@@ -1030,7 +1144,7 @@ TroggleDef *TroggleGame::randomTroggle()
   if (cur_trog_type == 0) {
     return trogdef.at(0);
   }
-  return trogdef.at((int)((double)cur_trog_type*rand() / (RAND_MAX + 1.0)));
+  return trogdef.at((int)((double)cur_trog_type*random() / (RAND_MAX + 1.0)));
 }
 
 void TroggleGame::nextTrogLevel()
@@ -1083,3 +1197,209 @@ void TroggleGame::resetTroggles()
       troggles[i]->die( SDL_GetTicks() );
     }
 }
+
+int TroggleGame::saveState(Uint8 *buf, int max)
+{
+  BitWriter out(buf, max);
+
+  out.write(SAVE_MAGIC, 32);
+  out.write(SAVE_VERSION, 8);
+  writeKind(out);
+  writeState(out, SDL_GetTicks());
+  return out.overflow() ? -1 : out.length();
+}
+
+/* The level and the board check what they are given before they change
+ * anything, but the players are loaded one at a time. So the game is saved
+ * first, and put back from that if the data turns out to be garbled part
+ * way through. */
+LoadResult TroggleGame::loadState(const Uint8 *buf, int len)
+{
+  BitReader in(buf, len);
+
+  if (in.read(32) != SAVE_MAGIC || in.read(8) != SAVE_VERSION) {
+    return LOAD_GARBLED;
+  }
+  if (!sameKind(in)) {
+    return in.overflow() ? LOAD_GARBLED : LOAD_OTHER_GAME;
+  }
+
+  vector<Uint8> old(SAVE_MAX_SIZE);
+  int old_len = saveState(&old[0], old.size());
+
+  if (readState(in, SDL_GetTicks()) && !in.overflow()) {
+    return LOAD_OK;
+  }
+  if (old_len > 0) {
+    BitReader back(&old[0], old_len);
+    back.read(32);
+    back.read(8);
+    sameKind(back);
+    readState(back, SDL_GetTicks());
+  }
+  return LOAD_GARBLED;
+}
+
+/* A game can only be loaded into one with the same kind of level, the same
+ * size of board and the same troggles and players, since those are all
+ * set up before it is loaded. */
+void TroggleGame::writeKind(BitWriter &out)
+{
+  out.writeString(level->getKind());
+  out.writeGamma(getWidth());
+  out.writeGamma(getHeight());
+  out.writeGamma(trogdef.size());
+  out.writeGamma(players.size());
+}
+
+bool TroggleGame::sameKind(BitReader &in)
+{
+  string kind = in.readString(SAVE_MAX_KIND);
+  Uint32 w = in.readGamma();
+  Uint32 h = in.readGamma();
+  Uint32 ntrogdef = in.readGamma();
+  Uint32 nplayers = in.readGamma();
+
+  return !in.overflow() && kind == level->getKind()
+    && w == (Uint32)getWidth() && h == (Uint32)getHeight()
+    && ntrogdef == trogdef.size() && nplayers == players.size();
+}
+
+/* A saved game is laid out as follows:
+ * -------------------------------------------------------------------------
+ * | magic | version | level kind | width | height | # troggle types |
+ * -------------------------------------------------------------------------
+ * | # players | level | board | troggles in play | troggle types |
+ * -------------------------------------------------------------------------
+ * | players ... | dead troggles | warned troggles | waiting |
+ * -------------------------------------------------------------------------
+ * Each troggle among the players starts with its type, as one more than its
+ * place in trogdef, or 0 if it hasn't spawned yet. Each queue is its length
+ * and then, for each entry, the place of the player in troggles (or in
+ * players, for the ones waiting to spawn), and then when it is due or
+ * where it spawns. */
+void TroggleGame::writeState(BitWriter &out, int now)
+{
+  size_t i;
+
+  level->save(out);
+  board->save(out);
+  out.writeGamma(cur_num_trog);
+  out.writeGamma(cur_trog_type);
+
+  for (i=0; i<players.size(); i++) {
+    if (players[i]->isTroggle()) {
+      TroggleDef *d = static_cast<Troggle*>(players[i])->getDef();
+      out.writeGamma(d ? find(trogdef.begin(), trogdef.end(), d)
+		     - trogdef.begin() + 1 : 0);
+    }
+    players[i]->save(out, now);
+  }
+
+  out.writeGamma(trog_dead.size());
+  for (i=0; i<trog_dead.size(); i++) {
+    out.writeGamma(find(troggles.begin(), troggles.end(), trog_dead[i])
+		   - troggles.begin());
+    out.writeSigned(trog_warning_times[i] - now);
+  }
+  out.writeGamma(trog_spawning.size());
+  for (i=0; i<trog_spawning.size(); i++) {
+    out.writeGamma(find(troggles.begin(), troggles.end(), trog_spawning[i])
+		   - troggles.begin());
+    out.writeSigned(trog_spawning_times[i] - now);
+  }
+  out.writeGamma(spawning_players.size());
+  for (i=0; i<spawning_players.size(); i++) {
+    out.writeGamma(find(players.begin(), players.end(), spawning_players[i])
+		   - players.begin());
+    out.writeSigned(player_spawning_points[i].x);
+    out.writeSigned(player_spawning_points[i].y);
+  }
+}
+
+/* Read a troggle queue into trogs and times. */
+static bool readTrogQueue(BitReader &in, int now,
+			  const vector<Troggle*> &troggles,
+			  deque<Troggle*> *trogs, deque<int> *times)
+{
+  Uint32 n = in.readGamma();
+
+  if (n > troggles.size()) {
+    return false;
+  }
+  for (Uint32 i=0; i<n; i++) {
+    Uint32 t = in.readGamma();
+    int time = now + in.readSigned();
+
+    if (in.overflow() || t >= troggles.size()) {
+      return false;
+    }
+    trogs->push_back(troggles[t]);
+    times->push_back(time);
+  }
+  return true;
+}
+
+bool TroggleGame::readState(BitReader &in, int now)
+{
+  if (!level->load(in) || !board->load(in, level)) {
+    return false;
+  }
+
+  Uint32 num_trog = in.readGamma();
+  Uint32 trog_type = in.readGamma();
+  if (in.overflow() || num_trog > troggles.size()
+      || trog_type > trogdef.size()) {
+    return false;
+  }
+
+  for (size_t i=0; i<players.size(); i++) {
+    if (players[i]->isTroggle()) {
+      Uint32 d = in.readGamma();
+      if (d > trogdef.size()) {
+	return false;
+      }
+      if (d) {
+	static_cast<Troggle*>(players[i])->setDef(trogdef[d-1]);
+      }
+    }
+    if (!players[i]->load(in, now)) {
+      return false;
+    }
+  }
+
+  deque<Troggle*> dead, spawning;
+  deque<int> warning_times, spawning_times;
+  vector<Player*> waiting;
+  vector<Point> points;
+
+  if (!readTrogQueue(in, now, troggles, &dead, &warning_times)
+      || !readTrogQueue(in, now, troggles, &spawning, &spawning_times)) {
+    return false;
+  }
+  Uint32 n = in.readGamma();
+  if (n > players.size()) {
+    return false;
+  }
+  for (Uint32 i=0; i<n; i++) {
+    Uint32 p = in.readGamma();
+    int x = in.readSigned();
+    int y = in.readSigned();
+
+    if (in.overflow() || p >= players.size() || !board->contains(x, y)) {
+      return false;
+    }
+    waiting.push_back(players[p]);
+    points.push_back(Point(x, y));
+  }
+
+  cur_num_trog = num_trog;
+  cur_trog_type = trog_type;
+  trog_dead.swap(dead);
+  trog_warning_times.swap(warning_times);
+  trog_spawning.swap(spawning);
+  trog_spawning_times.swap(spawning_times);
+  spawning_players.swap(waiting);
+  player_spawning_points.swap(points);
+  return true;
+}
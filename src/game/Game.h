@@ -31,6 +31,21 @@ class Level;
 class Number;
 class Animation;
 class AnimationState;
+class BitWriter;
+class BitReader;
+
+/* a saved game (see TroggleGame::saveState) starts with SAVE_MAGIC and
+ * SAVE_VERSION, and is never longer than SAVE_MAX_SIZE */
+#define SAVE_MAGIC 0x476e5367  /* "GnSg" */
+#define SAVE_VERSION 2
+#define SAVE_MAX_SIZE 16384
+
+/* what TroggleGame::loadState made of a saved game */
+typedef enum {
+  LOAD_OK,
+  LOAD_OTHER_GAME,    /* fine, but not saved from a game like this one */
+  LOAD_GARBLED
+} LoadResult;
 
 typedef enum {
   FONT_SQUARE,
@@ -110,11 +125,17 @@ class Game {
   virtual void    pause();
   virtual void    run(Level*, SDL_Surface*) = 0;
   virtual void    changeVideoSettings(const Menu::VideoSettings&);
+  // swap in any full quality graphics that have finished loading since the
+  // last resolution change. Call this once per frame; it never blocks.
+  virtual void    updateAssets();
   virtual void    changeSoundSettings(const Menu::SoundSettings&);
   virtual void    changeGameSettings(const GameSettings&);
   virtual void    changeKeyBindings(const KeyBindings&, const KeyBindings&);
   virtual string  getError(int, int);
   virtual Number  *randomNumber();
+  // a random number from 0 to RAND_MAX, from this game's own generator
+  int             random() { return rand_r(&rand_seed); }
+  void            setSeed(unsigned int seed) { rand_seed = seed; }
   void            drawSquareBg(int, int);
   void            drawBackground(const Rectangle&);
   SDL_Surface *renderText(const char*, FontType);
@@ -130,6 +151,7 @@ class Game {
 
   GameSettings set;
   Menu::VideoSettings video;
+  unsigned int rand_seed;
   KeyBindings *k1, *k2;
 
   /* muncher/troggle behaviour settings */
@@ -169,6 +191,17 @@ class Game {
   SDL_Surface *board_bg;
   void drawBoardBg();
 
+  /* after a resolution change, the background and trogwarning are scaled
+   * roughly straight away and loaded properly in this thread */
+  SDL_Thread *asset_thread;
+  SDL_Surface *pending_background;
+  SDL_Surface *pending_trogwarning;
+  int pending_w, pending_h, pending_warn_w;
+  volatile bool assets_ready;
+  static int assetThread(Game*);
+  void cancelAssetReload();
+  static void quickScale(SDL_Surface**, double zoomx, double zoomy);
+
   /* game over filename */
   char *gameover_file;
 
@@ -228,7 +261,29 @@ class TroggleGame: public Game {
   static void writeSettings(int);
   static void readSettings(int*);
 
+  // Save the state of the game: the level, the board, every player and
+  // the spawn queues. Times are saved relative to now, so a game that is
+  // loaded later carries on where it left off.
+  //   return the number of bytes written, or -1 if it didn't fit.
+  int saveState(Uint8 *buf, int max);
+
+  // Load a game saved by saveState() into this one, which must already be
+  // set up as the saved one was: the same settings, and the board,
+  // players and troggles made. This game is left alone unless it returns
+  // LOAD_OK.
+  //   return LOAD_OTHER_GAME if it was saved from a different kind of
+  //   level, or with a different board or players.
+  LoadResult loadState(const Uint8 *buf, int len);
+
  protected:
+  // the start of a saved game, which says what kind of game it is
+  void writeKind(BitWriter&);
+  bool sameKind(BitReader&);
+
+  // subclasses add their own state to these
+  virtual void writeState(BitWriter&, int now);
+  virtual bool readState(BitReader&, int now);
+
   vector<Troggle*> troggles;
   deque<Troggle*>  trog_dead;
   deque<int>       trog_warning_times;
@@ -18,26 +18,21 @@
 #include <Gnumch.h>
 #include <Game.h>
 #include <FileSys.h>
-#include "menus/MainMenu.h"
-#include "menus/Menus.h"
 #include <signal.h>
+#include <sys/time.h>
 
 #define JAXIS_THRESHOLD 3
 
-static int verbosity;
+int verbosity;
 
-Game *game;
+/* each server room runs on a worker thread with its own game */
+__thread Game *game;
 FileSys *fs;
 Menu *menu;
 
 // render in utf8 or text?
 bool utf8 = true;
 
-/* CLI parsing stuff */
-const static char *optstring = "hvV";
-extern char *optarg;
-extern int optind, opterr;
-
 bool Point::operator== (Point param)
 {
     return x == param.x && y == param.y;
@@ -82,6 +77,15 @@ void sprintf(string *str, const char *fmt, ...)
     va_end(ap);
 }
 
+/* SDL_GetTicks is too coarse to time a tick */
+Uint64 microseconds()
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return (Uint64)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
 void printMsg(int v, const char *fmt, ...)
 {
     if(verbosity >= v) {
@@ -112,20 +116,14 @@ void printError(const char *fmt, ...)
     raise(SIGABRT);
 }
 
-void version()
+int gnumchRand()
 {
-    printf("This is %s, version %s\n", PACKAGE, VERSION);
+    return game ? game->random() : rand();
 }
 
-void usage(const char *name)
+void version()
 {
-    version();
-    printf("Usage: %s [OPTIONS]\n\
-\n\
-Options:\n\
-  -h                Display this help message\n\
-  -v                Verbose output\n\
-  -V                Display version information\n", name);
+    printf("This is %s, version %s\n", PACKAGE, VERSION);
 }
 
 /* drop all events except MOUSEMOTION, MOUSEBUTTONDOWN and QUIT */
@@ -182,70 +180,3 @@ int gameEventFilter(const SDL_Event *event)
     }
     return 0;
 }
-
-int main(int argc, char **argv)
-{
-    int c;
-
-    if(SDL_Init(SDL_INIT_TIMER | SDL_INIT_VIDEO) == -1) {
-        printError("couldn't init SDL: %s\n", SDL_GetError());
-    }
-    if(TTF_Init() == -1) {
-        printError("couldn't init TTF: %s\n", TTF_GetError());
-    }
-    atexit (SDL_Quit);
-
-#ifdef HAVE_LOCALE_H
-#ifdef ENABLE_NLS
-    if(!setlocale(LC_MESSAGES, "") || !setlocale(LC_CTYPE, ""))
-        printWarning("couldn't set your locale. Make sure it is installed correctly\n");
-
-    /* try to switch to utf8 */
-    if( !bind_textdomain_codeset(PACKAGE, "UTF-8") ) {
-        printWarning("couldn't switch to UTF-8\n");
-        utf8 = false;
-    }
-    const char *tmp = bindtextdomain(PACKAGE, LOCALEDIR);
-    printMsg(1, "after bindtextdomain(), domain is %s\n", tmp);
-    /* textdomain(PACKAGE); */
-#endif
-#endif
-    SDL_EnableUNICODE(1);
-
-    fs   = new FileSys();
-    while((c=getopt(argc, argv, optstring)) >= 0) {
-        switch(c) {
-            case 'h':
-            case '?':
-                usage(argv[0]);
-                exit(0);
-                break;
-            case 'v':
-                verbosity++;
-                break;
-            case 'V':
-                version();
-                exit(0);
-                break;
-            case ':':
-                fprintf(stderr, "you need to specify an argument to -%c\n", c);
-                exit(1);
-                break;
-        }
-    }
-
-    Game::GameSettings gset;
-    Menu::VideoSettings vset;
-    Menu::SoundSettings sset;
-    KeyBindings dummy;
-
-    Game::readSettings( &gset, &vset, &sset, &dummy, &dummy );
-    SDL_SetEventFilter(menuEventFilter);
-    Menu::changeSoundSettings(sset);
-    Menu::changeVideoSettings(vset);
-    Menu::setBackground("menu_back.png");
-    pushMenu(new MainMenu());
-    Menu::run();
-    return 1;
-}
-
@@ -64,8 +64,12 @@
 #   define ngettext(a,b,c) ((c)>1 ? (b) : (a))
 #endif
 
-#define RAND(a) ( (int) ((float)(a)*rand() / (RAND_MAX + 1.0)) )
-#define RANDLE(a) ( (int)(rand()*(a+1.0) / (RAND_MAX+1.0)) )
+/* like rand(), but uses the current game's generator if there is one, so
+ * that games running side by side on a server don't share a sequence */
+int gnumchRand();
+
+#define RAND(a) ( (int) ((float)(a)*gnumchRand() / (RAND_MAX + 1.0)) )
+#define RANDLE(a) ( (int)(gnumchRand()*(a+1.0) / (RAND_MAX+1.0)) )
 #define RANDLT(a) RANDLE(a-1)
 
 
@@ -83,6 +87,7 @@ class Point {
 void printMsg(int, const char*, ...);
 void printWarning(const char *, ...);
 void printError(const char *, ...);
+void version();
 
 int menuEventFilter(const SDL_Event*);
 int gameEventFilter(const SDL_Event*);
@@ -93,6 +98,9 @@ void stringSize(TTF_Font*, const char*, int *, int*);
 string itostr(int i, int w=0);
 void sprintf(string*, const char*, ...);
 
+/* a clock for timing things, in microseconds */
+Uint64 microseconds();
+
 /* used for hash_maps and maps */
 class eqstr
 {
@@ -0,0 +1,114 @@
+/*
+ *  Copyright (C) 2005 Joe Neeman <spuzzzzzzz@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#include "JoinState.h"
+#include "Wire.h"
+
+/* Encoded join states look like this:
+ * ----------------------------------------------------------------------
+ * | title (s) | trog warning (b) | # scores (b) | scores (i) ... | snap
+ * ----------------------------------------------------------------------
+ * with the fields as in Wire.h, and the snapshot encoded in full as in
+ * Snapshot.cpp. Snapshot encoding already leaves out the empty squares and
+ * numbers the repeated texts, which is what makes it smaller than the
+ * board: a typical level fits in one fragment.
+ */
+
+JoinState::JoinState()
+{
+    trog_warning = false;
+}
+
+int JoinState::encode(Uint8 *buf, int max) const
+{
+    WireWriter out(buf, max);
+
+    out.put( "sbb", title.substr(0, WIRE_STRING_MAX).c_str(),
+             (int)trog_warning, (int)scores.size() );
+    for( size_t i=0; i<scores.size(); i++ ) {
+        out.zigzag(scores[i]);
+    }
+    if( out.overflow() ) {
+        return -1;
+    }
+
+    int len = snap.encode( NULL, buf + out.length(), max - out.length() );
+    return len < 0 ? -1 : out.length() + len;
+}
+
+bool JoinState::decode(const Uint8 *buf, int len)
+{
+    WireReader in(buf, len);
+    WireArgs a;
+
+    if( !in.get("sbb", &a) ) {
+        return false;
+    }
+    title = a.s[0];
+    trog_warning = a.n[0];
+    scores.resize(a.n[1]);
+    for( size_t i=0; i<scores.size(); i++ ) {
+        scores[i] = in.zigzag();
+    }
+    if( in.overflow() || in.left() < 1 ) {
+        return false;
+    }
+    return snap.decode( NULL, buf + in.position(), in.left() );
+}
+
+JoinAssembler::JoinAssembler()
+{
+    started = done = false;
+    id = 0;
+    count = missing = len = 0;
+}
+
+bool JoinAssembler::add(Uint16 id, int frag, int count, const Uint8 *data,
+                        int len)
+{
+    bool last = frag == count - 1;
+
+    if( count < 1 || count > JOIN_MAX_FRAGMENTS || frag < 0 ||
+        frag >= count || len < 1 || len > JOIN_FRAGMENT_SIZE ||
+        (!last && len != JOIN_FRAGMENT_SIZE) ) {
+        printMsg(1, "dropping malformed join fragment\n");
+        return false;
+    }
+    if( started && (Sint16)(id - this->id) < 0 ) {
+        return false;
+    }
+    if( !started || id != this->id ) {
+        started = true;
+        done = false;
+        this->id = id;
+        this->count = count;
+        missing = count;
+        have.assign(count, false);
+        buf.resize(count * JOIN_FRAGMENT_SIZE);
+    }
+    if( done || count != this->count || have[frag] ) {
+        return false;
+    }
+
+    memcpy( &buf[frag * JOIN_FRAGMENT_SIZE], data, len );
+    have[frag] = true;
+    if( last ) {
+        this->len = frag * JOIN_FRAGMENT_SIZE + len;
+    }
+    done = --missing == 0;
+    return done;
+}
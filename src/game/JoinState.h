@@ -0,0 +1,83 @@
+/*
+ *  Copyright (C) 2005 Joe Neeman <spuzzzzzzz@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#ifndef JOINSTATE_H
+#define JOINSTATE_H
+
+#include "Gnumch.h"
+#include "Snapshot.h"
+
+/* A join state is sent in pieces of this many bytes (the last may be
+ * shorter), so that each piece fits in one packet */
+#define JOIN_FRAGMENT_SIZE 1024
+#define JOIN_MAX_FRAGMENTS 16
+
+/* Everything that a client needs to draw a room that it has just joined:
+ * the level, the scores, and a full snapshot of the board and the players.
+ * The server sends one instead of a snapshot to any player that has no
+ * snapshot to build a delta on, in as many fragments as it takes. Once the
+ * client acks it, it gets ordinary deltas against it. */
+class JoinState {
+    public:
+        JoinState();
+
+        /** Encode the whole state.
+         *  @return the number of bytes written, or -1 if it didn't fit. */
+        int     encode(Uint8 *buf, int max) const;
+
+        /** @return false if the data is garbled. */
+        bool    decode(const Uint8 *buf, int len);
+
+        string title;           /* of the level being played */
+        bool trog_warning;      /* whether the troggle warning is showing */
+        vector<int> scores;     /* indexed by player id */
+        Snapshot snap;          /* the id isn't encoded; it comes with the
+                                 * fragments */
+};
+
+/* Puts the fragments of a join state back together. Fragments can arrive in
+ * any order, and the server sends a new join state each time that it would
+ * have sent a snapshot, so a fragment of a newer one throws away whatever
+ * we had of an older one. */
+class JoinAssembler {
+    public:
+        JoinAssembler();
+
+        /** Add one fragment. Old and garbled ones are ignored.
+         *  @param id the snapshot id of the join state
+         *  @param frag which fragment this is, from 0
+         *  @param count how many fragments there are
+         *  @return true if this completed the join state; it stays in
+         *          data() until the next call. */
+        bool    add(Uint16 id, int frag, int count, const Uint8 *data,
+                    int len);
+
+        const Uint8 *data() {return &buf[0];}
+        int     length() {return len;}
+
+    private:
+        bool started;
+        bool done;
+        Uint16 id;
+        int count;
+        int missing;        /* how many fragments haven't arrived */
+        int len;            /* known once the last fragment arrives */
+        vector<bool> have;
+        vector<Uint8> buf;
+};
+
+#endif
@@ -23,6 +23,12 @@
 #include <FactorLevel.h>
 #include <MultipleLevel.h>
 #include <EqualityLevel.h>
+#include <BitStream.h>
+
+/* the longest title, and the most numbers in a list, that a saved level may
+ * have */
+#define SAVE_MAX_TITLE 256
+#define SAVE_MAX_LIST 100000
 
 extern FileSys *fs;
 
@@ -112,7 +118,7 @@ const char *numlist_final_separator()
     return _(" and ");
 }
 
-extern Game *game;
+extern __thread Game *game;
 extern FileSys *fs;
 
 Number::Number(const string &text_, bool isgood_, int value_)
@@ -121,6 +127,7 @@ Number::Number(const string &text_, bool isgood_, int value_)
     isgood = isgood_;
     value = value_;
     pic = NULL;
+    stale = false;
 }
 
 Number::~Number()
@@ -132,6 +139,17 @@ void Number::render()
 {
     if(pic) SDL_FreeSurface(pic);
     pic = game->renderText(text.c_str(), FONT_SQUARE);
+    stale = false;
+}
+
+void Number::rescale(double zoom)
+{
+    if (pic) {
+        SDL_Surface *tmp = zoomSurface(pic, zoom, zoom, SMOOTHING_OFF);
+        SDL_FreeSurface(pic);
+        pic = tmp;
+        stale = true;
+    }
 }
 
 void Number::unrender()
@@ -182,6 +200,32 @@ void Level::reRender()
     }
 }
 
+void Level::rescale(double zoom)
+{
+    map<Number*, int, ltnum>::iterator i;
+
+    for (i=numbers.begin(); i != numbers.end(); i++) {
+        i->first->rescale(zoom);
+    }
+}
+
+bool Level::refineRender(int max)
+{
+    map<Number*, int, ltnum>::iterator i;
+    bool rendered = false;
+
+    for (i=numbers.begin(); i != numbers.end(); i++) {
+        if (i->first->isStale()) {
+            if (max-- <= 0) {
+                return false;
+            }
+            i->first->render();
+            rendered = true;
+        }
+    }
+    return rendered;
+}
+
 Number *Level::addNumber(const char *text, bool good, int value)
 {
     map<Number*, int, ltnum>::iterator i;
@@ -199,6 +243,28 @@ Number *Level::addNumber(const char *text, bool good, int value)
     return ret;
 }
 
+/* The kind of level goes first, so that a saved game of one kind isn't
+ * loaded into another. A level that is out of the configured range is
+ * refused too, since the settings have changed since it was saved. */
+void Level::save(BitWriter &out)
+{
+    out.writeSigned(curlevel);
+    out.writeString(title);
+}
+
+bool Level::load(BitReader &in)
+{
+    int cur = in.readSigned();
+    string t = in.readString(SAVE_MAX_TITLE);
+
+    if (in.overflow() || cur < conf->minlevel || cur > conf->maxlevel) {
+        return false;
+    }
+    curlevel = cur;
+    title = t;
+    return true;
+}
+
 string Level::translateList(const vector<int> &list)
 {
     bool prev = false;
@@ -232,22 +298,16 @@ void Level::getFactors(vector<int> *vec, int n)
 }
 
 LevelGUI::LevelGUI(LevelConfig *c):
-    min_spin(c->abs_maxlevel),
-    max_spin(c->abs_maxlevel),
+    min_spin(c->abs_maxlevel, c->abs_minlevel, c->abs_maxlevel - c->minlevel),
+    max_spin(c->abs_maxlevel, c->abs_minlevel, c->abs_maxlevel - c->maxlevel),
     apply(_("Apply")),
     cancel(_("Cancel")),
     min_label(_("Minimum level")),
     max_label(_("Maximum level")),
     conf(c)
 {
-    for (int i=c->abs_maxlevel-1; i >= c->abs_minlevel; i--) {
-        min_spin.addItem(i);
-        max_spin.addItem(i);
-        min_spin.setCallback((Spinner<int>::Callback)minSpinCallback, &max_spin);
-        max_spin.setCallback((Spinner<int>::Callback)maxSpinCallback, &min_spin);
-    }
-    min_spin.setItem(c->abs_maxlevel - c->minlevel);
-    max_spin.setItem(c->abs_maxlevel - c->maxlevel);
+    min_spin.setCallback((Spinner<int>::Callback)minSpinCallback, &max_spin);
+    max_spin.setCallback((Spinner<int>::Callback)maxSpinCallback, &min_spin);
 
     apply.setCallback((Clickable::Callback)applyChanges, this);
     cancel.setCallback(popMenu, NULL);
@@ -285,7 +345,7 @@ Number *ListedNumberLevel::randomNumber()
     int val;
     bool good;
 
-    if (rand()%2) {
+    if (gnumchRand()%2) {
         good = false;
         val = bad_num[ RANDLT(bad_num.size()) ];
     } else {
@@ -297,6 +357,48 @@ Number *ListedNumberLevel::randomNumber()
     return addNumber(text.c_str(), good, val);
 }
 
+static void saveList(BitWriter &out, const vector<int> &list)
+{
+    out.writeGamma(list.size());
+    for (int i=0; i<(int)list.size(); i++) {
+        out.writeSigned(list[i]);
+    }
+}
+
+/* randomNumber() picks from both lists, so neither can be empty */
+static bool loadList(BitReader &in, vector<int> *list)
+{
+    Uint32 n = in.readGamma();
+
+    list->clear();
+    if (n == 0 || n > SAVE_MAX_LIST) {
+        return false;
+    }
+    for (Uint32 i=0; i<n && !in.overflow(); i++) {
+        list->push_back(in.readSigned());
+    }
+    return !in.overflow();
+}
+
+void ListedNumberLevel::save(BitWriter &out)
+{
+    Level::save(out);
+    saveList(out, good_num);
+    saveList(out, bad_num);
+}
+
+bool ListedNumberLevel::load(BitReader &in)
+{
+    vector<int> good, bad;
+
+    if (!Level::load(in) || !loadList(in, &good) || !loadList(in, &bad)) {
+        return false;
+    }
+    good_num.swap(good);
+    bad_num.swap(bad);
+    return true;
+}
+
 const ExpressionLevel::GetExpr ExpressionLevel::getExprFns[] = {
     ExpressionLevel::getAddExpr,
     ExpressionLevel::getSubExpr,
@@ -306,20 +408,13 @@ const ExpressionLevel::GetExpr ExpressionLevel::getExprFns[] = {
 
 ExpressionLevelGUI::ExpressionLevelGUI(ExpressionLevelConfig *c):
     LevelGUI(c),
-    maxsub_spin(EXPR_MAX_SUBTRACTOR),
-    maxdiv_spin(EXPR_MAX_DIVISOR),
+    maxsub_spin(EXPR_MAX_SUBTRACTOR, EXPR_MIN_SUBTRACTOR,
+                EXPR_MAX_SUBTRACTOR - c->maxsub),
+    maxdiv_spin(EXPR_MAX_DIVISOR, EXPR_MIN_DIVISOR,
+                EXPR_MAX_DIVISOR - c->maxdiv),
     lab_maxsub(_("Maximum subtractor")),
     lab_maxdiv(_("Maximum divisor"))
 {
-    for (int i=EXPR_MAX_SUBTRACTOR-1; i >= EXPR_MIN_SUBTRACTOR; i--) {
-        maxsub_spin.addItem(i);
-    }
-    for (int i=EXPR_MAX_DIVISOR-1; i >= EXPR_MIN_DIVISOR; i--) {
-        maxdiv_spin.addItem(i);
-    }
-    maxsub_spin.setItem(EXPR_MAX_SUBTRACTOR - c->maxsub);
-    maxdiv_spin.setItem(EXPR_MAX_DIVISOR - c->maxdiv);
-
     lab_op[ADD].setText(_("Addition"));
     lab_op[SUB].setText(_("Subtraction"));
     lab_op[MUL].setText(_("Multiplication"));
@@ -375,7 +470,7 @@ void ExpressionLevel::getExpr(int val)
     assert(numops>0);
 
     int max = RAND_MAX - RAND_MAX%numops;
-    int r = rand() % max;
+    int r = gnumchRand() % max;
     int thresh = max/numops;
     for (int i=ADD; i<=DIV; i++)
       {
@@ -42,6 +42,13 @@ class Number {
         /** Free the internal SDL_Surface */
         void unrender();
 
+        /** Quickly (and roughly) scale the internal SDL_Surface. The Number
+         *  is then stale until render() is called again. */
+        void rescale(double zoom);
+
+        /** Return true if the picture was scaled rather than rendered. */
+        bool isStale() {return stale;}
+
         /** Return the internal SDL_Surface. Used for drawing the number. */
         SDL_Surface *getPic();
 
@@ -58,6 +65,7 @@ class Number {
         string text;
         vector<string> error;    /* the list of items that gets displayed if this number is eaten erroneously */
         SDL_Surface *pic;
+        bool stale;
         bool isgood;
         int  value;
 };
@@ -80,6 +88,8 @@ typedef enum {
 
 class Level;
 class ConfigFile;
+class BitWriter;
+class BitReader;
 
 class LevelConfig {
     public:
@@ -99,6 +109,9 @@ class LevelConfig {
         virtual Level *makeLevel() = 0;
         virtual Container *makeConfigDialog();
 
+        /** Return the section of gnumch.cfg that this is saved in */
+        const char *getSection() const {return section;}
+
     protected:
         const char *section;
         ConfigFile *conf;
@@ -148,11 +161,28 @@ class Level {
         /** Return a random Number belonging to this Level */
         virtual Number  *randomNumber() = 0;
 
+        /** Get the Number with the given text, sharing the one that is
+         *  already in use if there is one. Every call counts as a use; see
+         *  releaseNumber(). This is how a saved Board gets its numbers
+         *  back. */
+        Number *addNumber(const char*, bool, int=0);
+
         /** Force all the numbers in this level to redraw their internal
          *  pictures. This is used if, for example, the game font changes.
          */
         void reRender();
 
+        /** Scale all the numbers' pictures by \p zoom without re-rendering
+         *  them. Use refineRender() to render them properly afterwards.
+         */
+        void rescale(double zoom);
+
+        /** Re-render at most \p max of the numbers that were scaled by
+         *  rescale().
+         *  @return true if this call rendered the last of them.
+         */
+        bool refineRender(int max);
+
         /** Notify the level that this number is not being used any more.
          *  This is used to implement a reference-counting GC for the numbers.
          */
@@ -161,6 +191,10 @@ class Level {
         /** Return the title of the current level being played */
         const char *getLevelTitle() {return title.c_str();}
 
+        /** Return the name of this kind of level, which is the same in
+         *  every language */
+        const char *getKind() {return conf->getSection();}
+
         /** Return a formatted error message for when a Muncher eats the
          *  wrong number.
          *  @param num the number that was erroneously eaten.
@@ -171,6 +205,14 @@ class Level {
         /** Go to the next level. */
         virtual void nextLevel() = 0;
 
+        /** Write which level this is and anything that depends on it, for
+         *  a saved game. */
+        virtual void save(BitWriter&);
+
+        /** Go back to a level written by save() on the same kind of Level.
+         *  @return false if the data is garbled. */
+        virtual bool load(BitReader&);
+
         /** Return a list of available title/description/Level* tuples */
         static void getLevelList(vector<LevelConfig*>*);
 
@@ -184,7 +226,6 @@ class Level {
         string error;
 
         string translateList(const vector<int>&);
-        Number *addNumber(const char*, bool, int=0);
 
         // helpful math functions
         static void getFactors(vector<int> *factors, int n);
@@ -197,6 +238,9 @@ class ListedNumberLevel: public Level {
 
         Number *randomNumber();
 
+        virtual void save(BitWriter&);
+        virtual bool load(BitReader&);
+
     protected:
         vector<int> good_num, bad_num;
 };
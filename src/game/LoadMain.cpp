@@ -0,0 +1,683 @@
+/*
+ *  Copyright (C) 2005 Joe Neeman <spuzzzzzzz@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#include <Gnumch.h>
+#include <Game.h>
+#include <FileSys.h>
+#include <Level.h>
+#include "MultiPlayerServer.h"
+#include "NetworkThread.h"
+#include "NetEmulator.h"
+#include "RoomPool.h"
+#include "Prediction.h"
+#include <signal.h>
+#include <unistd.h>
+
+extern __thread Game *game;
+extern FileSys *fs;
+extern int verbosity;
+
+/* a synthetic client sends very little, so it needs few packets */
+#define LOAD_POOL_SIZE 16
+
+/* how long to wait for an answer to a registration before asking again */
+#define LOAD_REGISTER_RETRY 500
+
+/* a board that disagrees with the snapshots for longer than this (in ms) is
+ * counted as a desync */
+#define LOAD_DESYNC_GRACE 500
+
+/* CLI parsing stuff */
+const static char *optstring = "hvVH:p:n:s:t:k:R:w:l:e:S:";
+extern char *optarg;
+extern int optind, opterr;
+
+/* One synthetic player. It registers with the server, presses random keys
+ * at a steady rate, and acks snapshots and pings like a real client. It
+ * also keeps the board as the GAME_SETNUM events describe it, and counts a
+ * desync when that stays different from the snapshots. It starts from the
+ * server's JoinState, and times how long that takes to arrive: until then,
+ * a real client would have nothing correct to show. Its keys go through a
+ * Predictor, as a real client's would, and it counts a misprediction when
+ * the server's muncher doesn't end up where the Predictor said it would
+ * once the server has acted on the same keys. The load generator
+ * polls every client from one thread, so they have no threads of their
+ * own. */
+class LoadClient: public NetThread {
+    public:
+        /** @param watch 0 to play, or a spectator's tier plus one */
+        LoadClient(const IPaddress *server, int room, int number,
+                   int watch=0);
+
+        /** Handle what has arrived, press a key if one is due, and send.
+         *  @param batch NET_BATCH packets to receive into
+         *  @param key_interval ms between key presses, or 0 for none */
+        void poll(UDPpacket **batch, Uint32 now, int key_interval);
+
+        bool registered() {return id >= 0;}
+        bool ok() {return sock->ok() && !refused && !lost;}
+        int  getSent() {return sock->getSent();}
+        int  getReceived() {return sock->getReceived();}
+
+        /* ping times (ms), times from asking to join until the first
+         * correct board (ms), desyncs and mispredictions since the caller
+         * last cleared them */
+        vector<int> rtts;
+        vector<int> join_times;
+        int desyncs;
+        int mispredictions;
+
+    private:
+        virtual void handleEvent(UDPpacket*, enum NetEvent, const WireArgs&);
+        virtual void handlePing(UDPpacket*);
+        virtual void handleAck(UDPpacket*);
+        virtual void handleRegister(UDPpacket*);
+        virtual void handleSnapshot(UDPpacket*);
+        virtual void handleJoin(UDPpacket*);
+        virtual void handleDisconnect(playerInfo_t*);
+
+        void checkBoard(const Snapshot*, Uint32 now);
+        void checkPrediction(const Snapshot*, Uint32 input);
+        void setBoard(const Snapshot*);
+
+        string name;
+        int room;
+        int watch;
+        int id;
+        bool refused;
+        bool lost;
+        Uint32 last_register;
+        Uint32 join_start;      /* when we first asked to join */
+        bool got_state;         /* whether a JoinState has arrived */
+        Uint32 next_key;
+
+        Predictor predictor;
+        Uint32 last_key;        /* the number of the last key pressed */
+        Uint32 predicted_key;   /* the last key in the prediction, or 0 */
+        Point predicted;        /* where it said the muncher would be */
+
+        /* the board according to the events, keyed by (y << 8) | x */
+        map<int, pair<bool, string> > board;
+        Uint32 mismatch_since;
+        SnapshotHistory snapshots;
+        JoinAssembler joining;
+};
+
+LoadClient::LoadClient(const IPaddress *server, int room, int number,
+                       int watch):
+    NetThread(LOAD_POOL_SIZE),
+    predictor(-1),
+    predicted(0, 0)
+{
+    sprintf(&name, watch ? "spectator %d" : "load %d", number);
+    this->room = room;
+    this->watch = watch;
+    id = -1;
+    refused = lost = false;
+    last_register = 0;
+    join_start = 0;
+    got_state = false;
+    next_key = SDL_GetTicks() + rand() % 1000;
+    last_key = predicted_key = 0;
+    desyncs = mispredictions = 0;
+    mismatch_since = 0;
+
+    sock = new NetSocket(0);
+    sock->bind(0, server);
+
+    playerInfo_t *pi = new playerInfo_t;
+    pi->id = -1;
+    pi->channel = 0;
+    pi->room = room;
+    pi->address = *server;
+    pi->name = "server";
+    pi->conn = new Connection(pool);
+    pi->watching = -1;
+    active_players.push_back(pi);
+}
+
+void LoadClient::poll(UDPpacket **batch, Uint32 now, int key_interval)
+{
+    int got;
+
+    while ((got = sock->recv(batch, NET_BATCH)) > 0) {
+        for (int i=0; i<got; i++) {
+            receive(batch[i], now);
+        }
+    }
+
+    if (!ok()) {
+        return;
+    }
+    if (id < 0 && now - last_register >= LOAD_REGISTER_RETRY) {
+        queueSend( createRegisterPacket(name, room, watch) );
+        last_register = now;
+        if (!join_start) {
+            join_start = now;
+        }
+    }
+    if (id >= 0 && !watch && key_interval &&
+        (Sint32)(now - next_key) >= 0) {
+        enum Key key = (enum Key)(rand() % (KEY_MUNCH + 1));
+        last_key = predictor.press(key);
+        queueSend( createEventPacket(PLAYER_KEY, (int)key, (int)last_key) );
+        next_key += key_interval;
+        if ((Sint32)(now - next_key) > 0) {
+            next_key = now + key_interval;
+        }
+    }
+    flushSendQueue();
+}
+
+void LoadClient::handleEvent(UDPpacket*, enum NetEvent e,
+                             const WireArgs &a)
+{
+    switch (e) {
+        case GAME_SETNUM: {
+            int key = (a.n[1] << 8) | a.n[0];
+            if (a.s[0].empty()) {
+                board.erase(key);
+            } else {
+                board[key] = make_pair(a.n[2] != 0, a.s[0]);
+            }
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+void LoadClient::handlePing(UDPpacket *p)
+{
+    queueSend( createAckPacket(p) );
+}
+
+void LoadClient::handleAck(UDPpacket *p)
+{
+    WireArgs a;
+
+    if (readFields(p, &a) != -1) {
+        rtts.push_back( SDL_GetTicks() - (Uint32)a.n[1] );
+    }
+    NetThread::handleAck(p);
+}
+
+void LoadClient::handleRegister(UDPpacket *p)
+{
+    WireArgs a;
+
+    if (id >= 0 || readFields(p, &a) == -1) {
+        return;
+    }
+    if (a.n[1] < 0) {
+        printWarning("%s: room %d is full\n", name.c_str(), room);
+        refused = true;
+    } else {
+        id = a.n[1];
+        predictor = Predictor(id);
+    }
+}
+
+void LoadClient::handleSnapshot(UDPpacket *p)
+{
+    WireArgs a;
+    int start = readFields(p, &a);
+    int len = p->len - PACKET_HEADER_LEN - start;
+
+    if (start == -1 || len < 1) {
+        return;
+    }
+
+    Uint16 snap_id = a.n[0];
+    const Snapshot *s = snapshots.decode(snap_id, a.n[1],
+                                         PACKET_DATA(p) + start, len);
+    if (s) {
+        queueSend( createEventPacket(SNAPSHOT_ACK, (int)snap_id) );
+        checkBoard(s, SDL_GetTicks());
+        if (!watch && id >= 0) {
+            checkPrediction(s, a.n[2]);
+        }
+    }
+}
+
+void LoadClient::handleJoin(UDPpacket *p)
+{
+    WireArgs a;
+    JoinState js;
+    int start = readFields(p, &a);
+
+    if (start == -1 ||
+        !joining.add(a.n[0], a.n[2], a.n[3], PACKET_DATA(p) + start,
+                     p->len - PACKET_HEADER_LEN - start) ||
+        !js.decode(joining.data(), joining.length())) {
+        return;
+    }
+
+    js.snap.id = a.n[0];
+    const Snapshot *s = snapshots.add(js.snap);
+    queueSend( createEventPacket(SNAPSHOT_ACK, (int)s->id) );
+
+    setBoard(s);
+    mismatch_since = 0;
+    if (!got_state) {
+        join_times.push_back( SDL_GetTicks() - join_start );
+        got_state = true;
+    }
+}
+
+void LoadClient::handleDisconnect(playerInfo_t *pi)
+{
+    printWarning("%s: the server has stopped answering\n", name.c_str());
+    lost = true;
+    NetThread::handleDisconnect(pi);
+}
+
+/* Events are reliable and snapshots aren't, so they can arrive in either
+ * order and the board can disagree for a moment. It is only a desync if it
+ * goes on disagreeing; then we take the snapshot's word for it, so that one
+ * fault isn't counted over and over. */
+void LoadClient::checkBoard(const Snapshot *s, Uint32 now)
+{
+    bool same = true;
+
+    for (int i=0; i<s->width*s->height && same; i++) {
+        int key = ((i / s->width) << 8) | (i % s->width);
+        map<int, pair<bool, string> >::iterator b = board.find(key);
+
+        if (b == board.end()) {
+            same = s->text[i].empty();
+        } else {
+            same = b->second.first == s->good[i] &&
+                   b->second.second == s->text[i];
+        }
+    }
+
+    if (same) {
+        mismatch_since = 0;
+    } else if (!mismatch_since) {
+        mismatch_since = now | 1;
+    } else if (now - mismatch_since > LOAD_DESYNC_GRACE) {
+        desyncs++;
+        mismatch_since = 0;
+        setBoard(s);
+    }
+}
+
+/* A prediction can only be checked against the snapshot that the server
+ * took just after acting on its last key; by the next one, the server may
+ * have acted on keys that the prediction didn't know about. There is no
+ * local muncher, so none of the keys are waiting to be acted on here. */
+void LoadClient::checkPrediction(const Snapshot *s, Uint32 input)
+{
+    Point pos(0, 0);
+
+    if (predicted_key && input == predicted_key && id < (int)s->players.size()
+        && s->players[id].exist && (s->players[id].x != predicted.x ||
+                                    s->players[id].y != predicted.y)) {
+        mispredictions++;
+    }
+    if (predicted_key && (Sint32)(input - predicted_key) >= 0) {
+        predicted_key = 0;
+    }
+
+    if (!predicted_key && predictor.reconcile(*s, input, 0, s->width,
+                                              s->height, &pos)
+        && predictor.pending()) {
+        predicted = pos;
+        predicted_key = last_key;
+    }
+}
+
+void LoadClient::setBoard(const Snapshot *s)
+{
+    board.clear();
+    for (int i=0; i<s->width*s->height; i++) {
+        if (!s->text[i].empty()) {
+            int key = ((i / s->width) << 8) | (i % s->width);
+            board[key] = make_pair((bool)s->good[i], s->text[i]);
+        }
+    }
+}
+
+void usage(const char *name, const vector<LevelConfig*> &levels)
+{
+    version();
+    printf("Usage: %s [OPTIONS]\n\
+\n\
+Measures how much load a server can take. Synthetic clients join in steps,\n\
+and after each step the server tick time, packet rates, ping times,\n\
+desyncs, mispredictions and the time from asking to join until the board\n\
+is right are reported. Unless -H is given, the server runs in this process\n\
+on the loopback interface.\n\
+\n\
+Options:\n\
+  -h                Display this help message\n\
+  -v                Verbose output\n\
+  -V                Display version information\n\
+  -H HOST           Load the server running on HOST instead\n\
+  -p PORT           The server's port (default %d)\n\
+  -n CLIENTS        Stop after this many clients (default 64)\n\
+  -s STEP           Add STEP clients at a time (default 8)\n\
+  -t SECONDS        Run each step for SECONDS (default 5)\n\
+  -k RATE           Each client presses RATE keys a second (default 4)\n\
+  -R ROOMS          Host ROOMS games (default: enough for every client)\n\
+  -w THREADS        Run the rooms on THREADS threads (default: one per CPU)\n\
+  -e PROFILE        Add the latency and loss described in PROFILE to each\n\
+                    client's network (see NetEmulator.h). Each client's\n\
+                    seed is offset by its number, so runs repeat exactly.\n\
+  -S SPECTATORS     Have SPECTATORS more clients watch the first room from\n\
+                    the start, spread over the rate tiers (default 0)\n\
+  -l LEVEL          The number of the level to play (default 1):\n", name,
+           SERVER_PORT);
+    for (int i=0; i<(int)levels.size(); i++) {
+        printf("                      %d  %s\n", i+1, levels[i]->title);
+    }
+}
+
+static volatile sig_atomic_t stopping = 0;
+
+void stopLoad(int)
+{
+    stopping = 1;
+}
+
+/* the pth percentile of v, which is sorted */
+static int percentile(const vector<int> &v, int p)
+{
+    return v.empty() ? 0 : v[(v.size() - 1) * p / 100];
+}
+
+int main(int argc, char **argv)
+{
+    int c;
+    const char *host = NULL;
+    int port = SERVER_PORT;
+    int max_clients = 64;
+    int step = 8;
+    int step_secs = 5;
+    int key_rate = 4;
+    int num_rooms = 0;
+    int level_num = 1;
+    int workers = sysconf(_SC_NPROCESSORS_ONLN);
+    const char *profile_file = NULL;
+    int num_spectators = 0;
+
+    if(SDL_Init(SDL_INIT_TIMER | SDL_INIT_NOPARACHUTE) == -1) {
+        printError("couldn't init SDL: %s\n", SDL_GetError());
+    }
+    atexit (SDL_Quit);
+
+    fs = new FileSys();
+    vector<LevelConfig*> levels;
+    Level::getLevelList(&levels);
+
+    while((c=getopt(argc, argv, optstring)) >= 0) {
+        switch(c) {
+            case 'h':
+            case '?':
+                usage(argv[0], levels);
+                exit(0);
+                break;
+            case 'v':
+                verbosity++;
+                break;
+            case 'V':
+                version();
+                exit(0);
+                break;
+            case 'H':
+                host = optarg;
+                break;
+            case 'p':
+                port = atoi(optarg);
+                break;
+            case 'n':
+                max_clients = atoi(optarg);
+                break;
+            case 's':
+                step = atoi(optarg);
+                break;
+            case 't':
+                step_secs = atoi(optarg);
+                break;
+            case 'k':
+                key_rate = atoi(optarg);
+                break;
+            case 'R':
+                num_rooms = atoi(optarg);
+                break;
+            case 'w':
+                workers = atoi(optarg);
+                break;
+            case 'l':
+                level_num = atoi(optarg);
+                break;
+            case 'e':
+                profile_file = optarg;
+                break;
+            case 'S':
+                num_spectators = atoi(optarg);
+                break;
+            case ':':
+                fprintf(stderr, "you need to specify an argument to -%c\n", c);
+                exit(1);
+                break;
+        }
+    }
+    if (max_clients < 1 || step < 1 || step_secs < 1 || key_rate < 0) {
+        fprintf(stderr, "the client counts, step time and key rate must be "
+                        "positive\n");
+        exit(1);
+    }
+    if (level_num < 1 || level_num > (int)levels.size()) {
+        fprintf(stderr, "there is no level %d\n", level_num);
+        exit(1);
+    }
+    if (num_rooms == 0) {
+        num_rooms = (max_clients + MAX_PLAYERS - 1) / MAX_PLAYERS;
+    }
+    if (num_rooms < 1 || num_rooms > MAX_ROOMS) {
+        fprintf(stderr, "the number of rooms must be between 1 and %d\n",
+                MAX_ROOMS);
+        exit(1);
+    }
+
+    NetProfile profile;
+    if (profile_file && !NetEmulator::readProfile(profile_file, &profile)) {
+        fprintf(stderr, "couldn't read the network profile %s\n",
+                profile_file);
+        exit(1);
+    }
+
+    IPaddress server;
+    const char *server_name = host ? host : "127.0.0.1";
+    if (SDLNet_ResolveHost(&server, server_name, port) == -1) {
+        fprintf(stderr, "couldn't find %s\n", server_name);
+        exit(1);
+    }
+
+    /* the same set-up as gnumch-server */
+    RoomPool *pool = NULL;
+    ServerNetThread *net = NULL;
+    vector<MultiPlayerServer*> rooms;
+    vector<Level*> room_levels;
+
+    if (!host) {
+        Game::GameSettings gset;
+        Menu::VideoSettings vset;
+        Menu::SoundSettings sset;
+        KeyBindings dummy;
+        int trog_mask;
+
+        Game::readSettings( &gset, &vset, &sset, &dummy, &dummy );
+        TroggleGame::readSettings( &trog_mask );
+
+        pool = new RoomPool(max(1, min(workers, num_rooms)));
+        net = new ServerNetThread(pool, port);
+        for (int i=0; i<num_rooms; i++) {
+            MultiPlayerServer *room = new MultiPlayerServer(gset, "load",
+                                                            net, i);
+            room->setTrogMask(trog_mask);
+
+            game = room;
+            room_levels.push_back( levels[level_num-1]->makeLevel() );
+            room->begin(room_levels[i]);
+            pool->addRoom(room);
+            rooms.push_back(room);
+        }
+        game = NULL;
+        pool->start();
+        net->start();
+    }
+
+    signal(SIGINT, stopLoad);
+    signal(SIGTERM, stopLoad);
+
+    UDPpacket **batch = SDLNet_AllocPacketV(NET_BATCH,
+                                            NET_PREFIX_MAX + NET_PACKET_SIZE);
+    vector<LoadClient*> clients;
+    vector<LoadClient*> spectators;
+    int key_interval = key_rate ? 1000 / key_rate : 0;
+    int sent = 0, received = 0;
+
+    /* they only cost the server anything if they slow down the ticks */
+    for (int n=0; n<num_spectators; n++) {
+        LoadClient *cl = new LoadClient(&server, 0, n,
+                                        n % SPECTATOR_TIERS + 1);
+        if (!cl->ok()) {
+            printWarning("couldn't open a socket for spectator %d\n", n);
+            delete cl;
+            break;
+        }
+        if (profile_file) {
+            cl->emulate( new NetEmulator(profile, max_clients + n) );
+        }
+        spectators.push_back(cl);
+    }
+    if (!spectators.empty()) {
+        printf("%d spectators are watching the first room\n",
+               (int)spectators.size());
+    }
+
+    printf("clients joined  ticks/s  tick avg  tick max  overrun  "
+           "pkts/s out   in  rtt p50  p90  p99  desyncs  mispred  "
+           "join p50  p90\n");
+
+    while (!stopping && (int)clients.size() < max_clients) {
+        for (int i=0; i<step && (int)clients.size() < max_clients; i++) {
+            int n = clients.size();
+            LoadClient *cl = new LoadClient(&server,
+                                            (n / MAX_PLAYERS) % num_rooms, n);
+            if (!cl->ok()) {
+                printWarning("couldn't open a socket for client %d\n", n);
+                delete cl;
+                stopping = 1;
+                break;
+            }
+            if (profile_file) {
+                cl->emulate( new NetEmulator(profile, n) );
+            }
+            clients.push_back(cl);
+        }
+        /* throw away the timings from before this step */
+        if (pool) {
+            TickStats ts;
+            pool->takeTickStats(&ts);
+        }
+
+        Uint32 start = SDL_GetTicks();
+        Uint32 now = start;
+        while (!stopping && now - start < (Uint32)step_secs * 1000) {
+            for (int i=0; i<(int)clients.size(); i++) {
+                clients[i]->poll(batch, now, key_interval);
+            }
+            for (int i=0; i<(int)spectators.size(); i++) {
+                spectators[i]->poll(batch, now, 0);
+            }
+            SDL_Delay(1);
+            now = SDL_GetTicks();
+        }
+
+        vector<int> rtts, joins;
+        int joined = 0, desyncs = 0, mispredictions = 0;
+        int now_sent = 0, now_received = 0;
+        for (int i=0; i<(int)clients.size(); i++) {
+            LoadClient *cl = clients[i];
+            joined += cl->registered() && cl->ok();
+            desyncs += cl->desyncs;
+            mispredictions += cl->mispredictions;
+            now_sent += cl->getSent();
+            now_received += cl->getReceived();
+            rtts.insert(rtts.end(), cl->rtts.begin(), cl->rtts.end());
+            cl->rtts.clear();
+            joins.insert(joins.end(), cl->join_times.begin(),
+                         cl->join_times.end());
+            cl->join_times.clear();
+            cl->desyncs = 0;
+            cl->mispredictions = 0;
+        }
+        sort(rtts.begin(), rtts.end());
+        sort(joins.begin(), joins.end());
+
+        double secs = (now - start) / 1000.0;
+        printf("%7d %6d", (int)clients.size(), joined);
+        if (pool) {
+            TickStats ts;
+            pool->takeTickStats(&ts);
+            printf(" %8.0f %7dus %7dus %8d", ts.ticks / secs,
+                   ts.ticks ? (int)(ts.busy_us / ts.ticks) : 0, ts.max_us,
+                   (int)ts.overruns);
+        } else {
+            printf(" %8s %9s %9s %8s", "-", "-", "-", "-");
+        }
+        printf(" %11.0f %5.0f %6dms %4d %4d %8d %8d %7dms %4d\n",
+               (now_sent - sent) / secs, (now_received - received) / secs,
+               percentile(rtts, 50), percentile(rtts, 90),
+               percentile(rtts, 99), desyncs, mispredictions,
+               percentile(joins, 50), percentile(joins, 90));
+        fflush(stdout);
+        sent = now_sent;
+        received = now_received;
+    }
+
+    for (int i=0; i<(int)clients.size(); i++) {
+        delete clients[i];
+    }
+    for (int i=0; i<(int)spectators.size(); i++) {
+        delete spectators[i];
+    }
+    SDLNet_FreePacketV(batch);
+
+    if (pool) {
+        pool->stop();
+        net->stop();
+        for (int i=0; i<num_rooms; i++) {
+            game = rooms[i];
+            rooms[i]->finish();
+            delete rooms[i];
+            delete room_levels[i];
+        }
+        game = NULL;
+        delete net;
+        delete pool;
+    }
+    for (int i=0; i<(int)levels.size(); i++) {
+        delete levels[i];
+    }
+    delete fs;
+    return 0;
+}
@@ -0,0 +1,109 @@
+/*
+ *  Copyright (C) 2005 Joe Neeman <spuzzzzzzz@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#include <Gnumch.h>
+#include <Game.h>
+#include <FileSys.h>
+#include "menus/MainMenu.h"
+#include "menus/Menus.h"
+
+extern FileSys *fs;
+extern int verbosity;
+extern bool utf8;
+
+/* CLI parsing stuff */
+const static char *optstring = "hvV";
+extern char *optarg;
+extern int optind, opterr;
+
+void usage(const char *name)
+{
+    version();
+    printf("Usage: %s [OPTIONS]\n\
+\n\
+Options:\n\
+  -h                Display this help message\n\
+  -v                Verbose output\n\
+  -V                Display version information\n", name);
+}
+
+int main(int argc, char **argv)
+{
+    int c;
+
+    if(SDL_Init(SDL_INIT_TIMER | SDL_INIT_VIDEO) == -1) {
+        printError("couldn't init SDL: %s\n", SDL_GetError());
+    }
+    if(TTF_Init() == -1) {
+        printError("couldn't init TTF: %s\n", TTF_GetError());
+    }
+    atexit (SDL_Quit);
+
+#ifdef HAVE_LOCALE_H
+#ifdef ENABLE_NLS
+    if(!setlocale(LC_MESSAGES, "") || !setlocale(LC_CTYPE, ""))
+        printWarning("couldn't set your locale. Make sure it is installed correctly\n");
+
+    /* try to switch to utf8 */
+    if( !bind_textdomain_codeset(PACKAGE, "UTF-8") ) {
+        printWarning("couldn't switch to UTF-8\n");
+        utf8 = false;
+    }
+    const char *tmp = bindtextdomain(PACKAGE, LOCALEDIR);
+    printMsg(1, "after bindtextdomain(), domain is %s\n", tmp);
+    /* textdomain(PACKAGE); */
+#endif
+#endif
+    SDL_EnableUNICODE(1);
+
+    fs   = new FileSys();
+    while((c=getopt(argc, argv, optstring)) >= 0) {
+        switch(c) {
+            case 'h':
+            case '?':
+                usage(argv[0]);
+                exit(0);
+                break;
+            case 'v':
+                verbosity++;
+                break;
+            case 'V':
+                version();
+                exit(0);
+                break;
+            case ':':
+                fprintf(stderr, "you need to specify an argument to -%c\n", c);
+                exit(1);
+                break;
+        }
+    }
+
+    Game::GameSettings gset;
+    Menu::VideoSettings vset;
+    Menu::SoundSettings sset;
+    KeyBindings dummy;
+
+    Game::readSettings( &gset, &vset, &sset, &dummy, &dummy );
+    SDL_SetEventFilter(menuEventFilter);
+    Menu::changeSoundSettings(sset);
+    Menu::changeVideoSettings(vset);
+    Menu::setBackground("menu_back.png");
+    pushMenu(new MainMenu());
+    Menu::run();
+    return 1;
+}
+
@@ -20,6 +20,8 @@
 
 #include "Game.h"
 #include "MultiPlayerServer.h"
+#include "NetworkThread.h"
+#include "Prediction.h"
 
 class MultiPlayerClient: public Game {
     public:
@@ -45,10 +47,18 @@ class MultiPlayerClient: public Game {
         virtual void    doPlayerMove(int, int, int, int, int, int);
         virtual void    doPlayerStop(int, int, int, int);
         virtual void    doPlayerMunch(int, int, int, int);
-        virtual void    doPlayerSpawn(int, int);
+        virtual void    doPlayerSpawn(int, int, int, int);
         virtual void    doPlayerDie(int, int);
-        virtual void    doUpdateScore(int, int);
+        virtual void    doUpdateScore(int, int, int);
         virtual void    doNextLevel(int);
+        virtual void    doTrogWarning(bool);
+        virtual void    doSetNum(int, int, bool, const string&, int);
+        /* bring the board and players into line with the server, then
+         * replay the local keys it hadn't acted on (see Predictor) */
+        virtual void    doSnapshot(const Snapshot&, Uint32 input, int);
+        /* set up the level, scores and board of a game that we have just
+         * joined, then carry on as for doSnapshot */
+        virtual void    doJoinState(const JoinState&, Uint32 input, int);
         virtual void    addServer(ServerDetails *details);
 
         virtual void    troggleNextSpawn( Troggle*, int );
@@ -75,6 +85,7 @@ class MultiPlayerClient: public Game {
         int next_id;
         vector<Muncher*> munchers;
         vector<PlayerDetails*> muncher_details;
+        vector<Predictor*> predictors;  /* one for each local muncher */
         vector<Troggle*> troggles;
         vector<Player*> remote;
         vector<PlayerDetails*> remote_details;
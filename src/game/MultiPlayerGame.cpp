@@ -261,6 +261,7 @@ void MultiPlayerGame::runLevel()
         }
         handleTrogSpawns();
         tryPlayerSpawn();
+        updateAssets();
         board->update();
         if (!won && !lost) {
             refresh();
@@ -20,66 +20,131 @@
 #include <Menu.h>
 #include "NetworkThread.h"
 #include <Animation.h>
+#include <Muncher.h>
 
 extern FileSys *fs;
 
+static Menu::VideoSettings no_video = {0, 0, 0, 0};
+
 MultiPlayerServer::MultiPlayerServer(const GameSettings &set,
-                                     const Menu::VideoSettings &video,
-                                     int numlocal)
+                                     const char *name, ServerNetThread *net,
+                                     int room):
+    TroggleGame(set, no_video, KeyBindings(), KeyBindings())
 {
-    this->numlocal = numlocal;
-    this->set   = set;
-    this->video = video;
-
-    this->mpmuncher_file = "mpmuncher.cfg";
+    this->name = name;
+    this->net = net;
+    this->room = room;
+    channel = CHANNEL_ROOM(room);
+    tick_rate = SERVER_TICK_RATE;
+    ending = false;
+    start_time = 0;
+    snap_id = 0;
+    snap_tick = 0;
+    join_data.resize(JOIN_MAX_FRAGMENTS * JOIN_FRAGMENT_SIZE);
+    join_len = -1;
+    join_id = 0;
+    events = new EventBatch(net, net->openOutbox(), channel);
+    inbox = new SPSCQueue<RoomInput>(ROOM_INBOX_SIZE);
+
+    for (int i=0; i<MAX_PLAYERS; i++) {
+        muncher[i] = NULL;
+        active[i] = connected[i] = false;
+        details[i].id = i;
+        details[i].lives = 0;
+        details[i].score = 0;
+        scores[i] = 0;
+        snap_acked[i] = -1;
+        input_seq[i] = 0;
+    }
+    for (int i=0; i<SPECTATOR_TIERS; i++) {
+        spectators[i] = 0;
+    }
 }
 
 MultiPlayerServer::~MultiPlayerServer()
 {
+    delete events;
+    delete inbox;
 }
 
 int MultiPlayerServer::addPlayer(const string &name)
 {
-    /* FIXME */
+    for (int i=0; i<MAX_PLAYERS; i++) {
+        if (!connected[i]) {
+            snap_acked[i] = -1;
+            RoomInput in = {RoomInput::ROOM_JOIN, i, KEY_NUM, 0};
+            if (!inbox->push(in)) {
+                return -1;
+            }
+            connected[i] = true;
+            details[i].name = name;
+            return i;
+        }
+    }
     return -1;
 }
 
-void MultiPlayerServer::updateLives(Player *p, int lives)
+bool MultiPlayerServer::removePlayer(int id)
 {
-    for(int i=0; i<(int)munchers.size(); i++) {
-        if(munchers.at(i) == p) {
-            muncher_details.at(i)->lives = lives;
-            break;
+    if (connected[id]) {
+        RoomInput in = {RoomInput::ROOM_LEAVE, id, KEY_NUM, 0};
+        if (!inbox->push(in)) {
+            return false;
         }
+        connected[id] = false;
     }
+    return true;
+}
 
-    for(int i=0; i<(int)remote.size(); i++) {
-        if(remote.at(i) == p) {
-            remote_details.at(i)->lives = lives;
-            break;
-        }
+void MultiPlayerServer::queueKey(int id, enum Key key, Uint32 seq)
+{
+    RoomInput in = {RoomInput::ROOM_KEY, id, key, seq};
+    if (!inbox->push(in)) {
+        printMsg(1, "room %d is busy: dropped a key from player %d\n",
+                 room, id);
     }
 }
 
-void MultiPlayerServer::updateScore(Player *p, int score)
+/* acks can arrive out of order, so we only keep the newest */
+void MultiPlayerServer::ackSnapshot(int id, Uint32 snap)
 {
-    for(int i=0; i<(int)munchers.size(); i++) {
-        if(munchers.at(i) == p) {
-            muncher_details.at(i)->score = score;
-            break;
-        }
+    int old = snap_acked[id];
+
+    if (snap <= 0xFFFF && (old < 0 || (Sint16)(snap - old) > 0)) {
+        snap_acked[id] = snap;
     }
+}
 
-    for(int i=0; i<(int)remote.size(); i++) {
-        if(remote.at(i) == p) {
-            remote_details.at(i)->score = score;
-            break;
+int MultiPlayerServer::getDetails(vector<PlayerDetails> *ret)
+{
+    ret->clear();
+    for (int i=0; i<MAX_PLAYERS; i++) {
+        if (connected[i]) {
+            ret->push_back(details[i]);
+            ret->back().score = scores[i];
         }
     }
+    return ret->size();
+}
+
+int MultiPlayerServer::getRunTime()
+{
+    return start_time ? SDL_GetTicks() - start_time : 0;
+}
+
+void MultiPlayerServer::updateLives(Player*, int)
+{
+}
+
+void MultiPlayerServer::updateScore(Player *p, int score)
+{
+    int id = playerId(p);
+
+    scores[id] = score;
+
+    events->add(NetThread::PLAYER_SCORE, id, score);
 }
 
-/* free all the memory used in the game. Record the high score if necessary.
- * Exit gracefully to the menu */
 void MultiPlayerServer::end()
 {
     lost = 1;
@@ -88,234 +153,424 @@ void MultiPlayerServer::end()
 /* go on to the next level */
 void MultiPlayerServer::win()
 {
-    printMsg(1, "you beat the level\n");
+    printMsg(1, "level finished\n");
     won = 1;
 }
 
-/* run a game using the selected levelset.
- * 0) set the size parameters (eg. square_width, square_height, etc)
- * 1) open the fonts and animation pictures of the required sizes
- * 2) open the bg pic and create the board
- */
-void MultiPlayerServer::run(Level *level_, SDL_Surface *screen_)
+/* run the game until end() is called, at the tick rate, on this thread.
+ * There is no screen, so the surface is ignored. */
+void MultiPlayerServer::run(Level *level_, SDL_Surface*)
 {
-    unsigned int i;
-
-    screen = screen_;
-    level = level_;
-    SDL_ShowCursor(0);
-    SDL_FillRect(screen, NULL, Menu::getBlack());
-    SDL_Flip(screen);
-
-    video.flags  = screen->flags;
-    video.bpp    = screen->format->BitsPerPixel;
-    numdirty = 0;
-
-    /* set size parameters */
-    video.w         = screen->w;
-    video.h         = screen->h;
-    square_width    = video.w / (set.width+2);
-    square_height   = video.h / (set.height+2);
-    left            = square_width;
-    top             = square_height;
-    right           = video.w - (square_width  * set.width)  - left;
-    bottom          = video.h - (square_height * set.height) - top;
-
-    /* open fonts */
-    for(i=0; i<FONT_NUM; i++) {
-        font[i] = fs->openFont(fontname[i], fontsize[i]);
-    }
-
-    /* open the animations */
-    FILE *cfg;
-    char animname[20];
-    char getmove_name[20], onmove_name[20], onstop_name[20];
+    TickScheduler sched(tick_rate);
+    TickStats stats;
+    bool more = true;
+
+    begin(level_);
+    memset(&stats, 0, sizeof(stats));
+    sched.start(microseconds());
+    while (more) {
+        Sint64 wait = sched.untilDue(microseconds());
+        if (wait > 0) {
+            SDL_Delay((wait + 999) / 1000);
+            continue;
+        }
 
-    cfg = fs->openCfg(mpmuncher_file);
-    while(fscanf(cfg, " %19s", animname) == 1) {
-        anim.push_back( new Animation(animname) );
+        Uint64 start = microseconds();
+        more = tick();
+        sched.ticked(start, microseconds(), &stats);
     }
+    printMsg(1, "%d ticks, %d overran, %d skipped\n", (int)stats.ticks,
+             (int)stats.overruns, (int)stats.skipped);
+    finish();
+}
 
-    fclose(cfg);
-    cfg = fs->openCfg(troggle_file);
+/* set up the board and the players and start the first level */
+void MultiPlayerServer::begin(Level *level_)
+{
+    screen = NULL;
+    level = level_;
+    start_time = SDL_GetTicks();
 
-    while(fscanf(cfg, " %19s", animname) == 1) {
-        if(     fscanf(cfg, " %19s", getmove_name) != 1
-            ||  fscanf(cfg, " %19s", onmove_name ) != 1
-            ||  fscanf(cfg, " %19s", onstop_name ) != 1) {
-            printError("malformed troggle config file\n");
-        }
-        anim.push_back(new Animation(animname));
-        trogdef.push_back(new TroggleDef(anim.back(),
-                                             getAction(getmove_name),
-                                             getAction(onmove_name),
-                                             getAction(onstop_name)));
-    }
-    fclose(cfg);
-
-    /* open the bg pic and create the board */
-    background = fs->openPic(background_file, video.w, video.h);
-    trogwarning = fs->openPic(trogwarning_file, left, -1);
-
-    for( int i=0; i<numlocal; i++) { // the first few anims are muncher anims
-        munchers.push_back( new Muncher(anim.at(i)) );
-        players.push_back(munchers.at(i));
-        PlayerDetails *d = (PlayerDetails*)malloc(sizeof(PlayerDetails));
-        d->id = next_id++;
-        d->lives = 3;
-        d->score = 0;
-        muncher_details.push_back(d);
+    /* the animations are only needed for their timing */
+    Animation::setHeadless(true);
+    anim.push_back(new Animation(muncher_name));
+    players.clear();
+    for (int i=0; i<MAX_PLAYERS; i++) {
+        players.push_back( muncher[i] = new Muncher(anim[0]) );
     }
+    setupTroggles();
+    alive.assign(players.size(), false);
 
-    for( int i=0; i<set.trog_number; i++ ) {
-        troggles.push_back( new Troggle() );
-        players.push_back( troggles.at(i) );
-    }
     board = new Board(set.width, set.height, players);
 
-    /* FIXME: spawn connection-listening thread */
     lost = 0;
-    while(!lost) {
-        level->nextLevel();
-        runLevel();
-    }
-    /* FIXME: stop connection-listening thread */
+    trog_next_level = false;
+    startLevel();
+    events->flush();
+}
 
-    /* prepare for return to menu */
-    SDL_ShowCursor(1);
-    SDL_SetEventFilter(menuEventFilter);
+/* Advance the game by one step. The steps always come in this order:
+ * 1) apply the input that the network thread has queued
+ * 2) move everything on the board; collisions are settled as each player
+ *    arrives in a square
+ * 3) bring on the troggles and munchers that are due
+ * 4) tell the clients who appeared and who died
+ * 5) every SNAPSHOT_INTERVAL ticks, encode and send the snapshots
+ * When a level is won, the munchers are killed and we keep updating the
+ * board until they have all gone before starting the next one. */
+bool MultiPlayerServer::tick()
+{
+    if (lost) {
+        return false;
+    }
 
-    /* free memory; levelset is freed elsewhere */
-    delete board;
+    if (!ending) {
+        handleInput();
+        board->update();
+        handleTrogSpawns();
+        tryPlayerSpawn();
+        sendSpawnsAndDeaths();
+
+        if (won && !lost) {
+            for (int i=0; i<MAX_PLAYERS; i++) {
+                if (muncher[i]->exist()) {
+                    muncher[i]->die(SDL_GetTicks());
+                }
+            }
+            ending = true;
+        }
+    } else {
+        board->update();
+        sendSpawnsAndDeaths();
 
-    for(i=0; i<trogdef.size(); i++)
-        delete trogdef.at(i);
-    trogdef.clear();
-    for(i=0; i<anim.size(); i++)
-        delete anim.at(i);
-    anim.clear();
-    for(i=0; i<players.size(); i++)
-        delete players.at(i);
-    players.clear();
-    for(i=0; i<muncher_details.size(); i++)
-        free(muncher_details.at(i));
-    muncher_details.clear();
-    for(i=0; i<remote_details.size(); i++)
-        free(remote_details.at(i));
-    muncher_details.clear();
-    munchers.clear();
-    remote.clear();
-    troggles.clear();
-
-    if(background) SDL_FreeSurface(background), background=NULL;
-    if(trogwarning)SDL_FreeSurface(trogwarning), trogwarning=NULL;
-    for(i=0; i<FONT_NUM; i++) {
-        TTF_CloseFont(font[i]);
-        font[i] = NULL;
+        bool gone = true;
+        for (int i=0; i<MAX_PLAYERS; i++) {
+            gone = gone && !muncher[i]->exist();
+        }
+        if (gone) {
+            board->unset();
+            startLevel();
+        }
+    }
+    if (++snap_tick >= SNAPSHOT_INTERVAL) {
+        sendSnapshots();
+        snap_tick = 0;
     }
+    events->flush();
+    return !lost;
+}
+
+void MultiPlayerServer::finish()
+{
+    board->unset();
+    events->flush();
+    delete board;
+    freeGame();
+    freeTroggles();
 
     board       = NULL;
     level       = NULL;
-    background  = NULL;
-    trogwarning = NULL;
+    start_time  = 0;
 }
 
 void MultiPlayerServer::playerMove(Player *p, int old_x, int old_y,
                                               int x, int y, int time)
 {
+    Game::playerMove(p, old_x, old_y, x, y, time);
+    events->add(NetThread::PLAYER_MOVE, playerId(p), old_x, old_y, x, y);
 }
 
 void MultiPlayerServer::playerStop(Player *p, int x, int y, int time)
 {
+    Game::playerStop(p, x, y, time);
+    events->add(NetThread::PLAYER_STOP, playerId(p), x, y);
 }
 
 void MultiPlayerServer::playerMunch(Player *p, int x, int y, int time,
                                     bool immune)
 {
+    Game::playerMunch(p, x, y, time, immune);
+    events->add(NetThread::PLAYER_EAT, playerId(p), x, y);
 }
 
+/* munchers spawn in the corners, in order of player id */
 void MultiPlayerServer::playerSpawn(Player *p, int time)
 {
+    if (p->isMuncher()) {
+        int id = playerId(p);
+        if (!active[id]) {
+            return;
+        }
+        queuePlayerSpawn(p, (id & 1) ? set.width-1 : 0,
+                            (id == 1 || id == 2) ? set.height-1 : 0);
+    } else {
+        p->spawn( time );
+    }
 }
 
-void MultiPlayerServer::playerDie(Player *p, int time)
+void MultiPlayerServer::setNum(int x, int y, Number *n, bool wincheck)
 {
+    Game::setNum(x, y, n, wincheck);
+    if (n) {
+        events->add(NetThread::GAME_SETNUM, x, y, n->good(), n->getText());
+    } else {
+        events->add(NetThread::GAME_SETNUM, x, y, 0, "");
+    }
 }
 
-void MultiPlayerServer::troggleNextSpawn(Troggle *t, int time)
+void MultiPlayerServer::showTrogWarning()
 {
+    if (!warning_on) {
+        warning_on = true;
+        events->add(NetThread::GAME_TROGWARN);
+    }
+}
+
+void MultiPlayerServer::hideTrogWarning()
+{
+    if (warning_on) {
+        warning_on = false;
+        events->add(NetThread::GAME_TROGHIDE);
+    }
 }
 
 Player *MultiPlayerServer::getNearestMuncher(int x, int y)
 {
-    return NULL;
+    Player *ret = NULL;
+    int min_d = INT_MAX;
+
+    for (int i=0; i<MAX_PLAYERS; i++) {
+        if (muncher[i]->exist()) {
+            Point m = muncher[i]->getPos();
+            int d = abs(m.x - x) + abs(m.y - y);
+            if (d < min_d) {
+                min_d = d;
+                ret = muncher[i];
+            }
+        }
+    }
+    return ret;
 }
 
 /*_________________________________protected__________________________________*/
 
-/* 1) create the list of Number*s
- * 2) reset the Board
- * 3) draw the level title
- * 4) main game loop
+/* 1) go on to the next level
+ * 2) reset the troggles and the Board
+ * 3) spawn the connected players
  */
-void MultiPlayerServer::runLevel()
+void MultiPlayerServer::startLevel()
 {
-    board->reset();
+    level->nextLevel();
+    if (trog_next_level) {
+        nextTrogLevel();
+        trog_next_level = false;
+    } else {
+        trog_next_level = true;
+    }
+    events->add(NetThread::GAME_NEXTLEVEL);
 
-    FPSmanager manager;
-    SDL_initFramerate(&manager);
-    SDL_setFramerate(&manager, 50);
+    resetTroggles();
+    clearPlayerSpawn();
+    board->reset();
     won = 0;
-    warning_on = 1;
-    hideTrogWarning();
-
-    /* draw the title */
-    const char *title = level->getTitle();
-    SDL_Rect rect = {0, 0, video.w, top};
-    drawTextBox(title, FONT_TITLE, Menu::getWhite(), Menu::getBlack(), &rect);
-
-    SDL_Event event;
-    while(!won && !lost) {
-        while( SDL_PollEvent(&event) ) {
-            handleEvent( event );
+    ending = false;
+
+    for (int i=0; i<MAX_PLAYERS; i++) {
+        if (active[i]) {
+            playerSpawn(muncher[i], SDL_GetTicks());
         }
-        board->update();
-        SDL_framerateDelay(&manager);
     }
 }
 
-void MultiPlayerServer::handleEvent(const SDL_Event &event)
+/* apply the joins, leaves and key presses that came in from the network
+ * since the last tick, in the order they arrived */
+void MultiPlayerServer::handleInput()
 {
-    for( int i=0; i<Muncher::KEY_NUM; i++ ) {
-        if( event.key.keysym.sym == set.bindings1[i] ) {
-            munchers.at(0)->handleKey((Muncher::Key)i);
-            break;
-        } else if( event.key.keysym.sym == set.bindings2[i]
-                   && numlocal > 1 ) {
-            munchers.at(1)->handleKey((Muncher::Key)i);
+    RoomInput in;
+    int now = SDL_GetTicks();
+
+    while (inbox->pop(&in)) {
+        Muncher *m = muncher[in.id];
+
+        switch (in.type) {
+            case RoomInput::ROOM_LEAVE:
+                active[in.id] = false;
+                for (size_t i=0; i<spawning_players.size(); i++) {
+                    if (spawning_players[i] == m) {
+                        spawning_players.erase(spawning_players.begin() + i);
+                        player_spawning_points.erase(
+                                player_spawning_points.begin() + i);
+                        break;
+                    }
+                }
+                if (m->exist()) {
+                    m->die(now);
+                }
+                break;
+            case RoomInput::ROOM_JOIN:
+                active[in.id] = true;
+                input_seq[in.id] = 0;
+                m->givePoints(-m->getScore());
+                playerSpawn(m, now);
+                break;
+            case RoomInput::ROOM_KEY:
+                if (active[in.id]) {
+                    m->handleKey(in.key);
+                    input_seq[in.id] = in.seq;
+                }
+                break;
+        }
+    }
+}
+
+/* Players appear and disappear in several places that don't go through the
+ * Game, so we look for changes once per tick. */
+void MultiPlayerServer::sendSpawnsAndDeaths()
+{
+    for (size_t i=0; i<players.size(); i++) {
+        Player *p = players[i];
+        bool now_alive = p->exist() && !p->dying();
+
+        if (now_alive && !alive[i]) {
+            Point pos = p->getPos();
+            events->add(NetThread::PLAYER_SPAWN, (int)i, pos.x, pos.y);
+        } else if (!now_alive && alive[i]) {
+            events->add(NetThread::PLAYER_DIE, (int)i);
+        }
+        alive[i] = now_alive;
+    }
+}
+
+/* Record the room and send it to each player, as the changes since the last
+ * snapshot that player acked. A player who hasn't acked anything recent,
+ * such as one who has just joined, gets a JoinState with the whole thing
+ * instead. Each tier of spectators gets the same JoinState every few
+ * snapshots, as one packet for the whole tier, so they cost the room
+ * nothing however many of them there are. */
+void MultiPlayerServer::sendSnapshots()
+{
+    static const int interval[SPECTATOR_TIERS] = SPECTATOR_INTERVALS;
+    Snapshot *s = &history[++snap_id % SNAPSHOT_HISTORY];
+
+    s->capture(board, players);
+    s->id = snap_id;
+
+    for (int i=0; i<MAX_PLAYERS; i++) {
+        if (!active[i]) {
+            continue;
+        }
+
+        const Snapshot *base = NULL;
+        int acked = snap_acked[i];
+        if (acked >= 0 && (Uint16)(snap_id - acked) < SNAPSHOT_HISTORY &&
+            history[acked % SNAPSHOT_HISTORY].id == acked) {
+            base = &history[acked % SNAPSHOT_HISTORY];
+        }
+        /* the keys still in the muncher's queue haven't been acted on */
+        Uint32 input = input_seq[i] - muncher[i]->queued();
+        if (base) {
+            events->addSnapshot(CHANNEL_PLAYER(room, i), s, base, input);
+        } else {
+            sendJoinState(CHANNEL_PLAYER(room, i), s, input);
+        }
+    }
+
+    for (int t=0; t<SPECTATOR_TIERS; t++) {
+        if (spectators[t] > 0 && snap_id % interval[t] == 0) {
+            sendJoinState(CHANNEL_SPECTATORS(room, t), s, 0);
         }
     }
 }
 
+/* Players often join together, so the join state is only encoded once for
+ * each snapshot. */
+void MultiPlayerServer::sendJoinState(int to, const Snapshot *s, Uint32 input)
+{
+    if (join_len < 0 || join_id != s->id) {
+        JoinState js;
+
+        js.title = level->getLevelTitle();
+        js.trog_warning = warning_on;
+        for (int i=0; i<MAX_PLAYERS; i++) {
+            js.scores.push_back((int)scores[i]);
+        }
+        js.snap = *s;
+        join_id = s->id;
+        join_len = js.encode(&join_data[0], join_data.size());
+    }
+    if (join_len < 0) {
+        printWarning("the join state for snapshot %d is too big\n", s->id);
+        return;
+    }
+    events->addJoinState(to, s->id, input, &join_data[0], join_len);
+}
+
+/* the munchers come first in the players vector, so a player's id is its
+ * position in it */
+int MultiPlayerServer::playerId(Player *p)
+{
+    for (size_t i=0; i<players.size(); i++) {
+        if (players[i] == p) {
+            return i;
+        }
+    }
+    assert(0);
+    return -1;
+}
+
+void MultiPlayerServer::handleMuncherEaten(Muncher *m, Player*)
+{
+    m->givePoints(-5);
+    m->die(SDL_GetTicks());
+    m->handleKey(KEY_SPAWN);
+}
+
+void MultiPlayerServer::handleMuncherIndigestion(Muncher *m)
+{
+    m->givePoints(-5);
+}
+
 ServerDetails::ServerDetails(const UDPpacket *p)
 {
-    assert( PACKET_TYPE(p) == NetThread::PT_DETAILS );
+    assert( PACKET_TYPE(p) == NetThread::PT_DETAILS ||
+            PACKET_TYPE(p) == NetThread::PT_ANNOUNCE );
 
-    name.assign( (char*)&PACKET_DATA(p)[0], SERVER_NAME_LEN );
-    numplayers = PACKET_DATA(p)[17];
-    maxplayers = PACKET_DATA(p)[18];
-    gametime = SDLNet_Read32( &PACKET_DATA(p)[19] );
+    WireArgs a;
+    int start = NetThread::readFields(p, &a);
 
-    if (p->len != 23 + 23*numplayers) {
+    address = p->address;
+    ping = 0;
+    full = false;
+    seen = SDL_GetTicks();
+    if (start == -1) {
         printWarning("strangeness in details packet\n");
+        numplayers = maxplayers = gametime = room = 0;
+        return;
+    }
+    name = a.s[0].substr(0, SERVER_NAME_LEN);
+    numplayers = a.n[0];
+    maxplayers = a.n[1];
+    gametime = a.n[2];
+    room = a.n[3];
+    if (PACKET_TYPE(p) == NetThread::PT_ANNOUNCE) {
+        return;
     }
 
+    full = true;
+    WireReader in(PACKET_DATA(p) + start, p->len - PACKET_HEADER_LEN - start);
     for (int i=0; i<numplayers; i++) {
-        PlayerDetails *d = (PlayerDetails*)malloc(sizeof(PlayerDetails));
-        d->id = PACKET_DATA(p)[23 + i*23];
-        d->name.assign( (char*)&PACKET_DATA(p)[24 + i*23], PLAYER_NAME_LEN );
-        d->score = SDLNet_Read32( &PACKET_DATA(p)[41 + i*23] );
-        d->lives = PACKET_DATA(p)[45 + i*23];
+        if (!in.get(PLAYER_DETAILS_FORMAT, &a)) {
+            printWarning("strangeness in details packet\n");
+            numplayers = i;
+            full = false;
+            break;
+        }
+
+        PlayerDetails *d = new PlayerDetails;
+        d->id = a.n[0];
+        d->name = a.s[0].substr(0, PLAYER_NAME_LEN);
+        d->score = a.n[1];
+        d->lives = a.n[2];
 
         player_details.push_back(d);
     }
@@ -324,6 +579,6 @@ ServerDetails::ServerDetails(const UDPpacket *p)
 ServerDetails::~ServerDetails()
 {
     for (int i=0; i<(int)player_details.size(); i++) {
-        free(player_details[i]);
+        delete player_details[i];
     }
 }
@@ -24,16 +24,52 @@
 #include "Level.h"
 #include "Menu.h"
 #include "Game.h"
+#include "Event.h"
+#include "SPSCQueue.h"
+#include "Snapshot.h"
+#include "JoinState.h"
+#include "NetworkThread.h"
+#include "TickScheduler.h"
+#include <SDL_net.h>
 
-#define SERVER_PORT 7529
+/* the first MAX_PLAYERS player ids belong to munchers */
+#define MAX_PLAYERS 4
 
+/* how many times a second the server updates the game */
+#define SERVER_TICK_RATE 50
+
+/* how many ticks go by between snapshots of the room */
+#define SNAPSHOT_INTERVAL 5
+
+/* how many snapshots go by between the states sent to each tier of
+ * spectators; at the default tick rate, 10, 5, 2 and 1 a second */
+#define SPECTATOR_INTERVALS {1, 2, 5, 10}
+
+/* how many joins, leaves and key presses a room can have waiting */
+#define ROOM_INBOX_SIZE 256
+
+class ServerNetThread;
+typedef SPSCQueue<UDPpacket*> Outbox;
+class EventBatch;
+
+/* something that a remote player did, passed from the network thread to the
+ * room */
 typedef struct {
+    enum {ROOM_JOIN, ROOM_LEAVE, ROOM_KEY} type;
+    int id;
+    enum Key key;
+    Uint32 seq;         /* for ROOM_KEY, the client's number for the key */
+} RoomInput;
+
+typedef struct PlayerDetails {
     int id;             /* unique ID number */
     int lives;
     int score;
     string name;
 } PlayerDetails;
 
+/* One room on a server, from a details reply or an announcement. An
+ * announcement only has the summary, so player_details stays empty. */
 class ServerDetails {
     public:
         ServerDetails(const UDPpacket *p);
@@ -41,17 +77,23 @@ class ServerDetails {
 
         string name;
         IPaddress address;
+        int room;
         int numplayers;
         int maxplayers;
         int ping;
         int gametime; /* 0 means the game isn't running */
+        bool full;    /* whether player_details has been filled in */
+        Uint32 seen;  /* when we last heard from it, by SDL_GetTicks */
         vector<PlayerDetails*> player_details;
 };
 
-class MultiPlayerServer: public Game {
+/* The authoritative game for network play. It has no screen: the clients do
+ * all the drawing, from the events that it sends them. One server process can
+ * host several of these, each in its own room; see RoomPool. */
+class MultiPlayerServer: public TroggleGame {
     public:
-        MultiPlayerServer(const GameSettings&, const Menu::VideoSettings&,
-                          int numlocal);
+        MultiPlayerServer(const GameSettings&, const char *name,
+                          ServerNetThread *net, int room=0);
         virtual ~MultiPlayerServer();
 
         virtual void    updateLives(Player*, int);
@@ -60,38 +102,123 @@ class MultiPlayerServer: public Game {
         virtual void    win();
         virtual void    run(Level*, SDL_Surface*);
 
+        /* run() broken into pieces, so that a RoomPool worker can interleave
+         * many rooms. The global game must point at this room around each
+         * call. */
+        void            begin(Level*);
+        bool            tick();     /* false once the game is over */
+        void            finish();
+
         virtual void    playerMove( Player*, int, int, int, int, int );
         virtual void    playerStop( Player*, int, int, int );
         virtual void    playerMunch( Player*, int, int, int, bool=0 );
         virtual void    playerSpawn( Player*, int );
-        virtual void    playerDie( Player*, int );
-        virtual void    troggleNextSpawn( Troggle*, int );
-        virtual void    setNum(int x, int y, Number *n) {board->setNum(x,y,n);}
+        virtual void    setNum(int, int, Number*, bool win=1);
+
+        /* there is nothing to draw */
+        virtual void    showTrogWarning();
+        virtual void    hideTrogWarning();
+        virtual void    showMessage(const char*, Uint8=255, Uint8=255,
+                                    Uint8=255, Uint8=128) {}
+        virtual void    hideMessage() {}
+        virtual void    redrawSquare(int, int) {}
+        virtual void    refresh() {}
+        virtual void    redrawAll() {}
 
         virtual Player *getNearestMuncher(int, int);
 
+        /** Set the number of game updates per second. */
+        void            setTickRate(int rate) {tick_rate = rate;}
+        int             getTickRate() {return tick_rate;}
+        int             getRoom() {return room;}
+
+        /* The following functions are called from the network thread. They
+         * pass things to the game thread through the inbox, so neither
+         * thread ever waits for the other. */
+
         /** Try to add a new player to the server.
          *   @param name The name of the player to add.
          *   @return the new player id, or -1 if the server is full. */
-        virtual int     addPlayer(const string &name);
+        int             addPlayer(const string &name);
+
+        /** Remove a player that has left.
+         *  @return false if the room is too busy; try again later. */
+        bool            removePlayer(int id);
+
+        /** Queue a key press from a remote player. It is handled at the
+         *  start of the next tick, or dropped if the room is too busy.
+         *  seq is sent back in snapshots once the key has been acted on. */
+        void            queueKey(int id, enum Key key, Uint32 seq);
+
+        /** Note that a player has the given snapshot, so that later ones
+         *  can be sent as changes from it. */
+        void            ackSnapshot(int id, Uint32 snap);
+
+        /** Count the spectators watching at each rate tier, so that the
+         *  room only makes states for the tiers that someone is in. */
+        void            addSpectator(int tier) {spectators[tier]++;}
+        void            removeSpectator(int tier) {spectators[tier]--;}
+
+        /** Copy the details of the connected players.
+         *  @return the number of connected players. */
+        int             getDetails(vector<PlayerDetails> *details);
+
+        const string   &getName() {return name;}
+
+        /** @return how long the game has been running, in ms. */
+        int             getRunTime();
 
     protected:
-        virtual void    runLevel();
-        virtual void    handleEvent(const SDL_Event&);
-
-        char *mpmuncher_file;
-        int numlocal;
-        int next_id;
-        vector<Muncher*> munchers;
-        vector<PlayerDetails*> muncher_details;
-        vector<Troggle*> troggles;
-        vector<Player*> remote;
-        vector<PlayerDetails*> remote_details;
-
-        vector<Player*> players;
-
-        queue<Troggle*> trog_spawning;
-        queue<int>      trog_spawning_times;
+        virtual void    startLevel();
+        virtual void    handleMuncherEaten(Muncher *m, Player *eater);
+        virtual void    handleMuncherIndigestion(Muncher *m);
+
+        void            handleInput();
+        void            sendSpawnsAndDeaths();
+        void            sendSnapshots();
+        void            sendJoinState(int to, const Snapshot*,
+                                      Uint32 input);
+        int             playerId(Player*);
+
+        string name;
+        ServerNetThread *net;
+        EventBatch *events;     /* what we tell the clients this tick */
+        int room;
+        int channel;            /* CHANNEL_ROOM(room) */
+        int tick_rate;
+        int start_time;
+        bool trog_next_level;
+        bool ending;            /* waiting for the munchers to leave */
+
+        Muncher *muncher[MAX_PLAYERS];
+        bool active[MAX_PLAYERS];   /* the game thread's copy of connected */
+        vector<bool> alive;     /* whether each player was alive last tick */
+
+        /* the last few snapshots, indexed by id % SNAPSHOT_HISTORY */
+        Snapshot history[SNAPSHOT_HISTORY];
+        Uint16 snap_id;         /* the id of the newest one */
+        vector<Uint8> join_data; /* the newest one as a JoinState... */
+        int join_len;           /* ...and its length, or -1 */
+        Uint16 join_id;         /* the snapshot that it holds */
+        int snap_tick;          /* ticks since the last one */
+        Uint32 input_seq[MAX_PLAYERS];  /* the last key given to each muncher */
+
+        /* written by the network thread, read by the game thread */
+        SPSCQueue<RoomInput> *inbox;
+
+        /* only the network thread looks at these */
+        bool connected[MAX_PLAYERS];
+        PlayerDetails details[MAX_PLAYERS];
+
+        /* the newest snapshot each player has acked, or -1. Written by the
+         * network thread, read by the game thread. */
+        volatile int snap_acked[MAX_PLAYERS];
+
+        /* written by the game thread for getDetails() */
+        volatile int scores[MAX_PLAYERS];
+
+        /* written by the network thread, read by the game thread */
+        volatile int spectators[SPECTATOR_TIERS];
 };
 
 #endif
@@ -128,14 +128,9 @@ void MultipleLevel::nextLevel()
 
 MultipleGUI::MultipleGUI(MultipleConfig *c):
     LevelGUI(c),
-    mult_spin(MAX_MULTIPLIER),
+    mult_spin(MAX_MULTIPLIER, MIN_MULTIPLIER, MAX_MULTIPLIER - c->max_multiplier),
     mult_label(_("Maximum multiplier"))
 {
-    for (int i=MAX_MULTIPLIER-1; i>=MIN_MULTIPLIER; i--) {
-        mult_spin.addItem(i);
-    }
-    mult_spin.setItem(MAX_MULTIPLIER - c->max_multiplier);
-
     options.add(&mult_label, &mult_spin);
     apply.setCallback(reinterpret_cast<Clickable::Callback>(applyChanges), this);
 }
@@ -20,8 +20,9 @@
 #include <Game.h>
 #include <Board.h>
 #include <Event.h>
+#include <BitStream.h>
 
-extern Game *game;
+extern __thread Game *game;
 
 Muncher::Muncher(Animation *new_anim)
 {
@@ -50,6 +51,24 @@ void Muncher::handleKey(enum Key key)
     key_queue.push_back(key);
 }
 
+/* the keys that are waiting aren't saved; they would be stale by the time
+ * the game is loaded */
+void Muncher::save(BitWriter &out, int now)
+{
+    Player::save(out, now);
+    out.writeSigned(score);
+}
+
+bool Muncher::load(BitReader &in, int now)
+{
+    if (!Player::load(in, now)) {
+        return false;
+    }
+    score = in.readSigned();
+    key_queue.clear();
+    return !in.overflow();
+}
+
 void Muncher::givePoints(int p)
 {
     score += p;
@@ -64,23 +83,17 @@ void Muncher::update()
         key_queue.pop_front();
         printMsg(2, "muncher got key %d\n", key);
 
+        Point to(x, y);
+
         switch( key )
         {
             case KEY_UP:
-                if( y > 0 )
-                    game->playerMove( this, x, y, x, y-1, now );
-                break;
             case KEY_DOWN:
-                if( y < game->getHeight() - 1 )
-                    game->playerMove( this, x, y, x, y+1, now );
-                break;
             case KEY_LEFT:
-                if( x > 0 )
-                    game->playerMove( this, x, y, x-1, y, now );
-                break;
             case KEY_RIGHT:
-                if( x < game->getWidth() - 1 )
-                    game->playerMove( this, x, y, x+1, y, now );
+                if( keyMove( key, x, y, game->getWidth(), game->getHeight(),
+                             &to ) )
+                    game->playerMove( this, x, y, to.x, to.y, now );
                 break;
             case KEY_MUNCH:
                 game->playerMunch( this, x, y, now );
@@ -104,3 +117,25 @@ void Muncher::update()
         updatePos();
     }
 }
+
+/* The network client uses this to predict where the server will put its
+ * muncher, so it has to follow update() exactly. */
+bool Muncher::keyMove(enum Key key, int x, int y, int w, int h, Point *to)
+{
+    to->x = x;
+    to->y = y;
+    switch( key )
+    {
+        case KEY_UP:    to->y--; break;
+        case KEY_DOWN:  to->y++; break;
+        case KEY_LEFT:  to->x--; break;
+        case KEY_RIGHT: to->x++; break;
+        default:        return false;
+    }
+    if( to->x < 0 || to->x >= w || to->y < 0 || to->y >= h ) {
+        to->x = x;
+        to->y = y;
+        return false;
+    }
+    return true;
+}
@@ -32,6 +32,17 @@ class Muncher: public Player {
         void givePoints(int);
         int getScore() { return score; };
 
+        void save(BitWriter&, int now);
+        bool load(BitReader&, int now);
+
+        /* the number of keys waiting for the muncher to stop moving */
+        int queued() { return key_queue.size(); }
+
+        /** Work out where a key moves a muncher at (x, y) on a w by h
+         *  board, as update() does.
+         *  @return false if the key doesn't move it. */
+        static bool keyMove(enum Key, int x, int y, int w, int h, Point *to);
+
         virtual bool isMuncher() {return 1;}
         virtual bool isTroggle() {return 0;}
 
@@ -0,0 +1,183 @@
+/*
+ *  Copyright (C) 2005 Joe Neeman <spuzzzzzzz@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#include "NetEmulator.h"
+#include "ConfigFile.h"
+
+NetEmulator::NetEmulator(const NetProfile &profile, Uint32 seed_offset)
+{
+    this->profile = profile;
+    seed = profile.seed + seed_offset;
+    order = 0;
+    lost_out = lost_in = false;
+    dropped = duplicated = 0;
+}
+
+NetEmulator::~NetEmulator()
+{
+    sendDone();
+    while( !out.empty() ) {
+        delete out.top();
+        out.pop();
+    }
+    while( !in.empty() ) {
+        delete in.top();
+        in.pop();
+    }
+}
+
+static void readConditions(ConfigFile *f, const char *section,
+                           NetConditions *c)
+{
+    c->latency = f->readInt(section, "latency", 0);
+    c->jitter = f->readInt(section, "jitter", 0);
+    c->loss = atof( f->readString(section, "loss", "0") );
+    c->burst = atof( f->readString(section, "burst", "0") );
+    c->duplicate = atof( f->readString(section, "duplicate", "0") );
+    c->reorder = atof( f->readString(section, "reorder", "0") );
+    c->reorder_delay = f->readInt(section, "reorder_delay", 0);
+}
+
+bool NetEmulator::readProfile(const char *file, NetProfile *profile)
+{
+    if( access(file, R_OK) == -1 ) {
+        printWarning("couldn't read network profile %s: %s\n", file,
+                     strerror(errno));
+        return false;
+    }
+
+    ConfigFile *f = new ConfigFile(file);
+    profile->seed = f->readInt("emulator", "seed", 1);
+    readConditions(f, "outgoing", &profile->out);
+    readConditions(f, "incoming", &profile->in);
+    delete f;
+    return true;
+}
+
+void NetEmulator::send(const Uint8 *prefix, int len, UDPpacket *p,
+                       const IPaddress *to, Uint32 now)
+{
+    NetDatagram *d = new NetDatagram;
+
+    d->address = *to;
+    memcpy( d->prefix, prefix, len );
+    d->prefix_len = len;
+    if( p ) {
+        d->data.assign(p->data, p->data + p->len);
+    }
+    schedule(d, profile.out, &lost_out, &out, now);
+}
+
+void NetEmulator::receive(UDPpacket *p, Uint32 now)
+{
+    NetDatagram *d = new NetDatagram;
+
+    d->address = p->address;
+    d->prefix_len = 0;
+    d->data.assign(p->data, p->data + p->len);
+    schedule(d, profile.in, &lost_in, &in, now);
+}
+
+const NetDatagram *NetEmulator::nextOut(Uint32 now)
+{
+    if( out.empty() || (Sint32)(out.top()->due - now) > 0 ) {
+        return NULL;
+    }
+
+    NetDatagram *d = out.top();
+    out.pop();
+    d->packet.data = d->data.empty() ? NULL : &d->data[0];
+    d->packet.len = d->data.size();
+    d->packet.address = d->address;
+    sent.push_back(d);
+    return d;
+}
+
+void NetEmulator::sendDone()
+{
+    for( int i=0; i<(int)sent.size(); i++ ) {
+        delete sent[i];
+    }
+    sent.clear();
+}
+
+bool NetEmulator::nextIn(Uint32 now, UDPpacket *p)
+{
+    if( in.empty() || (Sint32)(in.top()->due - now) > 0 ) {
+        return false;
+    }
+
+    NetDatagram *d = in.top();
+    in.pop();
+    p->len = min( (int)d->data.size(), p->maxlen );
+    memcpy( p->data, &d->data[0], p->len );
+    p->address = d->address;
+    p->channel = -1;
+    delete d;
+    return true;
+}
+
+int NetEmulator::timeout(int ms, Uint32 now)
+{
+    if( !out.empty() ) {
+        ms = min( ms, max(0, (Sint32)(out.top()->due - now)) );
+    }
+    if( !in.empty() ) {
+        ms = min( ms, max(0, (Sint32)(in.top()->due - now)) );
+    }
+    return ms;
+}
+
+/*_________________________________private__________________________________*/
+
+void NetEmulator::schedule(NetDatagram *d, const NetConditions &c,
+                           bool *lost, Queue *q, Uint32 now)
+{
+    /* losses come in bursts: once one is dropped, the next one is dropped
+     * with the burst chance instead */
+    *lost = chance(*lost ? c.burst : c.loss);
+    if( *lost ) {
+        dropped++;
+        delete d;
+        return;
+    }
+
+    if( chance(c.duplicate) ) {
+        NetDatagram *copy = new NetDatagram(*d);
+        copy->due = now + delay(c);
+        copy->order = order++;
+        q->push(copy);
+        duplicated++;
+    }
+
+    d->due = now + delay(c);
+    if( chance(c.reorder) ) {
+        d->due += c.reorder_delay;
+    }
+    d->order = order++;
+    q->push(d);
+}
+
+int NetEmulator::delay(const NetConditions &c)
+{
+    return c.latency + (c.jitter > 0 ? rand_r(&seed) % (c.jitter + 1) : 0);
+}
+
+bool NetEmulator::chance(double percent)
+{
+    return percent > 0 && rand_r(&seed) % 10000 < percent * 100;
+}
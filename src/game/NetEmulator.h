@@ -0,0 +1,135 @@
+/*
+ *  Copyright (C) 2005 Joe Neeman <spuzzzzzzz@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#ifndef NETEMULATOR_H
+#define NETEMULATOR_H
+
+#include "Gnumch.h"
+#include "NetSocket.h"
+#include <SDL_net.h>
+
+/* How one direction of a link misbehaves. Times are in ms and chances are
+ * percentages. */
+typedef struct {
+    int latency;        /* added to every datagram */
+    int jitter;         /* a further random delay of up to this much */
+    double loss;        /* the chance of dropping a datagram */
+    double burst;       /* the chance of dropping one after a dropped one */
+    double duplicate;   /* the chance of sending a datagram twice */
+    double reorder;     /* the chance of holding a datagram back... */
+    int reorder_delay;  /* ...by this much more, so later ones overtake it */
+} NetConditions;
+
+typedef struct {
+    NetConditions out;  /* what we send */
+    NetConditions in;   /* what we receive */
+    Uint32 seed;
+} NetProfile;
+
+/* one datagram that the emulator is holding on to */
+typedef struct {
+    Uint32 due;
+    Uint32 order;       /* keeps datagrams that are due together in order */
+    IPaddress address;
+    Uint8 prefix[NET_PREFIX_MAX];
+    int prefix_len;
+    vector<Uint8> data;
+    UDPpacket packet;   /* points at data once it is released */
+} NetDatagram;
+
+/* Makes a NetSocket behave like a bad network, for testing on one machine.
+ * Datagrams going either way are dropped, duplicated, delayed and reordered
+ * according to a NetProfile. All the randomness comes from one seed, so a
+ * test can be run again with the same conditions.
+ *
+ * A profile file looks like this; anything left out is 0:
+ *
+ *   [emulator]
+ *   seed = 1
+ *
+ *   [outgoing]
+ *   latency = 40
+ *   jitter = 20
+ *   loss = 2.5
+ *   burst = 30
+ *   duplicate = 0.5
+ *   reorder = 1
+ *   reorder_delay = 40
+ *
+ *   [incoming]
+ *   ...the same keys as outgoing
+ */
+class NetEmulator {
+    public:
+        /** @param seed_offset added to the profile's seed, so that several
+         *                     sockets with one profile behave differently */
+        NetEmulator(const NetProfile&, Uint32 seed_offset=0);
+        ~NetEmulator();
+
+        /** Read a profile file.
+         *  @return false if it couldn't be read. */
+        static bool readProfile(const char *file, NetProfile*);
+
+        /** Take a datagram that is being sent. p may be NULL. */
+        void    send(const Uint8 *prefix, int len, UDPpacket *p,
+                     const IPaddress *to, Uint32 now);
+
+        /** Take a datagram that has just arrived. */
+        void    receive(UDPpacket *p, Uint32 now);
+
+        /** @return the next outgoing datagram that is due, or NULL. It
+         *          stays valid until sendDone(). */
+        const NetDatagram *nextOut(Uint32 now);
+        void    sendDone();
+
+        /** Copy the next incoming datagram that is due into p.
+         *  @return false if none is due. */
+        bool    nextIn(Uint32 now, UDPpacket *p);
+
+        /** @return how long until a datagram is due, but no more than ms */
+        int     timeout(int ms, Uint32 now);
+
+        /* counters */
+        int     getDropped() {return dropped;}
+        int     getDuplicated() {return duplicated;}
+
+    private:
+        struct Later {
+            bool operator()(const NetDatagram *a, const NetDatagram *b) {
+                if( a->due != b->due ) return (Sint32)(a->due - b->due) > 0;
+                return a->order > b->order;
+            }
+        };
+        typedef priority_queue<NetDatagram*, vector<NetDatagram*>, Later>
+                Queue;
+
+        /* work out what happens to d and queue it, or delete it */
+        void    schedule(NetDatagram *d, const NetConditions&, bool *lost,
+                         Queue*, Uint32 now);
+        int     delay(const NetConditions&);
+        bool    chance(double percent);
+
+        NetProfile profile;
+        unsigned int seed;
+        Uint32 order;
+        bool lost_out, lost_in;     /* whether the last one was dropped */
+        Queue out, in;
+        vector<NetDatagram*> sent;  /* released by nextOut() */
+        int dropped, duplicated;
+};
+
+#endif
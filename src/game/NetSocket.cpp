@@ -0,0 +1,353 @@
+/*
+ *  Copyright (C) 2005 Joe Neeman <spuzzzzzzz@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#include "NetSocket.h"
+#include "NetEmulator.h"
+
+#ifdef NET_USE_EPOLL
+#   include <sys/epoll.h>
+#   include <sys/eventfd.h>
+#   include <unistd.h>
+#   include <errno.h>
+#endif
+
+#ifdef NET_USE_EPOLL
+
+NetSocket::NetSocket(int port, bool shared)
+{
+    struct sockaddr_in a;
+    struct epoll_event ev;
+    int on = 1;
+
+    memset( peer, 0, sizeof(peer) );
+    sent = received = 0;
+    emu = NULL;
+    out_num = 0;
+    epoll_fd = wake_fd = -1;
+
+    fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if( fd == -1 ) {
+        printWarning("couldn't create UDP socket: %s\n", strerror(errno));
+        return;
+    }
+    /* servers announce themselves by broadcast, and browsers ask for
+     * them the same way */
+    setsockopt(fd, SOL_SOCKET, SO_BROADCAST, &on, sizeof(on));
+    if( shared ) {
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    }
+
+    memset( &a, 0, sizeof(a) );
+    a.sin_family = AF_INET;
+    a.sin_addr.s_addr = INADDR_ANY;
+    a.sin_port = htons(port);
+    if( ::bind(fd, (struct sockaddr*)&a, sizeof(a)) == -1 ) {
+        printWarning("couldn't bind UDP port %d: %s\n", port, strerror(errno));
+        close(fd);
+        fd = -1;
+        return;
+    }
+
+    wake_fd = eventfd(0, EFD_NONBLOCK);
+    epoll_fd = epoll_create(2);
+    if( wake_fd == -1 || epoll_fd == -1 ) {
+        printError("couldn't set up epoll: %s\n", strerror(errno));
+    }
+    memset( &ev, 0, sizeof(ev) );
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+    ev.data.fd = wake_fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &ev);
+
+    /* the receive buffers are filled in by recv(); only their addresses
+     * are fixed */
+    memset( in_msg, 0, sizeof(in_msg) );
+    memset( out_msg, 0, sizeof(out_msg) );
+    for( int i=0; i<NET_BATCH; i++ ) {
+        in_msg[i].msg_hdr.msg_name = &in_addr[i];
+        in_msg[i].msg_hdr.msg_iov = &in_iov[i];
+        in_msg[i].msg_hdr.msg_iovlen = 1;
+        out_msg[i].msg_hdr.msg_name = &out_addr[i];
+        out_msg[i].msg_hdr.msg_namelen = sizeof(out_addr[i]);
+        out_msg[i].msg_hdr.msg_iov = out_iov[i];
+        out_iov[i][0].iov_base = out_prefix[i];
+    }
+}
+
+NetSocket::~NetSocket()
+{
+    delete emu;
+    if( fd != -1 ) close(fd);
+    if( wake_fd != -1 ) close(wake_fd);
+    if( epoll_fd != -1 ) close(epoll_fd);
+}
+
+bool NetSocket::ok()
+{
+    return fd != -1;
+}
+
+void NetSocket::waitSocket(int ms)
+{
+    struct epoll_event ev[2];
+    int n = epoll_wait(epoll_fd, ev, 2, ms);
+
+    for( int i=0; i<n; i++ ) {
+        if( ev[i].data.fd == wake_fd ) {
+            uint64_t count;
+            if( read(wake_fd, &count, sizeof(count)) == -1 &&
+                errno != EAGAIN ) {
+                printWarning("couldn't read eventfd: %s\n", strerror(errno));
+            }
+        }
+    }
+    if( n == -1 && errno != EINTR ) {
+        printWarning("epoll_wait failed: %s\n", strerror(errno));
+    }
+}
+
+void NetSocket::wake()
+{
+    uint64_t one = 1;
+    if( write(wake_fd, &one, sizeof(one)) == -1 && errno != EAGAIN ) {
+        printWarning("couldn't write eventfd: %s\n", strerror(errno));
+    }
+}
+
+int NetSocket::recvSocket(UDPpacket **p, int n)
+{
+    int got;
+
+    n = min(n, NET_BATCH);
+    for( int i=0; i<n; i++ ) {
+        in_iov[i].iov_base = p[i]->data;
+        in_iov[i].iov_len = p[i]->maxlen;
+        in_msg[i].msg_hdr.msg_namelen = sizeof(in_addr[i]);
+    }
+
+    got = recvmmsg(fd, in_msg, n, MSG_DONTWAIT, NULL);
+    if( got == -1 ) {
+        return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+    }
+
+    /* SDL_net keeps addresses in network byte order too */
+    for( int i=0; i<got; i++ ) {
+        p[i]->len = in_msg[i].msg_len;
+        p[i]->channel = -1;
+        p[i]->address.host = in_addr[i].sin_addr.s_addr;
+        p[i]->address.port = in_addr[i].sin_port;
+    }
+    received += got;
+    return got;
+}
+
+void NetSocket::sendSocket(const Uint8 *prefix, int len, UDPpacket *p,
+                           const IPaddress *to)
+{
+    assert( len <= NET_PREFIX_MAX );
+    if( out_num == NET_BATCH ) {
+        flushSocket();
+    }
+    memcpy( out_prefix[out_num], prefix, len );
+    out_iov[out_num][0].iov_len = len;
+    if( p ) {
+        out_iov[out_num][1].iov_base = p->data;
+        out_iov[out_num][1].iov_len = p->len;
+        out_msg[out_num].msg_hdr.msg_iovlen = 2;
+    } else {
+        out_msg[out_num].msg_hdr.msg_iovlen = 1;
+    }
+    memset( &out_addr[out_num], 0, sizeof(out_addr[out_num]) );
+    out_addr[out_num].sin_family = AF_INET;
+    out_addr[out_num].sin_addr.s_addr = to->host;
+    out_addr[out_num].sin_port = to->port;
+    out_num++;
+    sent++;
+}
+
+void NetSocket::flushSocket()
+{
+    int done = 0;
+
+    while( done < out_num ) {
+        int n = sendmmsg(fd, &out_msg[done], out_num - done, 0);
+        if( n == -1 ) {
+            if( errno == EINTR ) {
+                continue;
+            }
+            /* drop this one and carry on with the rest */
+            printMsg(1, "sendmmsg failed: %s\n", strerror(errno));
+            n = 1;
+        }
+        done += n;
+    }
+    out_num = 0;
+}
+
+#else
+
+NetSocket::NetSocket(int port, bool shared)
+{
+    memset( peer, 0, sizeof(peer) );
+    sent = received = 0;
+    emu = NULL;
+    set = NULL;
+    scratch = SDLNet_AllocPacket(NET_PREFIX_MAX + NET_PACKET_SIZE);
+    sock = SDLNet_UDP_Open(port);
+    if( !sock ) {
+        printWarning("couldn't open UDP port %d: %s\n", port,
+                     SDLNet_GetError());
+        return;
+    }
+    set = SDLNet_AllocSocketSet(1);
+    SDLNet_UDP_AddSocket(set, sock);
+}
+
+NetSocket::~NetSocket()
+{
+    delete emu;
+    SDLNet_FreePacket(scratch);
+    if( set ) SDLNet_FreeSocketSet(set);
+    if( sock ) SDLNet_UDP_Close(sock);
+}
+
+bool NetSocket::ok()
+{
+    return sock != NULL;
+}
+
+void NetSocket::waitSocket(int ms)
+{
+    if( SDLNet_CheckSockets(set, ms) == -1 ) {
+        printWarning("SDLNet_CheckSockets failed: %s\n", SDLNet_GetError());
+        SDL_Delay(ms);
+    }
+}
+
+/* SDL_net can't wait on anything but sockets, so the sender has to wait for
+ * the poll to time out */
+void NetSocket::wake()
+{
+}
+
+int NetSocket::recvSocket(UDPpacket **p, int n)
+{
+    int got = 0, r = 0;
+
+    while( got < n && (r = SDLNet_UDP_Recv(sock, p[got])) == 1 ) {
+        got++;
+    }
+    received += got;
+    return (r == -1 && got == 0) ? -1 : got;
+}
+
+void NetSocket::sendSocket(const Uint8 *prefix, int len, UDPpacket *p,
+                           const IPaddress *to)
+{
+    memcpy( scratch->data, prefix, len );
+    scratch->len = len;
+    if( p ) {
+        memcpy( scratch->data + len, p->data, p->len );
+        scratch->len += p->len;
+    }
+    scratch->address = *to;
+    SDLNet_UDP_Send(sock, -1, scratch);
+    sent++;
+}
+
+void NetSocket::flushSocket()
+{
+}
+
+#endif
+
+void NetSocket::setEmulator(NetEmulator *e)
+{
+    delete emu;
+    emu = e;
+}
+
+void NetSocket::wait(int ms)
+{
+    if( emu ) {
+        ms = emu->timeout(ms, SDL_GetTicks());
+    }
+    waitSocket(ms);
+}
+
+/* Everything that arrives goes into the emulator, and comes out when it is
+ * due. The caller's packets serve as the receive buffers on the way in. */
+int NetSocket::recv(UDPpacket **p, int n)
+{
+    if( !emu ) {
+        return recvSocket(p, n);
+    }
+
+    Uint32 now = SDL_GetTicks();
+    int got;
+
+    while( (got = recvSocket(p, n)) > 0 ) {
+        for( int i=0; i<got; i++ ) {
+            emu->receive(p[i], now);
+        }
+    }
+    if( got == -1 ) {
+        return -1;
+    }
+    for( got = 0; got < n && emu->nextIn(now, p[got]); got++ )
+        ;
+    return got;
+}
+
+void NetSocket::send(const Uint8 *prefix, int len, UDPpacket *p,
+                     const IPaddress *to)
+{
+    if( emu ) {
+        emu->send(prefix, len, p, to, SDL_GetTicks());
+    } else {
+        sendSocket(prefix, len, p, to);
+    }
+}
+
+void NetSocket::flush()
+{
+    if( emu ) {
+        const NetDatagram *d;
+        while( (d = emu->nextOut(SDL_GetTicks())) ) {
+            sendSocket(d->prefix, d->prefix_len,
+                       d->data.empty() ? NULL : (UDPpacket*)&d->packet,
+                       &d->address);
+        }
+    }
+    flushSocket();
+    if( emu ) {
+        emu->sendDone();
+    }
+}
+
+void NetSocket::bind(int channel, const IPaddress *a)
+{
+    assert( channel >= 0 && channel < SDLNET_MAX_UDPCHANNELS );
+    peer[channel] = *a;
+}
+
+const IPaddress *NetSocket::getPeer(int channel)
+{
+    assert( channel >= 0 && channel < SDLNET_MAX_UDPCHANNELS );
+    return &peer[channel];
+}
@@ -0,0 +1,126 @@
+/*
+ *  Copyright (C) 2005 Joe Neeman <spuzzzzzzz@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#ifndef NETSOCKET_H
+#define NETSOCKET_H
+
+#include "Gnumch.h"
+#include <SDL_net.h>
+
+class NetEmulator;
+
+#if defined(HAVE_SYS_EPOLL_H) && defined(HAVE_SYS_EVENTFD_H) && \
+    defined(HAVE_RECVMMSG) && defined(HAVE_SENDMMSG)
+#   define NET_USE_EPOLL
+#   include <sys/socket.h>
+#   include <netinet/in.h>
+#endif
+
+/* The largest packet we ever send or receive, not counting its header. With
+ * the headers this stays under the 1280 byte minimum IPv6 MTU, so a batch of
+ * events shouldn't be fragmented. */
+#define NET_PACKET_SIZE 1200
+
+/* the most packets that we read or write with one system call */
+#define NET_BATCH 32
+
+/* the longest header that can go in front of a packet */
+#define NET_PREFIX_MAX 16
+
+/* A UDP socket that sends and receives packets in batches. On Linux, it waits
+ * with epoll and can be woken from another thread through an eventfd, so a
+ * packet that is queued to send doesn't have to wait for the poll to time
+ * out. Elsewhere it falls back to plain SDL_net. */
+class NetSocket {
+    public:
+        /** Open a socket on the given port, or on any free port if port is
+         *  0. Check ok() afterwards.
+         *  @param shared let other sockets on this machine open the same
+         *                port, so that they all hear broadcasts to it. This
+         *                only works with NET_USE_EPOLL. */
+        NetSocket(int port, bool shared=false);
+        ~NetSocket();
+
+        bool ok();
+
+        /** Send packets on the given channel to this address, as with
+         *  SDLNet_UDP_Bind. */
+        void bind(int channel, const IPaddress *a);
+        const IPaddress *getPeer(int channel);
+
+        /** Wait up to ms milliseconds for something to read, or for wake()
+         *  to be called. */
+        void wait(int ms);
+
+        /** Make wait() return early. This can be called from any thread. */
+        void wake();
+
+        /** Read up to n waiting packets without blocking.
+         *  @return the number of packets read, or -1 on error. */
+        int  recv(UDPpacket **p, int n);
+
+        /** Queue a datagram made of a header of len bytes, which is copied,
+         *  followed by the packet p, which may be NULL. The packet must not
+         *  be freed or changed until the next flush(). Sending one packet to
+         *  many addresses this way doesn't copy it. */
+        void send(const Uint8 *prefix, int len, UDPpacket *p,
+                  const IPaddress *to);
+        void flush();
+
+        /* the number of datagrams sent and received so far */
+        int  getSent()     {return sent;}
+        int  getReceived() {return received;}
+
+        /** Pass everything sent and received through an emulated network
+         *  (see NetEmulator.h). The socket deletes it. */
+        void setEmulator(NetEmulator *e);
+
+    private:
+        /* the real socket, under the emulator */
+        void waitSocket(int ms);
+        int  recvSocket(UDPpacket **p, int n);
+        void sendSocket(const Uint8 *prefix, int len, UDPpacket *p,
+                        const IPaddress *to);
+        void flushSocket();
+
+        int sent, received;
+        NetEmulator *emu;
+
+        IPaddress peer[SDLNET_MAX_UDPCHANNELS];
+
+#ifdef NET_USE_EPOLL
+        int fd;
+        int epoll_fd;
+        int wake_fd;
+
+        struct mmsghdr in_msg[NET_BATCH];
+        struct iovec in_iov[NET_BATCH];
+        struct sockaddr_in in_addr[NET_BATCH];
+
+        struct mmsghdr out_msg[NET_BATCH];
+        struct iovec out_iov[NET_BATCH][2];
+        struct sockaddr_in out_addr[NET_BATCH];
+        Uint8 out_prefix[NET_BATCH][NET_PREFIX_MAX];
+        int out_num;
+#else
+        UDPsocket sock;
+        SDLNet_SocketSet set;
+        UDPpacket *scratch;     /* SDL_net wants the datagram in one piece */
+#endif
+};
+
+#endif
@@ -0,0 +1,172 @@
+/*
+ *  Copyright (C) 2005 Joe Neeman <spuzzzzzzz@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#include "NetStats.h"
+
+void formatNetStats(const NetStats &s, string *out)
+{
+    char line[160];
+
+    snprintf(line, sizeof(line), "%d connections, send queue %d (peak %d), "
+             "%d disconnects, %u dropped from strangers, "
+             "%.3fs holding the player list\n",
+             (int)s.conns.size(), s.queue_depth, s.queue_peak,
+             s.disconnects, s.strangers_dropped, s.lock_us / 1e6);
+    *out = line;
+    *out += "player           room  id    rtt    var   loss  retx"
+            "  pkts/s out    in  kB/s out    in  backlog"
+            "  drop/s in   out\n";
+    for (int i=0; i<(int)s.conns.size(); i++) {
+        const ConnStats &c = s.conns[i];
+        snprintf(line, sizeof(line), "%-16.16s %4d %3d %4dms %4dms %5.1f%% "
+                 "%5u %11.0f %5.0f %9.1f %5.1f %8d %10.0f %5.0f\n",
+                 c.name.c_str(), c.room, c.id, c.rtt, c.rttvar,
+                 c.loss * 100, c.totals.retransmits, c.packets_out,
+                 c.packets_in, c.bytes_out / 1024, c.bytes_in / 1024,
+                 c.backlog, c.dropped_in, c.dropped_out);
+        *out += line;
+    }
+}
+
+/* label values may hold anything but a backslash, a quote or a newline */
+static string escapeLabel(const string &s)
+{
+    string ret;
+
+    for (int i=0; i<(int)s.size(); i++) {
+        switch (s[i]) {
+            case '\\': ret += "\\\\"; break;
+            case '"':  ret += "\\\""; break;
+            case '\n': ret += "\\n"; break;
+            default:   ret += s[i];
+        }
+    }
+    return ret;
+}
+
+static void metricHeader(FILE *f, const char *name, const char *type,
+                         const char *help)
+{
+    fprintf(f, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+static void metric(FILE *f, const char *name, const char *type,
+                   const char *help, double val)
+{
+    metricHeader(f, name, type, help);
+    fprintf(f, "%s %.15g\n", name, val);
+}
+
+/* one line for each connection, with expr worked out for connection c */
+#define CONN_METRIC(name, type, help, expr) \
+    metricHeader(f, name, type, help); \
+    for (int i=0; i<(int)s.conns.size(); i++) { \
+        const ConnStats &c = s.conns[i]; \
+        fprintf(f, "%s{%s} %.15g\n", name, labels[i].c_str(), \
+                (double)(expr)); \
+    }
+
+void writePrometheus(FILE *f, const NetStats &s, const string &extra)
+{
+    vector<string> labels;
+
+    for (int i=0; i<(int)s.conns.size(); i++) {
+        string l = "player=\"" + escapeLabel(s.conns[i].name) + "\",room=\"";
+        l += itostr(s.conns[i].room) + "\",id=\"";
+        l += itostr(s.conns[i].id) + "\"";
+        labels.push_back(l);
+    }
+
+    metric(f, "gnumch_net_connections", "gauge",
+           "Connections open.", s.conns.size());
+    metric(f, "gnumch_net_send_queue_depth", "gauge",
+           "Packets sent in the last flush of the send queue.",
+           s.queue_depth);
+    metric(f, "gnumch_net_send_queue_peak", "gauge",
+           "The most packets sent in one flush over the last interval.",
+           s.queue_peak);
+    metric(f, "gnumch_net_outbox_overflows_total", "counter",
+           "Packets that didn't fit in a game thread's outbox.",
+           s.outbox_overflows);
+    metric(f, "gnumch_net_disconnects_total", "counter",
+           "Connections dropped because the other end stopped answering.",
+           s.disconnects);
+    metric(f, "gnumch_net_stranger_dropped_total", "counter",
+           "Datagrams from unconnected addresses dropped by the rate limit.",
+           s.strangers_dropped);
+    metric(f, "gnumch_net_lock_held_seconds_total", "counter",
+           "Time the network thread has held the player list locked.",
+           s.lock_us / 1e6);
+
+    CONN_METRIC("gnumch_net_rtt_seconds", "gauge",
+                "Smoothed round trip time.", c.rtt / 1000.0);
+    CONN_METRIC("gnumch_net_rttvar_seconds", "gauge",
+                "Mean deviation of the round trip time.", c.rttvar / 1000.0);
+    CONN_METRIC("gnumch_net_loss_ratio", "gauge",
+                "Fraction of datagrams lost over the last interval.", c.loss);
+    CONN_METRIC("gnumch_net_retransmits_total", "counter",
+                "Reliable payloads sent again.", c.totals.retransmits);
+    CONN_METRIC("gnumch_net_lost_total", "counter",
+                "Datagrams that were never acked.", c.totals.lost);
+    CONN_METRIC("gnumch_net_packets_sent_total", "counter",
+                "Datagrams sent.", c.totals.packets_out);
+    CONN_METRIC("gnumch_net_packets_received_total", "counter",
+                "Datagrams received.", c.totals.packets_in);
+    CONN_METRIC("gnumch_net_bytes_sent_total", "counter",
+                "Bytes sent, counting the connection header.",
+                c.totals.bytes_out);
+    CONN_METRIC("gnumch_net_bytes_received_total", "counter",
+                "Bytes received, counting the connection header.",
+                c.totals.bytes_in);
+    CONN_METRIC("gnumch_net_packets_sent_per_second", "gauge",
+                "Datagrams sent a second over the last interval.",
+                c.packets_out);
+    CONN_METRIC("gnumch_net_packets_received_per_second", "gauge",
+                "Datagrams received a second over the last interval.",
+                c.packets_in);
+    CONN_METRIC("gnumch_net_bytes_sent_per_second", "gauge",
+                "Bytes sent a second over the last interval.", c.bytes_out);
+    CONN_METRIC("gnumch_net_bytes_received_per_second", "gauge",
+                "Bytes received a second over the last interval.",
+                c.bytes_in);
+    CONN_METRIC("gnumch_net_dropped_received_total", "counter",
+                "Datagrams received over the rate limit and dropped.",
+                c.totals.dropped_in);
+    CONN_METRIC("gnumch_net_dropped_sent_total", "counter",
+                "Unreliable datagrams not sent for going over the "
+                "bandwidth limit.", c.totals.dropped_out);
+    CONN_METRIC("gnumch_net_reliable_backlog", "gauge",
+                "Reliable payloads waiting to be acked.", c.backlog);
+
+    fputs(extra.c_str(), f);
+}
+
+bool dumpPrometheus(const char *file, const NetStats &s, const string &extra)
+{
+    string tmp = string(file) + ".tmp";
+    FILE *f = fopen(tmp.c_str(), "w");
+
+    if (!f) {
+        return false;
+    }
+    writePrometheus(f, s, extra);
+    if (fclose(f) != 0 || rename(tmp.c_str(), file) != 0) {
+        remove(tmp.c_str());
+        return false;
+    }
+    return true;
+}
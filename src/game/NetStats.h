@@ -0,0 +1,78 @@
+/*
+ *  Copyright (C) 2005 Joe Neeman <spuzzzzzzz@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#ifndef NETSTATS_H
+#define NETSTATS_H
+
+#include "Gnumch.h"
+#include "Connection.h"
+
+/* how often the network thread works out the rates below, in ms */
+#define NET_STATS_INTERVAL 1000
+
+/* How one connection is doing. The rates are over the last
+ * NET_STATS_INTERVAL; the totals are since it connected. */
+typedef struct {
+    string name;
+    int id;
+    int room;
+    int rtt;                /* smoothed round trip time, in ms */
+    int rttvar;             /* and its mean deviation */
+    double loss;            /* the fraction of datagrams lost, 0 to 1 */
+    double packets_out;     /* per second */
+    double packets_in;
+    double bytes_out;
+    double bytes_in;
+    double dropped_in;      /* datagrams a second dropped by the rate */
+    double dropped_out;     /* limits (see NET_IN_RATE and NET_OUT_RATE) */
+    int backlog;            /* reliable payloads waiting for acks */
+    ConnCounters totals;
+} ConnStats;
+
+/* How a NetThread is doing, as of the last sample. */
+typedef struct {
+    Uint32 time;            /* SDL_GetTicks() when it was taken */
+    int queue_depth;        /* the packets sent in the last flush */
+    int queue_peak;         /* the most sent in one flush, since the last
+                             * sample */
+    int outbox_overflows;
+    Uint32 disconnects;
+    Uint32 strangers_dropped;   /* datagrams from unconnected addresses that
+                                 * went over NET_STRANGER_RATE */
+    Uint64 lock_us;         /* the time the network thread has spent holding
+                             * the player list locked, which stalls anyone
+                             * else that wants it */
+    vector<ConnStats> conns;
+} NetStats;
+
+/** Write the stats as a table, one line per connection, for people. */
+void formatNetStats(const NetStats&, string *out);
+
+/** Write the stats in the Prometheus text exposition format. Each metric
+ *  for a connection is labelled with the player's name, room and id.
+ *  Anything in extra (more metrics in the same format) is added to the
+ *  end. */
+void writePrometheus(FILE*, const NetStats&, const string &extra="");
+
+/** Write the stats to a file with writePrometheus. The file is written
+ *  under another name and then renamed, so that a scraper never sees half
+ *  of it.
+ *  @return false if it couldn't be written. */
+bool dumpPrometheus(const char *file, const NetStats&,
+                    const string &extra="");
+
+#endif
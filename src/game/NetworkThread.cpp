@@ -16,19 +16,16 @@
  *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
  */
 #include "NetworkThread.h"
-#include "MultiPlayerServer.h"
-#include "MultiPlayerClient.h"
 
 /* Packet formats are as follows:
- * All packets begin with the following 10 bytes:
+ * All packets begin with the following 10 bytes, which come after the
+ * connection header described in Connection.h:
  * ---------------------------------------------------------------------------
- * |Retry # (8)  |Packet Type (8)| Packet ID(32)     |   Timestamp (32)      |
+ * |Version (8)  |Packet Type (8)| Packet ID(32)     |   Timestamp (32)      |
  * ---------------------------------------------------------------------------
  *
- * The retry number specifies how many times this packet has failed (a packet
- * fails if a response is not had withing a reasonable amount of tile). If a
- * packet fails too many times, the recipient of the failed packet will be
- * disconnected.
+ * The version is NET_PROTOCOL_VERSION (see Wire.h). A packet with any other
+ * version is dropped, since we can't know what its fields mean.
  *
  * The packet type specifies the format of the packet. The formats are
  * described below.
@@ -38,162 +35,617 @@
  * given computer. That is, a server and a client can both send a packet of id
  * 763, but each server/client will only send ONE packet of id 763.
  *
- * The timestamp from a client packet is the game time of that client. The
- * timestamp from a server packet is the game time that the server thinks the
- * recipient is at. That is, the server is responsible for checking the clock
- * skew of a client and adjusting for it.
- *
+ * The timestamp is the sender's SDL_GetTicks() when it made the packet. Each
+ * end pings the other to estimate its clock (see ClockSync.h), and
+ * packetTime() translates the timestamp into the receiver's time.
  *
+ * The header has fixed offsets so that it can be read without parsing.
+ * Everything after it is a list of fields as given by packet_format below,
+ * in the encoding described in Wire.h: small numbers take a byte, strings
+ * take only as much room as they need, and a square of the board usually
+ * fits in a byte.
  *
  * Packet format 0 (used for pinging):
- * Length: 10
- * ------
- *  ... |
- * ------
+ * No fields.
  *
  * Packet format 1 (used for ack):
- * Length: 14
- * ------------------------
- *  ... |   Reply-to ID (32)  |
- * ------------------------
+ * Reply-to ID (u), Ping time (t)
  *
  * Reply-to ID is the unique identifier of the packet that this packet is
- * replying to.
- *
+ * replying to, and Ping time is that packet's timestamp. The ack is made as
+ * soon as the ping arrives, so its own timestamp says when the ping got
+ * there.
  *
  * Packet format 2 (used for requesting/granting player IDs):
- * Length: 32
- * ---------------------------------------------------
- *  ... |   Reply-to ID (32)  |  ID (8)  | name (17) |
- * ---------------------------------------------------
+ * Reply-to ID (i), ID (i), name (s), room (b), watch (b)
  *
  * Reply-to ID is -1 for requesting a player ID. If this packet is granting
  * a player ID, reply-to ID is the same as in packet format 1.
  *
- * ID is the player ID that was granted. If this packet is requesting an ID,
- * ID is -1
+ * ID is the player ID that was granted, or -1 if the room is full. If this
+ * packet is requesting an ID, ID is -1.
+ *
+ * Name is the player name to associate with the granted ID; only the first
+ * PLAYER_NAME_LEN bytes are kept.
+ *
+ * Room is the room on the server that the player wants to join, or was let
+ * into.
  *
- * Name is the player name to associate with the granted ID. It is
- * null-terminated.
+ * Watch is 0 to play. Otherwise the client is a spectator, and watch is the
+ * rate tier that it wants plus one (see SPECTATOR_TIERS). A spectator gets
+ * no events, only a format 7 JoinState at the rate of its tier, and the
+ * server ignores anything but pings from it. Its ID is only used to tell
+ * spectators apart.
  *
  * Packet format 3 (used for NetEvents):
- * Length: >=32
- * ----------------------
- *  ... | Event Type(8) |
- * ----------------------
+ * -----------------------------------------------------------------
+ *  ... | Event Type (b) | arguments | Event Type (b) | arguments ...
+ * -----------------------------------------------------------------
  *
- * The subsequent elements of this packet depend on the Event Type. They are
- * defined in NetThread.h
+ * The arguments of each event depend on its type, and are given by
+ * event_format below. Events are packed back to back with nothing between
+ * them, as many as fit in NET_PACKET_SIZE; the events of one server tick
+ * usually fit in a single packet (see EventBatch). All of the events in a
+ * packet have the same entry in event_channel. Player ids 0 to
+ * MAX_PLAYERS-1 are munchers; the troggles come after them.
  *
  * Packet format 4 (request server details):
- * Length: 23 + 23*numplayers
- * -----------------------------------------------------------------------------
- *  ... | Server name(17) | # Players(1) | max players(1) |   runtime(4)   | ...
- * -----------------------------------------------------------------------------
- * ----------------------------------------------------------------------------
- *  ... | Player id(1) | Player name(17) | Player score(4) | Player Lives(1)...
- * ----------------------------------------------------------------------------
+ * Server name (s), # Players (b), max players (b), runtime (u), room (b)
+ * followed by, for each player:
+ * Player id (b), Player name (s), Player score (i), Player lives (b)
+ *
+ * A request has no fields. A server with several rooms answers a details
+ * request with one packet for each room. Finding servers doesn't need
+ * these; ServerBrowser only asks for them when it wants the player list.
+ * The replies are much bigger than the request, so the server stops
+ * answering an address that asks too often (see NET_QUERY_RATE), and leaves
+ * out a room whose players don't fit in a packet.
+ *
+ * Packet format 5 (world snapshots):
+ * Snapshot ID (u), Base ID (u), Input seq (u), then the snapshot data
+ *
+ * The snapshot data is bit-packed as described in Snapshot.cpp. Unless it is
+ * a full snapshot, it holds the changes since the snapshot numbered Base ID,
+ * which is the newest one that the client has acknowledged with a
+ * SNAPSHOT_ACK event.
+ *
+ * Input seq is the sequence number of the last PLAYER_KEY from the recipient
+ * that the server had acted on when it took the snapshot. The client uses it
+ * to replay the keys that came after (see Prediction.h).
+ *
+ * Packet format 6 (server announcements):
+ * Server name (s), # Players (b), max players (b), runtime (u), room (b)
+ *
+ * The same summary as a details reply, without the players. Servers
+ * broadcast one for each room to DISCOVERY_PORT every ANNOUNCE_INTERVAL, and
+ * send them straight back in answer to an announcement with no fields,
+ * which ServerBrowser broadcasts so that it doesn't have to wait. Those
+ * answers count against NET_QUERY_RATE too.
+ *
+ * Packet format 7 (join state fragments):
+ * Snapshot ID (u), Input seq (u), Fragment (b), Fragments (b), then one
+ * piece of the encoded JoinState
+ *
+ * A player that has no snapshot for the server to build a delta on, which
+ * is always the case just after joining, is sent a JoinState in place of
+ * a snapshot. It is split into Fragments pieces of JOIN_FRAGMENT_SIZE
+ * bytes (the last may be shorter), numbered from 0; see JoinAssembler.
+ * Once the client acks Snapshot ID with a SNAPSHOT_ACK, the server sends
+ * format 5 deltas against it. Input seq is as for format 5.
  */
-#define PACKET_RETRYNO(p) (p->data[0])
-#define PACKET_TYPE(p) (p->data[1])
-#define PACKET_ID(p) (p->data[2])
-#define PACKET_TIME(p) (p->data[6])
-#define PACKET_DATA(p) (&p->data[10])
-
-#define NETASSERT_S(n,s) \
-    if(!n) { \
-        printWarning("NetAssert failed: %s\n", s); \
-    }
-
-#define NETASSERT(n) NETASSERT_S(n,"Packet sanity check failed")
 
-extern Game *game;
-
-NetThread::NetThread()
+/* the fields after the header, indexed by PacketType. Events and the
+ * players in a details packet come after these. */
+static const char *packet_format[] = {
+    "",         /* PT_PING */
+    "ut",       /* PT_ACK: reply-to id, ping time */
+    "iisbb",    /* PT_REG: reply-to id, player id, name, room, watch */
+    "",         /* PT_EVENT */
+    "sbbub",    /* PT_DETAILS: name, players, max players, runtime, room */
+    "uuu",      /* PT_SNAPSHOT: snapshot id, base id, input seq */
+    "sbbub",    /* PT_ANNOUNCE: as PT_DETAILS */
+    "uubb"      /* PT_JOIN: snapshot id, input seq, fragment, fragments */
+};
+
+/* the arguments of each NetEvent, indexed by NetEvent */
+static const char *event_format[] = {
+    "bcc",      /* PLAYER_MOVE: id, old x, old y, x, y */
+    "bc",       /* PLAYER_STOP: id, x, y */
+    "bc",       /* PLAYER_EAT: id, x, y */
+    "b",        /* PLAYER_DIE: id */
+    "bc",       /* PLAYER_SPAWN: id, x, y */
+    "bi",       /* PLAYER_SCORE: id, score */
+    "",         /* GAME_NEXTLEVEL */
+    "",         /* GAME_TROGWARN */
+    "",         /* GAME_TROGHIDE */
+    "cbs",      /* GAME_SETNUM: x, y, good, text */
+    "bu",       /* PLAYER_KEY: key, input seq */
+    "u"         /* SNAPSHOT_ACK: snapshot id */
+};
+
+/* A move is superseded by the next one, so there is no point waiting for
+ * it to be resent. Everything else changes the state for good, stops
+ * included: nothing follows the last stop to correct a lost one, and the
+ * player would be left walking. */
+static const Uint8 event_channel[] = {
+    CHAN_UNRELIABLE,    /* PLAYER_MOVE */
+    CHAN_RELIABLE,      /* PLAYER_STOP */
+    CHAN_RELIABLE,      /* PLAYER_EAT */
+    CHAN_RELIABLE,      /* PLAYER_DIE */
+    CHAN_RELIABLE,      /* PLAYER_SPAWN */
+    CHAN_RELIABLE,      /* PLAYER_SCORE */
+    CHAN_RELIABLE,      /* GAME_NEXTLEVEL */
+    CHAN_RELIABLE,      /* GAME_TROGWARN */
+    CHAN_RELIABLE,      /* GAME_TROGHIDE */
+    CHAN_RELIABLE,      /* GAME_SETNUM */
+    CHAN_RELIABLE,      /* PLAYER_KEY */
+    CHAN_UNRELIABLE     /* SNAPSHOT_ACK */
+};
+
+NetThread::NetThread(int pool_size)
 {
     if(SDLNet_Init()==-1) {
         printError("SDLNet_Init failed: %s\n", SDLNet_GetError());
     }
+    sock = NULL;
+    pool = new PacketPool(pool_size, NET_PACKET_SIZE);
+    send_queue.reserve(pool_size);
+    sending.reserve(pool_size);
+    outbox_overflows = 0;
+    loop_thread = NULL;
+    quit = false;
+    packet_id = 0;
     packet_id_mutex = SDL_CreateMutex();
+    send_mutex = SDL_CreateMutex();
+    active_player_mutex = SDL_CreateMutex();
+
+    stats_mutex = SDL_CreateMutex();
+    stats_time = SDL_GetTicks();
+    queue_peak = last_queue = 0;
+    lock_us = 0;
+    disconnects = 0;
+    strangers_dropped = 0;
+    stats.time = stats_time;
+    stats.queue_depth = stats.queue_peak = stats.outbox_overflows = 0;
+    stats.disconnects = 0;
+    stats.strangers_dropped = 0;
+    stats.lock_us = 0;
 }
 
 NetThread::~NetThread()
 {
-    if(listen)
-        SDLNet_UDP_Close(listen);
+    cancelThreads();
+
+    for( int i=0; i<(int)send_queue.size(); i++ ) {
+        pool->unref( send_queue[i] );
+    }
+    for( int i=0; i<(int)outboxes.size(); i++ ) {
+        UDPpacket *p;
+        while( outboxes[i]->pop(&p) ) {
+            pool->unref(p);
+        }
+        delete outboxes[i];
+    }
+    for( int i=0; i<(int)active_players.size(); i++ ) {
+        delete active_players[i]->conn;
+        delete active_players[i];
+    }
+
+    delete sock;
+    delete pool;
+
+    SDL_DestroyMutex(packet_id_mutex);
+    SDL_DestroyMutex(send_mutex);
+    SDL_DestroyMutex(active_player_mutex);
+    SDL_DestroyMutex(stats_mutex);
+    SDLNet_Quit();
 }
 
 void NetThread::start()
 {
-    SDL_CreateThread(netThreadLoop, this);
+    if( !sock || !sock->ok() ) {
+        printError("network thread started without a socket\n");
+    }
+    quit = false;
+    loop_thread = SDL_CreateThread(netThreadLoop, this);
 }
 
-ClientNetThread::ClientNetThread()
+void NetThread::stop()
 {
-    listen = SDLNet_UDP_Open(0);
+    cancelThreads();
+    flushSendQueue();
+    printMsg(1, "packet pool: %d packets, %d in use, peak %d, %d overflows\n",
+             pool->getSize(), pool->getInUse(), pool->getPeakInUse(),
+             pool->getOverflows());
+    if( outbox_overflows ) {
+        printMsg(0, "%d events didn't fit in an outbox\n", outbox_overflows);
+    }
 }
 
-ClientNetThread::~ClientNetThread()
+void NetThread::cancelThreads()
 {
+    if( loop_thread ) {
+        quit = true;
+        sock->wake();
+        SDL_WaitThread(loop_thread, NULL);
+        loop_thread = NULL;
+    }
 }
 
-ServerNetThread::ServerNetThread()
+/* Sleep until there is a packet to read or queueSend() wakes us, then read
+ * what has arrived and send everything that has been queued, a batch at a
+ * time. At most NET_RECV_BATCHES are read each time round, so the sends go
+ * out on time however much is arriving; anything left over makes the next
+ * wait return straight away. */
+int netThreadLoop(void *net)
 {
-    listen = SDLNet_UDP_Open(SERVER_PORT);
-}
+    NetThread *n = (NetThread*)net;
+    UDPpacket **p = SDLNet_AllocPacketV(NET_BATCH,
+                                        NET_PREFIX_MAX + NET_PACKET_SIZE);
 
-ServerNetThread::~ServerNetThread()
-{
+    while( !n->quit ) {
+        n->sock->wait(NET_POLL_MS);
+
+        int got = 0;
+        for( int b=0; b<NET_RECV_BATCHES &&
+                      (got = n->sock->recv(p, NET_BATCH)) > 0; b++ ) {
+            n->receiveBatch(p, got, SDL_GetTicks());
+        }
+        if( got == -1 ) {
+            printWarning("couldn't receive packets\n");
+        }
+
+        n->flushSendQueue();
+
+        Uint32 now = SDL_GetTicks();
+        if( now - n->stats_time >= NET_STATS_INTERVAL ) {
+            n->updateStats(now);
+        }
+        n->periodic(now);
+    }
+
+    SDLNet_FreePacketV(p);
+    return 0;
 }
 
-int netThreadLoop(void *net)
+/* The outboxes are emptied without locking, and the shared queue is swapped
+ * out, so the game threads never wait for the sends. Both vectors keep their
+ * capacity, and the packets come from the pool, so once things settle down
+ * this doesn't allocate. */
+void NetThread::flushSendQueue()
 {
-    NetThread *n = (NetThread*)net;
-    UDPpacket *p = n->createGenericPacket();
+    UDPpacket *p;
+
+    for( int i=0; i<(int)outboxes.size(); i++ ) {
+        while( outboxes[i]->pop(&p) ) {
+            sending.push_back(p);
+        }
+    }
+
+    SDL_mutexP(send_mutex);
+    sending.insert(sending.end(), send_queue.begin(), send_queue.end());
+    send_queue.clear();
+    SDL_mutexV(send_mutex);
 
-    while( SDLNet_UDP_Recv(n->listen, p) != -1 ) {
-        n->handlePacket(p);
+    Uint32 now = SDL_GetTicks();
 
-        SDL_mutexP(n->send_mutex);
+    last_queue = sending.size();
+    queue_peak = max(queue_peak, last_queue);
 
-        while( !n->send_queue.empty() ) {
-            UDPpacket *tmp = n->send_queue.front();
+    if( !sending.empty() ) {
+        SDL_mutexP(active_player_mutex);
+        Uint64 locked = microseconds();
+        for( int j=0; j<(int)sending.size(); j++ ) {
+            UDPpacket *tmp = sending[j];
+            const IPaddress *to;
 
-            if(tmp->channel == -1) {
-                for(int i=0; i<(int)n->active_players.size(); i++) {
-                    SDLNet_UDP_Send(n->listen, n->active_players[i]->channel,
-                                                                        tmp);
+            if(tmp->channel == CHANNEL_ALL) {
+                for(int i=0; i<(int)active_players.size(); i++) {
+                    playerInfo_t *pi = active_players[i];
+                    if(pi->watching == -1) {
+                        transmit(tmp, &pi->address, pi, now);
+                    }
+                }
+            } else if(tmp->channel <= CHANNEL_SPECTATORS(0, 0)) {
+                /* the same packet goes to every spectator in the tier */
+                map<int, vector<playerInfo_t*> >::iterator s;
+                s = spectators.find(tmp->channel);
+                for(int i=0; s != spectators.end() &&
+                             i<(int)s->second.size(); i++) {
+                    playerInfo_t *pi = s->second[i];
+                    transmit(tmp, &pi->address, pi, now);
+                }
+            } else if(tmp->channel < CHANNEL_ROOM(MAX_ROOMS)) {
+                for(int i=0; i<(int)active_players.size(); i++) {
+                    playerInfo_t *pi = active_players[i];
+                    if(pi->watching == -1 &&
+                       tmp->channel == CHANNEL_PLAYER(pi->room, pi->id)) {
+                        transmit(tmp, &pi->address, pi, now);
+                        break;
+                    }
+                }
+            } else if(tmp->channel < CHANNEL_ALL) {
+                for(int i=0; i<(int)active_players.size(); i++) {
+                    playerInfo_t *pi = active_players[i];
+                    if(pi->watching == -1 &&
+                       tmp->channel == CHANNEL_ROOM(pi->room)) {
+                        transmit(tmp, &pi->address, pi, now);
+                    }
                 }
             } else {
-                SDLNet_UDP_Send(n->listen, tmp->channel, tmp);
+                to = tmp->channel >= 0 ? sock->getPeer(tmp->channel)
+                                       : &tmp->address;
+                transmit(tmp, to, findConnection(*to), now);
             }
+        }
+        lock_us += microseconds() - locked;
+        SDL_mutexV(active_player_mutex);
+    }
 
-            SDLNet_FreePacket(tmp);
-            n->send_queue.pop();
-        };
+    serviceConnections(now);
 
-        SDL_mutexV(n->send_mutex);
+    /* the socket still points at the packets until it is flushed */
+    sock->flush();
+    for( int i=0; i<(int)sending.size(); i++ ) {
+        pool->unref(sending[i]);
+    }
+    sending.clear();
+}
 
-        SDL_Delay(5);
+/* Send a packet to one address. Unreliable packets go straight out, unless
+ * the player has used up their out_limit; reliable ones are handed to the
+ * connection, which sends them from serviceConnections(). */
+void NetThread::transmit(UDPpacket *p, const IPaddress *to, playerInfo_t *pi,
+                         Uint32 now)
+{
+    Uint8 header[NET_HEADER_LEN];
+    int chan = packetChannel(p);
+
+    if( !pi || chan == CHAN_OOB ) {
+        Connection::writeOOB(header);
+        sock->send(header, NET_HEADER_LEN, p, to);
+    } else if( chan == CHAN_UNRELIABLE ) {
+        if( pi->out_limit.empty(now) ) {
+            /* a newer one will come along */
+            pi->conn->countDropped(false);
+            return;
+        }
+        pi->conn->writeUnreliable(header, now);
+        sendOn(pi, header, p, to, now);
+    } else if( !pi->conn->queueReliable(p) ) {
+        /* they haven't acked anything for a very long time */
+        pi->conn->setFailed();
     }
+}
 
-    printError("SDLNet_UDP_Recv returned error: %s\n", SDLNet_GetError());
-    return 0;
+/* send the reliable packets that are due, as far as each player's out_limit
+ * allows, and any acks that haven't had a packet to ride on, then drop the
+ * players that have stopped answering. Pings and acks go out regardless, so
+ * that a busy connection isn't taken for a dead one. */
+void NetThread::serviceConnections(Uint32 now)
+{
+    Uint8 header[NET_HEADER_LEN];
+    vector<playerInfo_t*> failed;
+
+    SDL_mutexP(active_player_mutex);
+    Uint64 locked = microseconds();
+    for( int i=0; i<(int)active_players.size(); i++ ) {
+        playerInfo_t *pi = active_players[i];
+        UDPpacket *p;
+
+        while( !pi->out_limit.empty(now) &&
+               (p = pi->conn->nextResend(header, now)) ) {
+            sendOn(pi, header, p, &pi->address, now);
+        }
+        if( pi->clock.wantsPing(now) ) {
+            p = createPingPacket();
+            pi->conn->writeUnreliable(header, now);
+            sendOn(pi, header, p, &pi->address, now);
+            sending.push_back(p);   /* unrefed after the flush */
+        }
+        if( pi->conn->wantsAck(now) ) {
+            pi->conn->writeAck(header, now);
+            sendOn(pi, header, NULL, &pi->address, now);
+        }
+        if( pi->conn->failed() ) {
+            failed.push_back(pi);
+        }
+    }
+    lock_us += microseconds() - locked;
+    SDL_mutexV(active_player_mutex);
+
+    disconnects += failed.size();
+    for( int i=0; i<(int)failed.size(); i++ ) {
+        printMsg(0, "lost contact with %s\n", failed[i]->name.c_str());
+        handleDisconnect(failed[i]);
+    }
+}
+
+void NetThread::sendOn(playerInfo_t *pi, const Uint8 *header, UDPpacket *p,
+                       const IPaddress *to, Uint32 now)
+{
+    int len = NET_HEADER_LEN + (p ? p->len : 0);
+
+    pi->conn->countSent(len);
+    pi->out_limit.charge(len, now);
+    sock->send(header, NET_HEADER_LEN, p, to);
+}
+
+void NetThread::updateStats(Uint32 now)
+{
+    vector<ConnStats> conns;
+    double secs = (now - stats_time) / 1000.0;
+
+    SDL_mutexP(active_player_mutex);
+    for( int i=0; i<(int)active_players.size(); i++ ) {
+        playerInfo_t *pi = active_players[i];
+        Connection *conn = pi->conn;
+        ConnCounters recent;
+        ConnStats c;
+
+        conn->sampleCounters(&c.totals, &recent);
+        c.name = pi->name;
+        c.id = pi->id;
+        c.room = pi->room;
+        c.rtt = conn->getRTT();
+        c.rttvar = conn->getRTTVar();
+        c.backlog = conn->getBacklog();
+        c.loss = recent.lost + recent.delivered ?
+                 (double)recent.lost / (recent.lost + recent.delivered) : 0;
+        c.packets_out = recent.packets_out / secs;
+        c.packets_in = recent.packets_in / secs;
+        c.bytes_out = recent.bytes_out / secs;
+        c.bytes_in = recent.bytes_in / secs;
+        c.dropped_in = recent.dropped_in / secs;
+        c.dropped_out = recent.dropped_out / secs;
+        conns.push_back(c);
+    }
+    SDL_mutexV(active_player_mutex);
+
+    SDL_mutexP(stats_mutex);
+    stats.time = now;
+    stats.queue_depth = last_queue;
+    stats.queue_peak = queue_peak;
+    stats.outbox_overflows = outbox_overflows;
+    stats.disconnects = disconnects;
+    stats.strangers_dropped = strangers_dropped;
+    stats.lock_us = lock_us;
+    stats.conns.swap(conns);
+    SDL_mutexV(stats_mutex);
+
+    queue_peak = 0;
+    stats_time = now;
+}
+
+void NetThread::getStats(NetStats *s)
+{
+    SDL_mutexP(stats_mutex);
+    *s = stats;
+    SDL_mutexV(stats_mutex);
+}
+
+/* A client that sends a lot shouldn't hold up everyone else's packets in the
+ * same batch, so the batch is handled in rounds: the first packet from each
+ * sender, then the second from each, and so on. Each sender's packets stay
+ * in the order they came in. */
+void NetThread::receiveBatch(UDPpacket **p, int n, Uint32 now)
+{
+    int round[NET_BATCH];
+    int last = 0;
+
+    n = min(n, NET_BATCH);
+    for( int i=0; i<n; i++ ) {
+        round[i] = 0;
+        for( int j=0; j<i; j++ ) {
+            if( p[j]->address.host == p[i]->address.host &&
+                p[j]->address.port == p[i]->address.port ) {
+                round[i]++;
+            }
+        }
+        last = max(last, round[i]);
+    }
+
+    for( int r=0; r<=last; r++ ) {
+        for( int i=0; i<n; i++ ) {
+            if( round[i] == r ) {
+                receive(p[i], now);
+            }
+        }
+    }
+}
+
+void NetThread::receive(UDPpacket *p, Uint32 now)
+{
+    playerInfo_t *pi = findConnection(p->address);
+    UDPpacket *early;
+
+    if( !pi ) {
+        /* only out of band packets make sense from a stranger */
+        if( !stranger_limit.take(1, now) ) {
+            strangers_dropped++;
+        } else if( Connection::stripHeader(p) == CHAN_OOB ) {
+            handlePacket(p);
+        }
+        return;
+    }
+
+    /* drop it before doing any work on it; if it was reliable, the client
+     * will send it again once they slow down */
+    if( !pi->in_limit.take(1, now) ) {
+        pi->conn->countDropped(true);
+        return;
+    }
+    if( pi->conn->receive(p, now) ) {
+        handlePacket(p);
+    }
+    while( (early = pi->conn->nextReady()) ) {
+        handlePacket(early);
+        pool->unref(early);
+    }
+}
+
+int NetThread::packetChannel(UDPpacket *p)
+{
+    switch( PACKET_TYPE(p) ) {
+        case PT_EVENT:
+            return event_channel[ PACKET_DATA(p)[0] ];
+        case PT_REG:
+        case PT_DETAILS:
+        case PT_ANNOUNCE:
+            return CHAN_OOB;
+        case PT_SNAPSHOT:
+        case PT_JOIN:
+            /* a lost snapshot is replaced by the next one */
+            return CHAN_UNRELIABLE;
+        default:
+            return CHAN_UNRELIABLE;
+    }
+}
+
+playerInfo_t *NetThread::findConnection(const IPaddress &a)
+{
+    playerInfo_t *ret = NULL;
+
+    SDL_mutexP(active_player_mutex);
+    for( int i=0; i<(int)active_players.size(); i++ ) {
+        if( active_players[i]->address.host == a.host &&
+            active_players[i]->address.port == a.port ) {
+            ret = active_players[i];
+            break;
+        }
+    }
+    SDL_mutexV(active_player_mutex);
+    return ret;
+}
+
+void NetThread::handleDisconnect(playerInfo_t *pi)
+{
+    SDL_mutexP(active_player_mutex);
+    active_players.erase( find(active_players.begin(), active_players.end(),
+                               pi) );
+    if( pi->watching != -1 ) {
+        vector<playerInfo_t*> &v = spectators[pi->watching];
+        v.erase( find(v.begin(), v.end(), pi) );
+    }
+    SDL_mutexV(active_player_mutex);
+
+    delete pi->conn;
+    delete pi;
 }
 
 UDPpacket *NetThread::createGenericPacket()
 {
-    UDPpacket *ret = SDLNet_AllocPacket(256);
-    ret->channel = -1;
-    ret->len = 10;
-    PACKET_RETRYNO(ret) = 0;
-    PACKET_TYPE(ret) = 0;
+    UDPpacket *ret = pool->get();
+    ret->channel = CHANNEL_ALL;
+    ret->len = PACKET_HEADER_LEN;
+    PACKET_VERSION(ret) = NET_PROTOCOL_VERSION;
+    PACKET_TYPE(ret) = PT_PING;
 
     SDL_mutexP(packet_id_mutex);
-    SDLNet_Write32( packet_id++, &ret->data[2] );
+    SDLNet_Write32( packet_id++, &PACKET_ID(ret) );
     SDL_mutexV(packet_id_mutex);
 
-    SDLNet_Write32( SDL_GetTicks(), &ret->data[6] );
+    SDLNet_Write32( SDL_GetTicks(), &PACKET_TIME(ret) );
 
     return ret;
 }
@@ -206,78 +658,365 @@ UDPpacket *NetThread::createPingPacket()
 UDPpacket *NetThread::createAckPacket(UDPpacket *orig)
 {
     UDPpacket *ret = createGenericPacket();
-    ret->len = 14;
-    PACKET_TYPE(ret) = 4;
-    SDLNet_Write32( PACKET_ID(orig), PACKET_DATA(ret) );
+    ret->channel = orig->channel;
+    ret->address = orig->address;
+    PACKET_TYPE(ret) = PT_ACK;
+    writeFields( ret, SDLNet_Read32(&PACKET_ID(orig)),
+                 SDLNet_Read32(&PACKET_TIME(orig)) );
     return ret;
 }
 
-UDPpacket *NetThread::createRegisterPacket( const string &name )
+UDPpacket *NetThread::createRegisterPacket( const string &name, int room,
+                                            int watch )
 {
     UDPpacket *ret = createGenericPacket();
-    ret->len = 178;
-    PACKET_TYPE(ret) = 5;
-    SDLNet_Write32(0, PACKET_DATA(ret));
-    PACKET_DATA(ret)[4] = (char)-1;
-    strncpy( (char*)&PACKET_DATA(ret)[5], name.c_str(), 16 );
-    PACKET_DATA(ret)[21] = '\0';
+    ret->channel = 0;
+    PACKET_TYPE(ret) = PT_REG;
+    writeFields( ret, -1, -1, name.substr(0, PLAYER_NAME_LEN).c_str(), room,
+                 watch );
     return ret;
 }
 
+/* req has already been checked by readFields */
+UDPpacket *NetThread::createRegisterReply(UDPpacket *req, int id)
+{
+    UDPpacket *ret = createGenericPacket();
+    WireArgs a;
+
+    readFields(req, &a);
+    ret->channel = -1;
+    ret->address = req->address;
+    PACKET_TYPE(ret) = PT_REG;
+    writeFields( ret, SDLNet_Read32(&PACKET_ID(req)), id,
+                 a.s[0].substr(0, PLAYER_NAME_LEN).c_str(), a.n[2], a.n[3] );
+    return ret;
+}
+
+void NetThread::writeFields(UDPpacket *p, ...)
+{
+    WireWriter out( PACKET_DATA(p), NET_PACKET_SIZE - PACKET_HEADER_LEN );
+    va_list ap;
+
+    va_start(ap, p);
+    out.vput( packet_format[PACKET_TYPE(p)], ap );
+    va_end(ap);
+    assert( !out.overflow() );
+    p->len = PACKET_HEADER_LEN + out.length();
+}
+
+int NetThread::readFields(const UDPpacket *p, WireArgs *args)
+{
+    if( p->len < PACKET_HEADER_LEN || PACKET_TYPE(p) > PT_JOIN ) {
+        return -1;
+    }
+
+    WireReader in( PACKET_DATA(p), p->len - PACKET_HEADER_LEN );
+    if( !in.get(packet_format[PACKET_TYPE(p)], args) ) {
+        return -1;
+    }
+    return in.position();
+}
+
 UDPpacket *NetThread::createEventPacket(enum NetEvent e, ...)
+{
+    va_list ap;
+    va_start(ap, e);
+    UDPpacket *ret = createEventPacket(e, ap);
+    va_end(ap);
+    return ret;
+}
+
+UDPpacket *NetThread::createEventPacket(enum NetEvent e, va_list ap)
 {
     UDPpacket *ret = createGenericPacket();
-    ret->len = 11;
-    PACKET_TYPE(ret) = 1;
-    PACKET_DATA(ret)[0] = e;
+
+    PACKET_TYPE(ret) = PT_EVENT;
+    ret->len = PACKET_HEADER_LEN + encodeEvent(PACKET_DATA(ret), e, ap);
     return ret;
 }
 
+/* write an event into data, which must have room for NET_EVENT_MAX bytes
+ * @return the number of bytes written */
+int NetThread::encodeEvent(Uint8 *data, enum NetEvent e, va_list ap)
+{
+    assert( e >= 0 && e < NET_EVENT_NUM );
+
+    WireWriter out(data, NET_EVENT_MAX);
+
+    out.byte(e);
+    out.vput(event_format[e], ap);
+    assert( !out.overflow() );
+    return out.length();
+}
+
 UDPpacket *NetThread::createDetailsPacket()
 {
     UDPpacket *ret = createGenericPacket();
-    ret->len = 10;
+    ret->channel = -1;
     PACKET_TYPE(ret) = PT_DETAILS;
     return ret;
 }
 
+void NetThread::sendEvent(enum NetEvent e, ...)
+{
+    va_list ap;
+    va_start(ap, e);
+    queueSend( createEventPacket(e, ap) );
+    va_end(ap);
+}
+
+void NetThread::sendEventTo(int channel, enum NetEvent e, ...)
+{
+    va_list ap;
+    va_start(ap, e);
+    UDPpacket *p = createEventPacket(e, ap);
+    va_end(ap);
+
+    p->channel = channel;
+    queueSend(p);
+}
+
+Outbox *NetThread::openOutbox()
+{
+    assert( !loop_thread );
+    Outbox *ret = new Outbox(NET_OUTBOX_SIZE);
+    outboxes.push_back(ret);
+    return ret;
+}
+
+EventBatch::EventBatch(NetThread *net, Outbox *outbox, int channel)
+{
+    this->net = net;
+    this->outbox = outbox;
+    this->channel = channel;
+    packet[0] = packet[1] = NULL;
+    queued = false;
+}
+
+EventBatch::~EventBatch()
+{
+    for( int i=0; i<2; i++ ) {
+        if( packet[i] ) net->pool->unref(packet[i]);
+    }
+}
+
+void EventBatch::add(enum NetThread::NetEvent e, ...)
+{
+    Uint8 buf[NET_EVENT_MAX];
+    int chan = event_channel[e];
+    va_list ap;
+
+    va_start(ap, e);
+    int len = NetThread::encodeEvent(buf, e, ap);
+    va_end(ap);
+
+    if( packet[chan] && packet[chan]->len + len > NET_PACKET_SIZE ) {
+        flushPacket(chan);
+    }
+    if( !packet[chan] ) {
+        packet[chan] = net->createGenericPacket();
+        packet[chan]->channel = channel;
+        PACKET_TYPE(packet[chan]) = NetThread::PT_EVENT;
+    }
+    memcpy( packet[chan]->data + packet[chan]->len, buf, len );
+    packet[chan]->len += len;
+}
+
+void EventBatch::addSnapshot(int channel, const Snapshot *s,
+                             const Snapshot *base, Uint32 input)
+{
+    UDPpacket *p = net->createGenericPacket();
+
+    p->channel = channel;
+    PACKET_TYPE(p) = NetThread::PT_SNAPSHOT;
+    NetThread::writeFields( p, s->id, base ? base->id : s->id, input );
+
+    int len = s->encode( base, p->data + p->len, NET_PACKET_SIZE - p->len );
+    if( len < 0 ) {
+        printWarning("snapshot %d doesn't fit in a packet\n", s->id);
+        net->pool->unref(p);
+        return;
+    }
+    p->len += len;
+    queue(p);
+}
+
+void EventBatch::addJoinState(int channel, Uint16 id, Uint32 input,
+                              const Uint8 *data, int len)
+{
+    int count = (len + JOIN_FRAGMENT_SIZE - 1) / JOIN_FRAGMENT_SIZE;
+
+    if( count > JOIN_MAX_FRAGMENTS ) {
+        printWarning("join state %d needs too many fragments\n", id);
+        return;
+    }
+    for( int f=0; f<count; f++ ) {
+        UDPpacket *p = net->createGenericPacket();
+        int n = min(JOIN_FRAGMENT_SIZE, len - f * JOIN_FRAGMENT_SIZE);
+
+        p->channel = channel;
+        PACKET_TYPE(p) = NetThread::PT_JOIN;
+        NetThread::writeFields( p, id, input, f, count );
+        memcpy( p->data + p->len, data + f * JOIN_FRAGMENT_SIZE, n );
+        p->len += n;
+        queue(p);
+    }
+}
+
+void EventBatch::flush()
+{
+    flushPacket(CHAN_UNRELIABLE);
+    flushPacket(CHAN_RELIABLE);
+    if( queued ) {
+        net->wake();
+        queued = false;
+    }
+}
+
+void EventBatch::flushPacket(int chan)
+{
+    UDPpacket *p = packet[chan];
+
+    if( p ) {
+        packet[chan] = NULL;
+        queue(p);
+    }
+}
+
+void EventBatch::queue(UDPpacket *p)
+{
+    queued = true;
+    if( !outbox->push(p) ) {
+        __sync_fetch_and_add(&net->outbox_overflows, 1);
+        net->queueSend(p);
+    }
+}
+
+int NetThread::decodeEvent(WireReader &in, WireArgs *args)
+{
+    Uint8 e = in.byte();
+
+    if( in.overflow() || e >= NET_EVENT_NUM ||
+        !in.get(event_format[e], args) ) {
+        return -1;
+    }
+    return e;
+}
+
+/* Check every event in the packet before handling any of them, so that a
+ * garbled packet is dropped as a whole. That means decoding them twice, but
+ * events are only a few bytes each. */
+void NetThread::handleEvents(UDPpacket *p)
+{
+    int max = p->len - PACKET_HEADER_LEN;
+    WireArgs args;
+
+    if( max < 1 ) {
+        printMsg(1, "dropping empty event packet\n");
+        return;
+    }
+
+    WireReader check( PACKET_DATA(p), max );
+    while( check.left() > 0 ) {
+        if( decodeEvent(check, &args) == -1 ) {
+            printMsg(1, "dropping malformed event packet\n");
+            return;
+        }
+    }
+
+    WireReader in( PACKET_DATA(p), max );
+    while( in.left() > 0 ) {
+        int e = decodeEvent(in, &args);
+        handleEvent(p, (enum NetEvent)e, args);
+    }
+}
+
 void NetThread::queueSend(UDPpacket *p)
 {
     SDL_mutexP(send_mutex);
-    send_queue.push(p);
+    send_queue.push_back(p);
     SDL_mutexV(send_mutex);
+    sock->wake();
 }
 
 void NetThread::handlePacket(UDPpacket *p)
 {
+    if( p->len < PACKET_HEADER_LEN ) {
+        printMsg(1, "dropping runt packet of length %d\n", p->len);
+        return;
+    }
+    if( PACKET_VERSION(p) != NET_PROTOCOL_VERSION ) {
+        printMsg(1, "dropping packet from protocol version %d (we speak "
+                    "%d)\n", PACKET_VERSION(p), NET_PROTOCOL_VERSION);
+        return;
+    }
+
     switch( PACKET_TYPE(p) ) {
         case PT_PING:
             handlePing(p);
             break;
-        case PT_EVENT0:
-        case PT_EVENT3:
-        case PT_EVENT5:
-            handleEvent(p);
-        case PT_REG:
-            handleRegister(p);
         case PT_ACK:
             handleAck(p);
+            break;
+        case PT_REG:
+            handleRegister(p);
+            break;
+        case PT_EVENT:
+            handleEvents(p);
+            break;
+        case PT_DETAILS:
+            handleDetails(p);
+            break;
+        case PT_SNAPSHOT:
+            handleSnapshot(p);
+            break;
+        case PT_ANNOUNCE:
+            handleAnnounce(p);
+            break;
+        case PT_JOIN:
+            handleJoin(p);
+            break;
+        default:
+            printMsg(1, "unknown packet type %d\n", PACKET_TYPE(p));
     }
 }
 
+/* Connection takes care of resending, so an ack is only the answer to a
+ * ping, which gives us a sample of the other clock */
 void NetThread::handleAck(UDPpacket *p)
 {
-    vector<UDPpacket*>::iterator i;
-    int id1, id2;
+    playerInfo_t *pi = findConnection(p->address);
+    WireArgs a;
 
-    id1 = SDLNet_Read32( &PACKET_ID(p) );
-    for( i=sent.begin(); i<sent.end(); i++) {
-        id2 = SDLNet_Read32( &PACKET_ID(p) );
-        if( id1 == id2 ) {
-            sent.erase(i);
-            break;
-        }
+    if( !pi || readFields(p, &a) == -1 ) {
+        return;
     }
+    pi->clock.sample( a.n[1], SDLNet_Read32(&PACKET_TIME(p)),
+                      SDL_GetTicks() );
 }
 
+Uint32 NetThread::packetTime(UDPpacket *p)
+{
+    playerInfo_t *pi = findConnection(p->address);
 
+    if( !pi || !pi->clock.synced() ) {
+        return SDL_GetTicks();
+    }
+    return pi->clock.toLocal( SDLNet_Read32(&PACKET_TIME(p)) );
+}
+
+void NetThread::handleDetails(UDPpacket*)
+{
+}
+
+void NetThread::handleSnapshot(UDPpacket*)
+{
+}
+
+void NetThread::handleAnnounce(UDPpacket*)
+{
+}
+
+void NetThread::handleJoin(UDPpacket*)
+{
+}
@@ -19,16 +19,116 @@
 #define NETWORKTHREAD_H
 
 #include "Gnumch.h"
-#include "MultiPlayerServer.h"
-#include "MultiPlayerClient.h"
+#include "NetSocket.h"
+#include "PacketPool.h"
+#include "SPSCQueue.h"
+#include "Connection.h"
+#include "Snapshot.h"
+#include "JoinState.h"
+#include "ClockSync.h"
+#include "Wire.h"
+#include "NetStats.h"
+#include "TokenBucket.h"
+#include "Event.h"
+#include <SDL_net.h>
 
 #define SERVER_PORT 7529
 
+/* Servers broadcast a summary of each room to this port every
+ * ANNOUNCE_INTERVAL ms, for ServerBrowser to pick up. */
+#define DISCOVERY_PORT (SERVER_PORT + 1)
+#define ANNOUNCE_INTERVAL 2000
+
+/* how many outgoing packets to allocate up front */
+#define NET_POOL_SIZE 256
+
+/* how many packets a game thread can queue before the network thread next
+ * wakes up */
+#define NET_OUTBOX_SIZE 1024
+
+/* The longest the network thread waits for packets before it checks its send
+ * queue. Queueing a packet wakes it straight away, except where NetSocket has
+ * to fall back to SDL_net. */
+#define NET_POLL_MS 10
+
+/* The most batches of packets that the network thread reads before it sends
+ * what is queued, so that a flood of packets can't hold up the sends. */
+#define NET_RECV_BATCHES 8
+
+/* A server takes up to NET_IN_RATE datagrams a second from each client, and
+ * up to NET_IN_BURST at once; the rest are dropped before they are looked at.
+ * Anyone who isn't connected shares NET_STRANGER_RATE and
+ * NET_STRANGER_BURST. */
+#define NET_IN_RATE 200
+#define NET_IN_BURST 100
+#define NET_STRANGER_RATE 500
+#define NET_STRANGER_BURST 100
+
+/* Details and announcement replies are much bigger than the requests for
+ * them, so a server sends each address up to NET_QUERY_RATE bytes a second
+ * of them, and up to NET_QUERY_BURST at once. Replies over that aren't
+ * sent. */
+#define NET_QUERY_RATE 2048
+#define NET_QUERY_BURST 16384
+
+/* A server sends each client up to NET_OUT_RATE bytes a second, and up to
+ * NET_OUT_BURST at once. Unreliable packets over that are dropped, and
+ * reliable ones wait in the connection. */
+#define NET_OUT_RATE (128 * 1024)
+#define NET_OUT_BURST (32 * 1024)
+
+/* a packet with this channel goes to every registered player. Channel -1
+ * means "use the packet's address", as in SDL_net. */
+#define CHANNEL_ALL -2
+
+/* a packet with this channel goes to every player in the given room */
+#define CHANNEL_ROOM(n) (CHANNEL_ALL - 1 - (n))
+
+/* the most rooms that one server can host; room numbers are sent as a byte */
+#define MAX_ROOMS 255
+
+/* a packet with this channel goes to the player with the given id in the
+ * given room. These come after all of the room channels. */
+#define CHANNEL_PLAYER(room, id) (CHANNEL_ROOM(MAX_ROOMS) - 1 - \
+                                  ((room) << 8) - (id))
+
+/* Spectators don't play and don't get events. They watch at one of these
+ * rates (see MultiPlayerServer::sendSnapshots), and a packet with this
+ * channel goes to everyone watching the given room at the given tier. These
+ * come after all of the player channels. */
+#define SPECTATOR_TIERS 4
+#define CHANNEL_SPECTATORS(room, tier) (CHANNEL_PLAYER(MAX_ROOMS, 0xff) - 1 - \
+                                        ((room) << 2) - (tier))
+
+/* the longest that one encoded event can be: a string and a few numbers */
+#define NET_EVENT_MAX 288
+
+/* the fields for each player in a details packet, after the ones in
+ * packet_format (see NetworkThread.cpp): id, name, score and lives */
+#define PLAYER_DETAILS_FORMAT "bsib"
+
+class MultiPlayerServer;
+class MultiPlayerClient;
+class RoomPool;
+class EventBatch;
+struct PlayerDetails;
+
+int netThreadLoop(void *net);
+int joinServerThread(void *cNetThread);
+
+typedef SPSCQueue<UDPpacket*> Outbox;
+
 typedef struct {
     int id;
-    int channel;
-    int clockskew;
+    int channel;    /* -1 if we send to address instead */
+    int room;
+    IPaddress address;
+    ClockSync clock;    /* their clock, from pings */
     string name;
+    Connection *conn;
+    int watching;   /* CHANNEL_SPECTATORS for a spectator, else -1 */
+    TokenBucket in_limit;   /* datagrams from them */
+    TokenBucket out_limit;  /* bytes to them */
 } playerInfo_t;
 
 class NetThread {
@@ -41,7 +141,12 @@ class NetThread {
             PLAYER_SPAWN,
             PLAYER_SCORE,
             GAME_NEXTLEVEL,
-            GAME_TROGWARN
+            GAME_TROGWARN,
+            GAME_TROGHIDE,
+            GAME_SETNUM,
+            PLAYER_KEY,
+            SNAPSHOT_ACK,
+            NET_EVENT_NUM
         };
 
         enum PacketType {
@@ -49,86 +154,282 @@ class NetThread {
             PT_ACK,
             PT_REG,
             PT_EVENT,
-            PT_DETAILS
+            PT_DETAILS,
+            PT_SNAPSHOT,
+            PT_ANNOUNCE,
+            PT_JOIN
         };
 
-        NetThread();
+        /** @param pool_size how many outgoing packets to allocate */
+        NetThread(int pool_size=NET_POOL_SIZE);
         virtual ~NetThread();
         virtual void start();
+        virtual void stop();
+
+        /** Send a NetEvent to every registered player. The arguments that
+         *  follow depend on the event; see event_format in NetworkThread.cpp.
+         *  This can be called from any thread. */
+        void sendEvent(enum NetEvent, ...);
+
+        /** Like sendEvent, but only to the players on the given channel,
+         *  which may be CHANNEL_ALL or CHANNEL_ROOM(n). */
+        void sendEventTo(int channel, enum NetEvent, ...);
+
+        /** Make a queue for one thread's outgoing events. Only that thread
+         *  may send through it (with an EventBatch), and the network thread
+         *  reads it without locking. Outboxes must be opened before
+         *  start(). */
+        Outbox *openOutbox();
+
+        /** Have the network thread send what is queued now. */
+        void wake() {sock->wake();}
+
+        /** Read the fields of a packet that come after the header, as given
+         *  by its type (see packet_format in NetworkThread.cpp).
+         *  @return the offset from PACKET_DATA(p) of whatever follows them,
+         *          or -1 if they are garbled. */
+        static int readFields(const UDPpacket *p, WireArgs *args);
+
+        /** Get a copy of the latest stats (see NetStats.h), which the
+         *  network thread updates every NET_STATS_INTERVAL. This can be
+         *  called from any thread. */
+        void getStats(NetStats*);
+
+        /** Pass everything this thread sends and receives through e, which
+         *  it then owns. Call this before start(). */
+        void emulate(NetEmulator *e) {sock->setEmulator(e);}
 
     protected:
-        UDPsocket sock;
-        queue<UDPpacket*> send_queue;
+        NetSocket *sock;
+        PacketPool *pool;
+        vector<UDPpacket*> send_queue;
+        vector<UDPpacket*> sending;  // swapped with send_queue to send
         SDL_mutex *send_mutex;
-        vector<UDPpacket*> sent; // sent but unAcked/unReplied packets
+        vector<Outbox*> outboxes;
+        int outbox_overflows;
         int packet_id;           // the id number of the next packet to send
         SDL_mutex *packet_id_mutex;
 
         vector<playerInfo_t*> active_players;
         SDL_mutex *active_player_mutex;
+        /* the spectators among active_players, by their watching channel */
+        map<int, vector<playerInfo_t*> > spectators;
 
         UDPpacket *createPingPacket();
         UDPpacket *createAckPacket(UDPpacket*);
-        UDPpacket *createRegisterPacket(const string &name);
+        /* watch is 0 to play, or a spectator's rate tier plus one */
+        UDPpacket *createRegisterPacket(const string &name, int room=0,
+                                        int watch=0);
+        UDPpacket *createRegisterReply(UDPpacket*, int id);
         UDPpacket *createEventPacket(enum NetEvent, ...);
+        UDPpacket *createEventPacket(enum NetEvent, va_list);
+        static int encodeEvent(Uint8 *data, enum NetEvent, va_list);
+        /* write the fields for the packet's type and set its length; the
+         * arguments are as for WireWriter::put */
+        static void writeFields(UDPpacket*, ...);
         UDPpacket *createDetailsPacket();
         UDPpacket *createGenericPacket();
 
         virtual void handlePacket(UDPpacket*);
-        virtual void handleEvent(UDPpacket*) = 0;
+        void handleEvents(UDPpacket*);
+        /* handle one event from packet p, with the arguments in
+         * event_format */
+        virtual void handleEvent(UDPpacket *p, enum NetEvent,
+                                 const WireArgs&) = 0;
         virtual void handlePing(UDPpacket*) = 0;
         virtual void handleAck(UDPpacket*);
+        /* the time that the packet was made, by our clock */
+        Uint32 packetTime(UDPpacket*);
         virtual void handleRegister(UDPpacket*) = 0;
+        virtual void handleDetails(UDPpacket*);
+        virtual void handleSnapshot(UDPpacket*);
+        virtual void handleAnnounce(UDPpacket*);
+        virtual void handleJoin(UDPpacket*);
         void queueSend(UDPpacket*);
+        void flushSendQueue();
+
+        /* work out the rates in stats since the last time */
+        void updateStats(Uint32 now);
+
+        /* called each time round the network thread's loop, for anything
+         * that has to happen every so often */
+        virtual void periodic(Uint32) {}
+
+        /* the reliability layer; see Connection.h */
+        void receive(UDPpacket*, Uint32 now);
+        /* receive a batch of packets, taking one from each sender in turn */
+        void receiveBatch(UDPpacket **p, int n, Uint32 now);
+        void transmit(UDPpacket*, const IPaddress*, playerInfo_t*, Uint32 now);
+        void serviceConnections(Uint32 now);
+        static int packetChannel(UDPpacket*);
+
+        /* send one datagram on pi's connection, and count it against
+         * pi's out_limit */
+        void sendOn(playerInfo_t *pi, const Uint8 *header, UDPpacket *p,
+                    const IPaddress *to, Uint32 now);
+
+        /* the player with the given address, or NULL */
+        virtual playerInfo_t *findConnection(const IPaddress&);
+
+        /* called when a player stops acking our packets. This deletes pi. */
+        virtual void handleDisconnect(playerInfo_t *pi);
+
+        /* read the next event according to event_format
+         * @return its type, or -1 if it is garbled */
+        static int decodeEvent(WireReader&, WireArgs*);
 
         virtual void cancelThreads();
+
+        /* statistics; everything but stats is only touched by the network
+         * thread */
+        NetStats stats;
+        SDL_mutex *stats_mutex;
+        Uint32 stats_time;
+        int queue_peak;
+        int last_queue;
+        Uint64 lock_us;
+        Uint32 disconnects;
+        TokenBucket stranger_limit;     /* see NET_STRANGER_RATE */
+        Uint32 strangers_dropped;
+
         SDL_Thread *loop_thread;
+        volatile bool quit;
         friend int netThreadLoop(void *net);
+        friend class EventBatch;
+};
+
+/* Collects the events that one thread sends during a tick and packs them
+ * into as few packets as possible, which go out when flush() is called.
+ * Reliable and unreliable events can't share a packet, so there is one
+ * packet on the go for each. */
+class EventBatch {
+    public:
+        EventBatch(NetThread*, Outbox*, int channel);
+        ~EventBatch();
+
+        /** Add an event; the arguments are as for NetThread::sendEvent. */
+        void add(enum NetThread::NetEvent, ...);
+
+        /** Send a snapshot on its own packet, encoded against base (which
+         *  may be NULL). The channel is usually CHANNEL_PLAYER, since each
+         *  player has acked a different base. input is the last key from
+         *  that player that the snapshot takes into account. */
+        void addSnapshot(int channel, const Snapshot *s, const Snapshot *base,
+                         Uint32 input);
+
+        /** Send an encoded JoinState, split into as many packets as it
+         *  takes. id is the id of its snapshot and input is as for
+         *  addSnapshot. */
+        void addJoinState(int channel, Uint16 id, Uint32 input,
+                          const Uint8 *data, int len);
+
+        /** Queue everything that has been added, and wake the network
+         *  thread. */
+        void flush();
+
+    private:
+        void flushPacket(int chan);
+        void queue(UDPpacket*);
+
+        NetThread *net;
+        Outbox *outbox;
+        int channel;
+        UDPpacket *packet[2];   /* indexed by CHAN_UNRELIABLE, CHAN_RELIABLE */
+        bool queued;            /* whether the network thread needs waking */
 };
 
 class ClientNetThread: public NetThread {
     public:
-        ClientNetThread();
+        ClientNetThread(MultiPlayerClient*);
         virtual ~ClientNetThread();
 
-        virtual void findServers();
         virtual void joinServer(IPaddress *a);
+
+        /** Send a key press to the server, numbered by a Predictor. */
+        void sendKey(enum Key key, Uint32 seq);
         virtual void cancelThreads();
 
     private:
-        virtual void handleEvent(UDPpacket*);
+        virtual void handleEvent(UDPpacket*, enum NetEvent, const WireArgs&);
         virtual void handlePing(UDPpacket*);
         virtual void handleRegister(UDPpacket*);
+        virtual void handleSnapshot(UDPpacket*);
+        virtual void handleJoin(UDPpacket*);
+        virtual void handleDisconnect(playerInfo_t*);
 
-        friend int findServersThread(void *cNetThread);
         friend int joinServerThread(void *cNetThread);
 
-        SDL_Thread *find_servers;
         SDL_Thread *join_servers;
         MultiPlayerClient *mpgame;
+
+        SnapshotHistory snapshots;  /* the ones we have acked */
+        JoinAssembler joining;
 };
 
+/* Receives for all the rooms on a server and routes each packet to the room
+ * of the player that sent it. Players are told apart by their address. */
 class ServerNetThread: public NetThread {
     public:
-        ServerNetThread();
+        ServerNetThread(RoomPool*, int port=SERVER_PORT);
         virtual ~ServerNetThread();
 
+        /** Whether to broadcast the rooms to the local network (the
+         *  default). Servers answer ServerBrowser's queries either way. */
+        void setAnnounce(bool a) {announce = a;}
+
     private:
-        virtual void handleEvent(UDPpacket*);
+        virtual void handleEvent(UDPpacket*, enum NetEvent, const WireArgs&);
         virtual void handlePing(UDPpacket*);
         virtual void handleRegister(UDPpacket*);
+        virtual void handleDetails(UDPpacket*);
+        virtual void handleAnnounce(UDPpacket*);
+        virtual void handleDisconnect(playerInfo_t*);
+        virtual void periodic(Uint32 now);
 
-        MultiPlayerServer *mpgame;
-};
+        /* a details or announce packet with the summary of one room,
+         * which fills in details with its players */
+        UDPpacket *createSummaryPacket(int room, enum PacketType,
+                                       vector<PlayerDetails> *details);
+
+        /* start a session with the client that sent register packet p */
+        playerInfo_t *addSession(UDPpacket *p, const string &name, int id,
+                                 int room, int watching);
 
-extern SDL_mutex *game_mutex;
+        /* whether a len byte reply to a query from a may be sent */
+        bool allowReply(const IPaddress &a, int len, Uint32 now);
 
-#define PACKET_RETRYNO(p) (p->data[0])
+        /* the player registered from the given address, or NULL */
+        playerInfo_t *findPlayer(const IPaddress&);
+        virtual playerInfo_t *findConnection(const IPaddress &a)
+            {return findPlayer(a);}
+
+        typedef pair<Uint32, Uint16> addr_key;
+        map<addr_key, playerInfo_t*> sessions;
+
+        /* see NET_QUERY_RATE; keyed by host, so that changing ports
+         * doesn't get anyone a fresh bucket */
+        typedef struct {
+            TokenBucket limit;
+            Uint32 last;        /* when they last asked */
+        } QuerySource;
+        map<Uint32, QuerySource> query_sources;
+        Uint32 last_prune;
+
+        RoomPool *rooms;
+        int next_spectator;     /* spectator ids just tell them apart */
+        bool announce;
+        IPaddress broadcast;
+        Uint32 last_announce;
+};
+
+#define PACKET_VERSION(p) (p->data[0])
 #define PACKET_TYPE(p) (p->data[1])
 #define PACKET_ID(p) (p->data[2])
 #define PACKET_TIME(p) (p->data[6])
 #define PACKET_DATA(p) (&p->data[10])
 
+#define PACKET_HEADER_LEN 10
+
 #define SERVER_NAME_LEN 16
 #define PLAYER_NAME_LEN 16
 
@@ -0,0 +1,120 @@
+/*
+ *  Copyright (C) 2005 Joe Neeman <spuzzzzzzz@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#include "PacketPool.h"
+
+/* The UDPpacket must come first, so that a UDPpacket* from get() can be
+ * turned back into its PooledPacket. */
+struct PooledPacket {
+    UDPpacket packet;
+    int refs;
+    Uint8 *buf;
+};
+
+PacketPool::PacketPool(int size, int packet_size)
+{
+    this->size = 0;
+    this->packet_size = packet_size;
+    in_use = peak_in_use = overflows = 0;
+    mutex = SDL_CreateMutex();
+
+    all.reserve(size);
+    free_list.reserve(size);
+    for (int i=0; i<size; i++) {
+        free_list.push_back( make() );
+    }
+}
+
+PacketPool::~PacketPool()
+{
+    if (in_use) {
+        printWarning("%d pooled packets still in use\n", in_use);
+    }
+    for (int i=0; i<(int)all.size(); i++) {
+        delete[] all[i]->buf;
+        delete all[i];
+    }
+    SDL_DestroyMutex(mutex);
+}
+
+UDPpacket *PacketPool::get()
+{
+    PooledPacket *p;
+
+    SDL_mutexP(mutex);
+    if (free_list.empty()) {
+        overflows++;
+        p = make();
+    } else {
+        p = free_list.back();
+        free_list.pop_back();
+    }
+    p->refs = 1;
+    if (++in_use > peak_in_use) {
+        peak_in_use = in_use;
+    }
+    SDL_mutexV(mutex);
+
+    p->packet.channel = -1;
+    p->packet.len = 0;
+    p->packet.status = 0;
+    return &p->packet;
+}
+
+void PacketPool::ref(UDPpacket *packet)
+{
+    PooledPacket *p = (PooledPacket*)packet;
+
+    SDL_mutexP(mutex);
+    assert(p->refs > 0);
+    p->refs++;
+    SDL_mutexV(mutex);
+}
+
+void PacketPool::unref(UDPpacket *packet)
+{
+    PooledPacket *p = (PooledPacket*)packet;
+
+    SDL_mutexP(mutex);
+    assert(p->refs > 0);
+    if (--p->refs == 0) {
+        free_list.push_back(p);
+        in_use--;
+    }
+    SDL_mutexV(mutex);
+}
+
+/*_________________________________private___________________________________*/
+
+/* called with the mutex held, or from the constructor */
+PooledPacket *PacketPool::make()
+{
+    PooledPacket *p = new PooledPacket;
+
+    p->buf = new Uint8[packet_size];
+    memset( &p->packet, 0, sizeof(p->packet) );
+    p->packet.data = p->buf;
+    p->packet.maxlen = packet_size;
+    p->refs = 0;
+
+    all.push_back(p);
+    size++;
+    if (free_list.capacity() < (size_t)size) {
+        free_list.reserve(size * 2);
+    }
+    return p;
+}
@@ -0,0 +1,62 @@
+/*
+ *  Copyright (C) 2005 Joe Neeman <spuzzzzzzz@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#ifndef PACKETPOOL_H
+#define PACKETPOOL_H
+
+#include "Gnumch.h"
+#include <SDL_net.h>
+
+struct PooledPacket;
+
+/* A free list of packets that all have buffers of the same size, so that
+ * sending doesn't have to allocate. Each packet carries a reference count:
+ * get() hands one out with a count of 1, and it goes back on the free list
+ * when the last unref() drops the count to 0.
+ *
+ * Packets from the pool must never be given to SDLNet_FreePacket. */
+class PacketPool {
+    public:
+        /** Make size packets of packet_size bytes up front. If they are
+         *  all in use, get() makes more and counts an overflow. */
+        PacketPool(int size, int packet_size);
+        ~PacketPool();
+
+        UDPpacket *get();
+        void       ref(UDPpacket*);
+        void       unref(UDPpacket*);
+
+        /* occupancy counters */
+        int        getSize()      {return size;}
+        int        getInUse()     {return in_use;}
+        int        getPeakInUse() {return peak_in_use;}
+        int        getOverflows() {return overflows;}
+
+    private:
+        PooledPacket *make();
+
+        SDL_mutex *mutex;
+        vector<PooledPacket*> free_list;
+        vector<PooledPacket*> all;
+        int packet_size;
+        int size;
+        int in_use;
+        int peak_in_use;
+        int overflows;
+};
+
+#endif
@@ -18,8 +18,9 @@
 #include <Player.h>
 #include <Game.h>
 #include <Animation.h>
+#include <BitStream.h>
 
-extern Game *game;
+extern __thread Game *game;
 
 Player::Player ():
     anim(NULL)
@@ -125,6 +126,64 @@ bool Player::isIdle()
     return exists && !(moving || appearing || disappearing);
 }
 
+/* A player that isn't on the board is a single 0 bit. Otherwise its
+ * position is saved with the old one, since it may be half way between
+ * them. */
+void Player::save(BitWriter &out, int now)
+{
+    out.write(exists != 0, 1);
+    if(!exists) {
+        return;
+    }
+    out.writeSigned(x);
+    out.writeSigned(y);
+    out.writeSigned(old_x);
+    out.writeSigned(old_y);
+    out.write(moving, 1);
+    out.write(appearing, 1);
+    out.write(disappearing, 1);
+    out.writeSigned(action_start - now);
+    anim.save(out, now);
+}
+
+/* old_x and old_y may be just off the board, where troggles walk on from */
+bool Player::load(BitReader &in, int now)
+{
+    int w = game->getWidth();
+    int h = game->getHeight();
+
+    if(!in.read(1)) {
+        exists = 0;
+        moving = appearing = disappearing = false;
+        return !in.overflow();
+    }
+
+    int new_x = in.readSigned();
+    int new_y = in.readSigned();
+    int new_old_x = in.readSigned();
+    int new_old_y = in.readSigned();
+    bool new_moving = in.read(1);
+    bool new_appearing = in.read(1);
+    bool new_disappearing = in.read(1);
+    int new_start = now + in.readSigned();
+
+    if(in.overflow() || new_x < 0 || new_x >= w || new_y < 0 || new_y >= h
+       || new_old_x < -1 || new_old_x > w || new_old_y < -1 || new_old_y > h
+       || !anim.load(in, now)) {
+        return false;
+    }
+    x = new_x;
+    y = new_y;
+    old_x = new_old_x;
+    old_y = new_old_y;
+    moving = new_moving;
+    appearing = new_appearing;
+    disappearing = new_disappearing;
+    action_start = new_start;
+    exists = 1;
+    return true;
+}
+
 void Player::delay(int delay)
 {
     action_start += delay;
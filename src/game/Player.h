@@ -21,6 +21,9 @@
 #include <Gnumch.h>
 #include <Animation.h>
 
+class BitWriter;
+class BitReader;
+
 class Player {
     public:
         Player();
@@ -41,14 +44,25 @@ class Player {
         virtual bool isMuncher() = 0;
         virtual bool isTroggle() = 0;
 
+        // write what the player is doing for a saved game, with the times
+        // relative to now, and put it back. load() returns false if the
+        // data is garbled.
+        virtual void save(BitWriter&, int now);
+        virtual bool load(BitReader&, int now);
+
         virtual void delay(int delay);
         bool isAt(int, int);
         bool isNear(int, int);
         bool isIdle();
         Point        getPos();
+        Point        getOldPos() {return Point(old_x, old_y);}
+        bool         isMoving() {return moving;}
+        AnimationType      getAnimState() {return anim.getState();}
+        AnimationDirection getDir() {return anim.getDir();}
         SDL_Surface  *getPic(int, int, int, int, SDL_Rect*, SDL_Rect*);
         SDL_Surface  *getWholePic(int w, int h, SDL_Rect*);
         bool         exist();
+        bool         dying() {return disappearing;}
 
     protected:
         int x, y;           // current position
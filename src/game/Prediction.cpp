@@ -0,0 +1,62 @@
+/*
+ *  Copyright (C) 2005 Joe Neeman <spuzzzzzzz@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#include "Prediction.h"
+#include "Muncher.h"
+
+Predictor::Predictor(int id)
+{
+    this->id = id;
+    next_seq = 1;
+}
+
+Uint32 Predictor::press(enum Key key)
+{
+    PendingInput in = {next_seq++, key};
+
+    if( inputs.size() >= PREDICT_MAX_INPUTS ) {
+        inputs.pop_front();
+    }
+    inputs.push_back(in);
+    return in.seq;
+}
+
+bool Predictor::reconcile(const Snapshot &s, Uint32 acked, int unapplied,
+                          int w, int h, Point *pos)
+{
+    while( !inputs.empty() && (Sint32)(inputs.front().seq - acked) <= 0 ) {
+        inputs.pop_front();
+    }
+
+    if( id < 0 || id >= (int)s.players.size() || !s.players[id].exist ) {
+        return false;
+    }
+
+    /* the keys the muncher hasn't acted on will move it from wherever we
+     * put it, so they aren't replayed */
+    int replay = inputs.size() - unapplied;
+    Point to(0, 0);
+
+    pos->x = s.players[id].x;
+    pos->y = s.players[id].y;
+    for( int i=0; i<replay; i++ ) {
+        if( Muncher::keyMove(inputs[i].key, pos->x, pos->y, w, h, &to) ) {
+            *pos = to;
+        }
+    }
+    return true;
+}
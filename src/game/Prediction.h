@@ -0,0 +1,72 @@
+/*
+ *  Copyright (C) 2005 Joe Neeman <spuzzzzzzz@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#ifndef PREDICTION_H
+#define PREDICTION_H
+
+#include "Gnumch.h"
+#include "Event.h"
+#include "Snapshot.h"
+
+/* the most keys we remember that the server hasn't handled yet. If it falls
+ * this far behind, it has probably lost some of them. */
+#define PREDICT_MAX_INPUTS 64
+
+typedef struct {
+    Uint32 seq;
+    enum Key key;
+} PendingInput;
+
+/* Lets a network client move its own muncher as soon as a key is pressed,
+ * rather than a round trip later. Each key is numbered and sent to the
+ * server, and also given straight to the local Muncher. Each snapshot says
+ * the number of the last key the server handled, so when one arrives we
+ * start from the server's muncher and replay the keys it hadn't got to. If
+ * that doesn't put the muncher where we did, the local one is moved. */
+class Predictor {
+    public:
+        /** @param id the player id of the local muncher */
+        Predictor(int id);
+
+        /** Remember a key before it is sent to the server.
+         *  @return the sequence number to send with it. */
+        Uint32  press(enum Key);
+
+        /** Work out where the local muncher should be.
+         *  @param s The newest snapshot from the server.
+         *  @param acked The last key the server had handled when it took s.
+         *  @param unapplied The number of keys that the local muncher
+         *                   hasn't acted on yet (Muncher::queued()).
+         *  @param w,h The size of the board.
+         *  @param pos Set to where the muncher should be once it has acted
+         *             on the rest of the keys.
+         *  @return false if the muncher isn't on the board. */
+        bool    reconcile(const Snapshot &s, Uint32 acked, int unapplied,
+                          int w, int h, Point *pos);
+
+        /** Forget all the keys, when the muncher dies or the level ends. */
+        void    reset() {inputs.clear();}
+
+        int     pending() {return inputs.size();}
+
+    private:
+        int id;
+        Uint32 next_seq;
+        deque<PendingInput> inputs;
+};
+
+#endif
@@ -18,6 +18,7 @@
 #include <PrimeLevel.h>
 #include <FileSys.h>
 #include <ConfigFile.h>
+#include <BitStream.h>
 
 #define MIN_LEVEL 3
 #define MAX_LEVEL 200
@@ -92,6 +93,26 @@ void PrimeLevel::nextLevel()
     sprintf(&title, _("Primes less than %d"), curlevel+1);
 }
 
+void PrimeLevel::save(BitWriter &out)
+{
+    ListedNumberLevel::save(out);
+    out.writeGamma(max_listed);
+}
+
+bool PrimeLevel::load(BitReader &in)
+{
+    if (!ListedNumberLevel::load(in)) {
+        return false;
+    }
+    /* every number below max_listed is in one list or the other */
+    Uint32 listed = in.readGamma();
+    if (in.overflow() || listed != good_num.size() + bad_num.size() + 1) {
+        return false;
+    }
+    max_listed = listed;
+    return true;
+}
+
 bool PrimeLevel::isPrime(int n)
 {
     int max = (int)sqrt((float)n) + 1;
@@ -43,6 +43,9 @@ class PrimeLevel: public ListedNumberLevel {
         virtual const char *getError(const Number *num);
         virtual void nextLevel();
 
+        virtual void save(BitWriter&);
+        virtual bool load(BitReader&);
+
     protected:
         int max_listed;
 
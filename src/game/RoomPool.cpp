@@ -0,0 +1,136 @@
+/*
+ *  Copyright (C) 2005 Joe Neeman <spuzzzzzzz@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#include "RoomPool.h"
+#include "MultiPlayerServer.h"
+
+extern __thread Game *game;
+
+RoomPool::RoomPool(int workers)
+{
+    num_workers = max(workers, 1);
+    quit = false;
+    stats_mutex = SDL_CreateMutex();
+    memset(&recent, 0, sizeof(recent));
+    memset(&total, 0, sizeof(total));
+}
+
+RoomPool::~RoomPool()
+{
+    stop();
+    SDL_DestroyMutex(stats_mutex);
+}
+
+void RoomPool::addRoom(MultiPlayerServer *room)
+{
+    assert(workers.empty());
+    rooms.push_back(room);
+}
+
+void RoomPool::start()
+{
+    int n = min(num_workers, (int)rooms.size());
+
+    quit = false;
+    for (int i=0; i<n; i++) {
+        Worker *w = new Worker;
+        w->pool = this;
+        for (int j=i; j<(int)rooms.size(); j += n) {
+            w->rooms.push_back(rooms[j]);
+        }
+        w->thread = SDL_CreateThread(roomWorkerLoop, w);
+        workers.push_back(w);
+    }
+    printMsg(1, "running %d rooms on %d threads\n", (int)rooms.size(), n);
+}
+
+void RoomPool::stop()
+{
+    quit = true;
+    for (int i=0; i<(int)workers.size(); i++) {
+        SDL_WaitThread(workers[i]->thread, NULL);
+        delete workers[i];
+    }
+    workers.clear();
+}
+
+void RoomPool::takeTickStats(TickStats *stats)
+{
+    SDL_mutexP(stats_mutex);
+    *stats = recent;
+    memset(&recent, 0, sizeof(recent));
+    SDL_mutexV(stats_mutex);
+}
+
+void RoomPool::getTickTotals(TickStats *stats)
+{
+    SDL_mutexP(stats_mutex);
+    *stats = total;
+    SDL_mutexV(stats_mutex);
+}
+
+/* Tick each of the worker's rooms at its own rate (see TickScheduler), and
+ * sleep until the next one is due. */
+int roomWorkerLoop(void *worker)
+{
+    RoomPool::Worker *w = (RoomPool::Worker*)worker;
+    int n = w->rooms.size();
+    vector<TickScheduler> sched;
+    vector<bool> over(n, false);
+    Uint64 now = microseconds();
+
+    for (int i=0; i<n; i++) {
+        sched.push_back( TickScheduler(w->rooms[i]->getTickRate()) );
+        sched[i].start(now);
+    }
+
+    while (!w->pool->quit) {
+        now = microseconds();
+        for (int i=0; i<n; i++) {
+            if (over[i] || sched[i].untilDue(now) > 0) {
+                continue;
+            }
+
+            TickStats one;
+            Uint64 start = microseconds();
+
+            memset(&one, 0, sizeof(one));
+            game = w->rooms[i];
+            over[i] = !w->rooms[i]->tick();
+            sched[i].ticked(start, microseconds(), &one);
+
+            SDL_mutexP(w->pool->stats_mutex);
+            addTickStats(&w->pool->recent, one);
+            addTickStats(&w->pool->total, one);
+            SDL_mutexV(w->pool->stats_mutex);
+        }
+        game = NULL;
+
+        /* SDL_Delay only does milliseconds, so round up rather than spin */
+        Sint64 wait = 1000000;
+        now = microseconds();
+        for (int i=0; i<n; i++) {
+            if (!over[i]) {
+                wait = min(wait, sched[i].untilDue(now));
+            }
+        }
+        if (wait > 0) {
+            SDL_Delay((wait + 999) / 1000);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,73 @@
+/*
+ *  Copyright (C) 2005 Joe Neeman <spuzzzzzzz@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#ifndef ROOMPOOL_H
+#define ROOMPOOL_H
+
+#include "Gnumch.h"
+#include "TickScheduler.h"
+
+class MultiPlayerServer;
+
+int roomWorkerLoop(void *worker);
+
+/* Runs the rooms of a server on a fixed number of worker threads. Each room
+ * belongs to one worker (room i goes to worker i % workers), so a room is
+ * only ever touched by one thread and the rooms don't need to share locks. */
+class RoomPool {
+    public:
+        RoomPool(int workers);
+        ~RoomPool();
+
+        /** Add a room. This must be done before start(), and the room must
+         *  already have had begin() called. The pool doesn't delete it. */
+        void addRoom(MultiPlayerServer*);
+
+        void start();
+        void stop();
+
+        int getNumRooms() {return rooms.size();}
+        MultiPlayerServer *getRoom(int n) {return rooms.at(n);}
+
+        /** Collect the tick timings of all the rooms since the last call.
+         *  This can be called from any thread. */
+        void takeTickStats(TickStats*);
+
+        /** The tick timings of all the rooms since start(). This can be
+         *  called from any thread, and doesn't reset anything. */
+        void getTickTotals(TickStats*);
+
+    private:
+        typedef struct {
+            RoomPool *pool;
+            SDL_Thread *thread;
+            vector<MultiPlayerServer*> rooms;
+        } Worker;
+
+        vector<MultiPlayerServer*> rooms;
+        vector<Worker*> workers;
+        int num_workers;
+        volatile bool quit;
+
+        SDL_mutex *stats_mutex;
+        TickStats recent;       /* since takeTickStats() */
+        TickStats total;
+
+        friend int roomWorkerLoop(void *worker);
+};
+
+#endif
@@ -0,0 +1,101 @@
+/*
+ *  Copyright (C) 2005 Joe Neeman <spuzzzzzzz@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#ifndef SPSCQUEUE_H
+#define SPSCQUEUE_H
+
+/* A bounded ring buffer for passing things from exactly one thread to exactly
+ * one other without locking. Only the producer may call push() and only the
+ * consumer may call pop(); either may call empty().
+ *
+ * The producer only writes head and the consumer only writes tail, so the
+ * only ordering we need is that a slot is written before head moves past it
+ * and read before tail does. */
+template <class T>
+class SPSCQueue {
+    public:
+        /** Make a queue that holds at least size things. */
+        SPSCQueue(int size);
+        ~SPSCQueue();
+
+        /** @return false, without blocking, if the queue is full. */
+        bool push(const T &item);
+
+        /** @return false, without blocking, if the queue is empty. */
+        bool pop(T *item);
+
+        bool empty() {return head == tail;}
+        int  getSize() {return mask + 1;}
+
+    private:
+        T *ring;
+        unsigned int mask;
+
+        /* keep the two ends on different cache lines */
+        volatile unsigned int head;     /* the next slot to write */
+        char pad[64];
+        volatile unsigned int tail;     /* the next slot to read */
+};
+
+template <class T>
+SPSCQueue<T>::SPSCQueue(int size)
+{
+    unsigned int n = 1;
+    while (n < (unsigned int)size) {
+        n <<= 1;
+    }
+    ring = new T[n];
+    mask = n - 1;
+    head = tail = 0;
+}
+
+template <class T>
+SPSCQueue<T>::~SPSCQueue()
+{
+    delete[] ring;
+}
+
+template <class T>
+bool SPSCQueue<T>::push(const T &item)
+{
+    unsigned int h = head;
+
+    if (h - tail > mask) {
+        return false;
+    }
+    ring[h & mask] = item;
+    __sync_synchronize();
+    head = h + 1;
+    return true;
+}
+
+template <class T>
+bool SPSCQueue<T>::pop(T *item)
+{
+    unsigned int t = tail;
+
+    if (head == t) {
+        return false;
+    }
+    __sync_synchronize();
+    *item = ring[t & mask];
+    __sync_synchronize();
+    tail = t + 1;
+    return true;
+}
+
+#endif
@@ -0,0 +1,134 @@
+/*
+ *  Copyright (C) 2005 Joe Neeman <spuzzzzzzz@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#include "ServerBrowser.h"
+
+/* the browser only sends the odd query, so it needs few packets */
+#define BROWSER_POOL_SIZE 16
+
+ServerBrowser::ServerBrowser():
+    NetThread(BROWSER_POOL_SIZE)
+{
+    /* other browsers on this machine need to hear the announcements too */
+    sock = new NetSocket(DISCOVERY_PORT, true);
+    if( !sock->ok() ) {
+        printMsg(1, "can't listen for servers on port %d; only servers that "
+                    "answer a query will be found\n", DISCOVERY_PORT);
+        delete sock;
+        sock = new NetSocket(0);
+    }
+    batch = SDLNet_AllocPacketV(NET_BATCH, NET_PREFIX_MAX + NET_PACKET_SIZE);
+    SDLNet_ResolveHost(&broadcast, "255.255.255.255", SERVER_PORT);
+}
+
+ServerBrowser::~ServerBrowser()
+{
+    for( int i=0; i<(int)servers.size(); i++ ) {
+        delete servers[i];
+    }
+    SDLNet_FreePacketV(batch);
+}
+
+void ServerBrowser::query()
+{
+    UDPpacket *p = createGenericPacket();
+
+    PACKET_TYPE(p) = PT_ANNOUNCE;
+    p->channel = -1;
+    p->address = broadcast;
+    queueSend(p);
+    flushSendQueue();
+}
+
+void ServerBrowser::update(Uint32 now)
+{
+    int got;
+
+    while( (got = sock->recv(batch, NET_BATCH)) > 0 ) {
+        for( int i=0; i<got; i++ ) {
+            receive(batch[i], now);
+        }
+    }
+
+    for( int i=0; i<(int)servers.size(); ) {
+        if( now - servers[i]->seen > SERVER_CACHE_AGE ) {
+            delete servers[i];
+            servers.erase(servers.begin() + i);
+        } else {
+            i++;
+        }
+    }
+}
+
+void ServerBrowser::requestDetails(const ServerDetails *s)
+{
+    UDPpacket *p = createDetailsPacket();
+
+    p->address = s->address;
+    asked[addr_key(s->address.host, s->address.port)] = SDL_GetTicks();
+    queueSend(p);
+    flushSendQueue();
+}
+
+void ServerBrowser::handleAnnounce(UDPpacket *p)
+{
+    if( readFields(p, NULL) == -1 ) {
+        return;
+    }
+    merge( new ServerDetails(p) );
+}
+
+void ServerBrowser::handleDetails(UDPpacket *p)
+{
+    if( readFields(p, NULL) == -1 ) {
+        return;
+    }
+
+    ServerDetails *d = new ServerDetails(p);
+    map<addr_key, Uint32>::iterator a;
+
+    a = asked.find( addr_key(d->address.host, d->address.port) );
+    if( a != asked.end() ) {
+        d->ping = d->seen - a->second;
+    }
+    merge(d);
+}
+
+/* An announcement updates the summary but keeps the players from an
+ * earlier details reply, unless the number of them has changed. */
+void ServerBrowser::merge(ServerDetails *d)
+{
+    for( int i=0; i<(int)servers.size(); i++ ) {
+        ServerDetails *old = servers[i];
+
+        if( old->address.host != d->address.host ||
+            old->address.port != d->address.port || old->room != d->room ) {
+            continue;
+        }
+        if( !d->full && old->full && old->numplayers == d->numplayers ) {
+            d->player_details.swap(old->player_details);
+            d->full = true;
+        }
+        if( !d->ping ) {
+            d->ping = old->ping;
+        }
+        servers[i] = d;
+        delete old;
+        return;
+    }
+    servers.push_back(d);
+}
@@ -0,0 +1,76 @@
+/*
+ *  Copyright (C) 2005 Joe Neeman <spuzzzzzzz@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#ifndef SERVERBROWSER_H
+#define SERVERBROWSER_H
+
+#include "NetworkThread.h"
+#include "MultiPlayerServer.h"
+
+/* forget a server that hasn't announced itself for this long, in ms */
+#define SERVER_CACHE_AGE (3 * ANNOUNCE_INTERVAL + 1000)
+
+/* Keeps a list of the servers on the local network, from the announcements
+ * that they broadcast. It has no thread of its own: whoever shows the list
+ * calls update() now and then, which never waits, so the list is there
+ * straight away and fills in as servers are heard from. Only the summary
+ * of each room comes for free; the players are fetched when they are
+ * wanted, with requestDetails(). */
+class ServerBrowser: public NetThread {
+    public:
+        ServerBrowser();
+        virtual ~ServerBrowser();
+
+        bool ok() {return sock->ok();}
+
+        /** Ask every server on the network to announce itself now, rather
+         *  than when it next would. */
+        void query();
+
+        /** Read whatever has arrived, and forget the servers that haven't
+         *  been heard from for SERVER_CACHE_AGE. */
+        void update(Uint32 now);
+
+        /** The rooms that we know about, in the order that they were first
+         *  heard from. They belong to the browser, and last until the next
+         *  update(). */
+        const vector<ServerDetails*> &getServers() {return servers;}
+
+        /** Ask a server for its players. They turn up in its rooms'
+         *  player_details, and ping is set, after a later update(). */
+        void requestDetails(const ServerDetails*);
+
+    private:
+        virtual void handleEvent(UDPpacket*, enum NetEvent, const WireArgs&)
+            {}
+        virtual void handlePing(UDPpacket*) {}
+        virtual void handleRegister(UDPpacket*) {}
+        virtual void handleDetails(UDPpacket*);
+        virtual void handleAnnounce(UDPpacket*);
+
+        /* add d to the list, or update the entry for its room */
+        void merge(ServerDetails *d);
+
+        typedef pair<Uint32, Uint16> addr_key;
+        map<addr_key, Uint32> asked;    /* when we asked each for details */
+
+        vector<ServerDetails*> servers;
+        UDPpacket **batch;
+        IPaddress broadcast;
+};
+
+#endif
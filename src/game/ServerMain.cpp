@@ -0,0 +1,299 @@
+/*
+ *  Copyright (C) 2005 Joe Neeman <spuzzzzzzz@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#include <Gnumch.h>
+#include <Game.h>
+#include <FileSys.h>
+#include <Level.h>
+#include "MultiPlayerServer.h"
+#include "NetworkThread.h"
+#include "NetEmulator.h"
+#include "RoomPool.h"
+#include <signal.h>
+#include <unistd.h>
+
+extern __thread Game *game;
+extern FileSys *fs;
+extern int verbosity;
+
+/* CLI parsing stuff */
+const static char *optstring = "hvVp:n:l:r:R:w:e:m:q";
+extern char *optarg;
+extern int optind, opterr;
+
+void usage(const char *name, const vector<LevelConfig*> &levels)
+{
+    version();
+    printf("Usage: %s [OPTIONS]\n\
+\n\
+Runs a dedicated server for network games. It has no graphics or sound.\n\
+\n\
+Options:\n\
+  -h                Display this help message\n\
+  -v                Verbose output\n\
+  -V                Display version information\n\
+  -p PORT           Listen on PORT (default %d)\n\
+  -n NAME           The server name that clients see\n\
+  -r RATE           Update the game RATE times a second (default %d)\n\
+  -R ROOMS          Host ROOMS separate games (default 1)\n\
+  -w THREADS        Run the rooms on THREADS threads (default: one per CPU)\n\
+  -e PROFILE        Add the latency and loss described in PROFILE to the\n\
+                    network (see NetEmulator.h)\n\
+  -m FILE           Keep network and tick statistics in FILE, in the\n\
+                    Prometheus text format. Send SIGUSR1 to print them.\n\
+  -q                Don't announce the server on the local network; it still\n\
+                    answers clients that ask for it\n\
+  -l LEVEL          The number of the level to play (default 1):\n", name,
+           SERVER_PORT, SERVER_TICK_RATE);
+    for (int i=0; i<(int)levels.size(); i++) {
+        printf("                      %d  %s\n", i+1, levels[i]->title);
+    }
+}
+
+static volatile sig_atomic_t stopping = 0;
+static volatile sig_atomic_t print_stats = 0;
+
+void stopServer(int)
+{
+    stopping = 1;
+}
+
+void printStats(int)
+{
+    print_stats = 1;
+}
+
+/* the rooms' tick times, in the same format as the network stats */
+static string tickMetrics(RoomPool *pool)
+{
+    TickStats ts;
+    char buf[1024];
+
+    pool->getTickTotals(&ts);
+    snprintf(buf, sizeof(buf),
+             "# HELP gnumch_room_ticks_total Ticks run in all rooms.\n"
+             "# TYPE gnumch_room_ticks_total counter\n"
+             "gnumch_room_ticks_total %llu\n"
+             "# HELP gnumch_room_tick_seconds_total Time spent running "
+             "ticks, when the game state is busy.\n"
+             "# TYPE gnumch_room_tick_seconds_total counter\n"
+             "gnumch_room_tick_seconds_total %.6f\n"
+             "# HELP gnumch_room_tick_overruns_total Ticks that took longer "
+             "than the tick period.\n"
+             "# TYPE gnumch_room_tick_overruns_total counter\n"
+             "gnumch_room_tick_overruns_total %llu\n"
+             "# HELP gnumch_room_ticks_skipped_total Ticks skipped by rooms "
+             "that fell too far behind.\n"
+             "# TYPE gnumch_room_ticks_skipped_total counter\n"
+             "gnumch_room_ticks_skipped_total %llu\n"
+             "# HELP gnumch_room_tick_max_late_seconds The latest that a "
+             "tick has started.\n"
+             "# TYPE gnumch_room_tick_max_late_seconds gauge\n"
+             "gnumch_room_tick_max_late_seconds %.6f\n",
+             (unsigned long long)ts.ticks, ts.busy_us / 1e6,
+             (unsigned long long)ts.overruns,
+             (unsigned long long)ts.skipped, ts.max_late_us / 1e6);
+    return buf;
+}
+
+int main(int argc, char **argv)
+{
+    int c;
+    int port = SERVER_PORT;
+    int level_num = 1;
+    int rate = SERVER_TICK_RATE;
+    int num_rooms = 1;
+    int workers = sysconf(_SC_NPROCESSORS_ONLN);
+    const char *name = "gnumch";
+    const char *profile_file = NULL;
+    const char *metrics_file = NULL;
+    bool announce = true;
+
+    /* no video or audio: just the timer, for SDL_GetTicks and SDL_Delay */
+    if(SDL_Init(SDL_INIT_TIMER | SDL_INIT_NOPARACHUTE) == -1) {
+        printError("couldn't init SDL: %s\n", SDL_GetError());
+    }
+    atexit (SDL_Quit);
+
+    fs = new FileSys();
+    vector<LevelConfig*> levels;
+    Level::getLevelList(&levels);
+
+    while((c=getopt(argc, argv, optstring)) >= 0) {
+        switch(c) {
+            case 'h':
+            case '?':
+                usage(argv[0], levels);
+                exit(0);
+                break;
+            case 'v':
+                verbosity++;
+                break;
+            case 'V':
+                version();
+                exit(0);
+                break;
+            case 'p':
+                port = atoi(optarg);
+                break;
+            case 'n':
+                name = optarg;
+                break;
+            case 'l':
+                level_num = atoi(optarg);
+                break;
+            case 'r':
+                rate = atoi(optarg);
+                break;
+            case 'R':
+                num_rooms = atoi(optarg);
+                break;
+            case 'w':
+                workers = atoi(optarg);
+                break;
+            case 'e':
+                profile_file = optarg;
+                break;
+            case 'm':
+                metrics_file = optarg;
+                break;
+            case 'q':
+                announce = false;
+                break;
+            case ':':
+                fprintf(stderr, "you need to specify an argument to -%c\n", c);
+                exit(1);
+                break;
+        }
+    }
+    if (level_num < 1 || level_num > (int)levels.size()) {
+        fprintf(stderr, "there is no level %d\n", level_num);
+        exit(1);
+    }
+    if (rate < 1 || rate > 200) {
+        fprintf(stderr, "the tick rate must be between 1 and 200\n");
+        exit(1);
+    }
+    if (num_rooms < 1 || num_rooms > MAX_ROOMS) {
+        fprintf(stderr, "the number of rooms must be between 1 and %d\n",
+                MAX_ROOMS);
+        exit(1);
+    }
+    workers = max(1, min(workers, num_rooms));
+
+    NetProfile profile;
+    if (profile_file && !NetEmulator::readProfile(profile_file, &profile)) {
+        fprintf(stderr, "couldn't read the network profile %s\n",
+                profile_file);
+        exit(1);
+    }
+
+    Game::GameSettings gset;
+    Menu::VideoSettings vset;
+    Menu::SoundSettings sset;
+    KeyBindings dummy;
+    int trog_mask;
+
+    Game::readSettings( &gset, &vset, &sset, &dummy, &dummy );
+    TroggleGame::readSettings( &trog_mask );
+
+    RoomPool *pool = new RoomPool(workers);
+    ServerNetThread *net = new ServerNetThread(pool, port);
+    if (profile_file) {
+        net->emulate( new NetEmulator(profile) );
+    }
+    net->setAnnounce(announce);
+    vector<MultiPlayerServer*> rooms;
+    vector<Level*> room_levels;
+
+    /* every room has its own level, so that they don't share any state */
+    for (int i=0; i<num_rooms; i++) {
+        string room_name = name;
+        if (num_rooms > 1) {
+            sprintf(&room_name, "%s %d", name, i+1);
+        }
+
+        MultiPlayerServer *room = new MultiPlayerServer(gset,
+                                                        room_name.c_str(),
+                                                        net, i);
+        room->setTrogMask(trog_mask);
+        room->setTickRate(rate);
+
+        game = room;
+        room_levels.push_back( levels[level_num-1]->makeLevel() );
+        room->begin(room_levels[i]);
+        pool->addRoom(room);
+        rooms.push_back(room);
+    }
+    game = NULL;
+
+    signal(SIGINT, stopServer);
+    signal(SIGTERM, stopServer);
+    signal(SIGUSR1, printStats);
+
+    printMsg(0, "%s: playing %s in %d rooms on port %d\n", name,
+             levels[level_num-1]->title, num_rooms, port);
+    pool->start();
+    net->start();
+
+    Uint32 dumped = 0;
+    while (!stopping) {
+        SDL_Delay(100);
+
+        NetStats stats;
+        if (print_stats || metrics_file) {
+            net->getStats(&stats);
+        }
+        if (print_stats) {
+            string table;
+            TickStats ts;
+
+            formatNetStats(stats, &table);
+            printMsg(0, "%s", table.c_str());
+            pool->getTickTotals(&ts);
+            printMsg(0, "%llu ticks: %llu overran, %llu skipped, the latest "
+                        "started %dus late\n", (unsigned long long)ts.ticks,
+                     (unsigned long long)ts.overruns,
+                     (unsigned long long)ts.skipped, ts.max_late_us);
+            print_stats = 0;
+        }
+        if (metrics_file && stats.time != dumped) {
+            if (!dumpPrometheus(metrics_file, stats, tickMetrics(pool))) {
+                printWarning("couldn't write %s\n", metrics_file);
+            }
+            dumped = stats.time;
+        }
+    }
+    printMsg(0, "shutting down\n");
+
+    pool->stop();
+    net->stop();
+    for (int i=0; i<num_rooms; i++) {
+        game = rooms[i];
+        rooms[i]->finish();
+        delete rooms[i];
+        delete room_levels[i];
+    }
+    game = NULL;
+    delete net;
+    delete pool;
+    for (int i=0; i<(int)levels.size(); i++) {
+        delete levels[i];
+    }
+    delete fs;
+    return 0;
+}
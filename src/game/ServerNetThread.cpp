@@ -16,9 +16,70 @@
  *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
  */
 #include "NetworkThread.h"
+#include "MultiPlayerServer.h"
+#include "RoomPool.h"
+#include "Event.h"
 
-void ServerNetThread::handleEvent(UDPpacket *p)
+ServerNetThread::ServerNetThread(RoomPool *rooms, int port)
 {
+    this->rooms = rooms;
+    next_spectator = 0;
+    stranger_limit.set(NET_STRANGER_RATE, NET_STRANGER_BURST);
+    sock = new NetSocket(port);
+    if( !sock->ok() ) {
+        printError("couldn't open UDP port %d\n", port);
+    }
+    announce = true;
+    last_announce = 0;
+    last_prune = 0;
+    SDLNet_ResolveHost(&broadcast, "255.255.255.255", DISCOVERY_PORT);
+}
+
+ServerNetThread::~ServerNetThread()
+{
+}
+
+playerInfo_t *ServerNetThread::findPlayer(const IPaddress &a)
+{
+    playerInfo_t *ret = NULL;
+    map<addr_key, playerInfo_t*>::iterator i;
+
+    SDL_mutexP(active_player_mutex);
+    i = sessions.find( addr_key(a.host, a.port) );
+    if( i != sessions.end() ) {
+        ret = i->second;
+    }
+    SDL_mutexV(active_player_mutex);
+    return ret;
+}
+
+void ServerNetThread::handleEvent(UDPpacket *p, enum NetEvent e,
+                                  const WireArgs &a)
+{
+    playerInfo_t *pi = findPlayer(p->address);
+
+    if( !pi ) {
+        printMsg(1, "event from unregistered address\n");
+        return;
+    }
+    if( pi->watching != -1 ) {
+        /* spectators can't do anything, and don't need to ack */
+        return;
+    }
+
+    switch( e ) {
+        case PLAYER_KEY:
+            if( a.n[0] < KEY_MENU ) {
+                rooms->getRoom(pi->room)->queueKey( pi->id, (enum Key)a.n[0],
+                                                    a.n[1] );
+            }
+            break;
+        case SNAPSHOT_ACK:
+            rooms->getRoom(pi->room)->ackSnapshot( pi->id, a.n[0] );
+            break;
+        default:
+            printMsg(1, "client sent unexpected NetEvent %d\n", e);
+    }
 }
 
 void ServerNetThread::handlePing(UDPpacket *p)
@@ -28,28 +89,203 @@ void ServerNetThread::handlePing(UDPpacket *p)
 
 void ServerNetThread::handleRegister(UDPpacket *p)
 {
-    const char *name = (char*)&PACKET_DATA(p)[5];
-    int id;
-
-    if( (id = mpgame->addPlayer(name)) != -1 ) {
-        if( SDLNet_UDP_Bind(listen, id, &p->address) != -1 ) {
-            playerInfo_t *pi = (playerInfo_t*)malloc(sizeof(playerInfo_t));
-            pi->id = id;
-            pi->channel = id;
-            pi->clockskew = SDL_GetTicks() - SDLNet_Read32( &PACKET_TIME(p) );
-            pi->name.assign( name, 16 );
-
-            SDL_mutexP(active_player_mutex);
-            active_players.push_back(pi);
-            SDL_mutexV(active_player_mutex);
-
-            printMsg(0, "Server registered client %s\n", pi->name.c_str() );
-        } else {
-            printMsg(0, "Server failed to bind address: %s\n",
-                     SDLNet_GetError());
-        }
+    WireArgs a;
+    int id, room, watch;
+
+    if( readFields(p, &a) == -1 ) {
+        printMsg(1, "dropping malformed register packet\n");
+        return;
+    }
+    room = a.n[2];
+    watch = a.n[3];
+
+    /* a client that didn't hear our reply asks again */
+    playerInfo_t *old = findPlayer(p->address);
+    if( old ) {
+        queueSend( createRegisterReply(p, old->id) );
+        return;
+    }
+
+    if( room >= rooms->getNumRooms() ) {
+        printMsg(1, "client asked for nonexistent room %d\n", room);
+        queueSend( createRegisterReply(p, -1) );
+        return;
+    }
+
+    string name = a.s[0].substr(0, PLAYER_NAME_LEN);
+
+    /* spectators don't take a place in the room; it only needs to know
+     * which tiers have anyone watching */
+    if( watch ) {
+        int tier = min(watch, SPECTATOR_TIERS) - 1;
+
+        addSession( p, name, next_spectator++, room,
+                    CHANNEL_SPECTATORS(room, tier) );
+        rooms->getRoom(room)->addSpectator(tier);
+        printMsg(0, "Server registered spectator %s in room %d\n",
+                 name.c_str(), room );
+        return;
+    }
+
+    if( (id = rooms->getRoom(room)->addPlayer(name)) != -1 ) {
+        addSession(p, name, id, room, -1);
+        printMsg(0, "Server registered client %s in room %d\n",
+                 name.c_str(), room );
     } else {
-        printMsg(0, "Server is full!\n");
+        printMsg(0, "Room %d is full!\n", room);
+        queueSend( createRegisterReply(p, -1) );
     }
 }
 
+void ServerNetThread::handleDisconnect(playerInfo_t *pi)
+{
+    SDL_mutexP(active_player_mutex);
+    sessions.erase( addr_key(pi->address.host, pi->address.port) );
+    SDL_mutexV(active_player_mutex);
+
+    if( pi->watching != -1 ) {
+        rooms->getRoom(pi->room)->removeSpectator(
+                CHANNEL_SPECTATORS(pi->room, 0) - pi->watching );
+    } else if( !rooms->getRoom(pi->room)->removePlayer(pi->id) ) {
+        printWarning("room %d is too busy to remove player %d\n",
+                     pi->room, pi->id);
+    }
+    NetThread::handleDisconnect(pi);
+}
+
+/* there are too many players for SDL_net's channels, so we remember their
+ * addresses instead */
+playerInfo_t *ServerNetThread::addSession(UDPpacket *p, const string &name,
+                                          int id, int room, int watching)
+{
+    playerInfo_t *pi = new playerInfo_t;
+    pi->id = id;
+    pi->channel = -1;
+    pi->room = room;
+    pi->address = p->address;
+    pi->clock.seed( SDLNet_Read32(&PACKET_TIME(p)), SDL_GetTicks() );
+    pi->name = name;
+    pi->conn = new Connection(pool);
+    pi->watching = watching;
+    pi->in_limit.set(NET_IN_RATE, NET_IN_BURST);
+    pi->out_limit.set(NET_OUT_RATE, NET_OUT_BURST);
+
+    SDL_mutexP(active_player_mutex);
+    active_players.push_back(pi);
+    sessions[addr_key(p->address.host, p->address.port)] = pi;
+    if( watching != -1 ) {
+        spectators[watching].push_back(pi);
+    }
+    SDL_mutexV(active_player_mutex);
+
+    queueSend( createRegisterReply(p, id) );
+    return pi;
+}
+
+UDPpacket *ServerNetThread::createSummaryPacket(int r, enum PacketType type,
+                                               vector<PlayerDetails> *details)
+{
+    MultiPlayerServer *room = rooms->getRoom(r);
+    UDPpacket *ret = createGenericPacket();
+    int n = room->getDetails(details);
+
+    ret->channel = -1;
+    PACKET_TYPE(ret) = type;
+    writeFields( ret, room->getName().substr(0, SERVER_NAME_LEN).c_str(),
+                 n, MAX_PLAYERS, room->getRunTime(), r );
+    return ret;
+}
+
+bool ServerNetThread::allowReply(const IPaddress &a, int len, Uint32 now)
+{
+    map<Uint32, QuerySource>::iterator i = query_sources.find(a.host);
+
+    if( i == query_sources.end() ) {
+        i = query_sources.insert( make_pair(a.host, QuerySource()) ).first;
+        i->second.limit.set(NET_QUERY_RATE, NET_QUERY_BURST);
+    }
+    i->second.last = now;
+    return i->second.limit.take(len, now);
+}
+
+/* reply with one format 4 packet (described in NetworkThread.cpp) for each
+ * room, as far as allowReply lets us */
+void ServerNetThread::handleDetails(UDPpacket *p)
+{
+    vector<PlayerDetails> details;
+    Uint32 now = SDL_GetTicks();
+
+    for( int r=0; r<rooms->getNumRooms(); r++ ) {
+        UDPpacket *ret = createSummaryPacket(r, PT_DETAILS, &details);
+        int n = details.size();
+
+        ret->address = p->address;
+        WireWriter out( ret->data + ret->len, NET_PACKET_SIZE - ret->len );
+        for( int i=0; i<n; i++ ) {
+            out.put( PLAYER_DETAILS_FORMAT, details[i].id,
+                     details[i].name.substr(0, PLAYER_NAME_LEN).c_str(),
+                     details[i].score, details[i].lives );
+        }
+        if( out.overflow() ) {
+            /* the player count wouldn't match what follows it */
+            printMsg(1, "room %d has too many players for a details packet\n",
+                     r);
+            pool->unref(ret);
+            continue;
+        }
+        ret->len += out.length();
+        if( !allowReply(p->address, ret->len, now) ) {
+            pool->unref(ret);
+            return;
+        }
+        queueSend(ret);
+    }
+}
+
+/* an announcement with no fields is a ServerBrowser asking who is there */
+void ServerNetThread::handleAnnounce(UDPpacket *p)
+{
+    vector<PlayerDetails> details;
+    Uint32 now = SDL_GetTicks();
+
+    if( p->len != PACKET_HEADER_LEN ) {
+        return;
+    }
+    for( int r=0; r<rooms->getNumRooms(); r++ ) {
+        UDPpacket *ret = createSummaryPacket(r, PT_ANNOUNCE, &details);
+        ret->address = p->address;
+        if( !allowReply(p->address, ret->len, now) ) {
+            pool->unref(ret);
+            return;
+        }
+        queueSend(ret);
+    }
+}
+
+void ServerNetThread::periodic(Uint32 now)
+{
+    vector<PlayerDetails> details;
+
+    /* forget anyone whose bucket has filled back up */
+    if( now - last_prune >= 1000 ) {
+        map<Uint32, QuerySource>::iterator i = query_sources.begin();
+        while( i != query_sources.end() ) {
+            if( now - i->second.last > NET_QUERY_BURST*1000/NET_QUERY_RATE ) {
+                query_sources.erase(i++);
+            } else {
+                ++i;
+            }
+        }
+        last_prune = now;
+    }
+
+    if( !announce || now - last_announce < ANNOUNCE_INTERVAL ) {
+        return;
+    }
+    for( int r=0; r<rooms->getNumRooms(); r++ ) {
+        UDPpacket *ret = createSummaryPacket(r, PT_ANNOUNCE, &details);
+        ret->address = broadcast;
+        queueSend(ret);
+    }
+    last_announce = now;
+}
@@ -22,6 +22,7 @@
 #include <Muncher.h>
 #include "menus/InGameMenu.h"
 #include <Animation.h>
+#include <BitStream.h>
 
 extern Container *enter_score_menu;
 
@@ -43,10 +44,14 @@ SinglePlayerGame::SinglePlayerGame(const GameSettings &set,
 {
     lives = 3;
     score = 0;
+    trog_next_level = false;
+    save_thread = NULL;
+    save_done = true;
 }
 
 SinglePlayerGame::~SinglePlayerGame()
 {
+    waitForSave();
 }
 
 void SinglePlayerGame::updateLives(Player *ignored, int lives)
@@ -127,17 +132,23 @@ void SinglePlayerGame::run(Level *level_, SDL_Surface *screen_)
     board = new Board(set.width, set.height, players);
 
     lost = 0;
-    bool trog_next_level = false;
+    trog_next_level = false;
+    bool resumed = resumeGame();
     while(!lost) {
-        level->nextLevel();
-        if (trog_next_level) { // bump the troggle difficulty every second level
-            nextTrogLevel();
-            trog_next_level = false;
-        } else {
-            trog_next_level = true;
+        if (!resumed) {
+            level->nextLevel();
+            if (trog_next_level) { // bump the troggle difficulty every second level
+                nextTrogLevel();
+                trog_next_level = false;
+            } else {
+                trog_next_level = true;
+            }
         }
-        runLevel();
+        runLevel(resumed);
+        resumed = false;
     }
+    waitForSave();
+    fs->forgetGame(level->getKind());
 
     /* free game memory */
     delete board;
@@ -200,13 +211,19 @@ Player *SinglePlayerGame::getNearestMuncher(int x, int y)
  * 3) draw the level title
  * 4) main game loop
  */
-void SinglePlayerGame::runLevel()
+void SinglePlayerGame::runLevel(bool resumed)
 {
     Event event;
     int now;
+    int last_save;
 
-    resetTroggles();
-    clearPlayerSpawn();
+    if (resumed) {
+        /* hold the clocks of the loaded game while the board comes in */
+        pause();
+    } else {
+        resetTroggles();
+        clearPlayerSpawn();
+    }
 
     FPSmanager manager;
     SDL_initFramerate(&manager);
@@ -216,14 +233,28 @@ void SinglePlayerGame::runLevel()
     showMessage( _("Ready..."), 0xee, 0xee, 0, 0xaa);
     redrawAll();
     SDL_Flip(screen);
-    board->reset();
+    if (!resumed) {
+        board->reset();
+    }
     redrawSpiral(800);
 
     showMessageTimed( _("GO!"), 1500, 0, 0xf5, 0, 0xaa);
+    if (resumed) {
+        resume();
+    }
     while( event.pollEvent() ) handleEvent( event ); // clear event queue
-    muncher->spawn( SDL_GetTicks() );
+    if (!resumed) {
+        muncher->spawn( SDL_GetTicks() );
+    } else if (!muncher->exist()
+               && find(spawning_players.begin(), spawning_players.end(),
+                       muncher) == spawning_players.end()) {
+        /* it was saved while waiting for the player to carry on */
+        showMessage( _("Press <Return> to continue.") );
+    }
     board->update();
     refresh();
+    saveGame();
+    last_save = SDL_GetTicks();
 
     while(!won && !lost)
     {
@@ -232,8 +263,13 @@ void SinglePlayerGame::runLevel()
         {
             handleEvent( event );
         }
+        if (now - last_save >= SAVE_INTERVAL && !won && !lost) {
+            saveGame();
+            last_save = now;
+        }
         handleTrogSpawns();
         tryPlayerSpawn();
+        updateAssets();
         board->update();
         if (!won && !lost) {
             refresh();
@@ -251,6 +287,96 @@ void SinglePlayerGame::runLevel()
     board->unset();
 }
 
+void SinglePlayerGame::writeState(BitWriter &out, int now)
+{
+    TroggleGame::writeState(out, now);
+    out.writeSigned(score);
+    out.writeSigned(lives);
+    out.write(trog_next_level, 1);
+}
+
+bool SinglePlayerGame::readState(BitReader &in, int now)
+{
+    if (!TroggleGame::readState(in, now)) {
+        return false;
+    }
+    int new_score = in.readSigned();
+    int new_lives = in.readSigned();
+    bool next = in.read(1);
+
+    if (in.overflow()) {
+        return false;
+    }
+    score = new_score;
+    lives = new_lives;
+    trog_next_level = next;
+    return true;
+}
+
+bool SinglePlayerGame::resumeGame()
+{
+    vector<Uint8> data;
+
+    if (!fs->loadGame(level->getKind(), &data) || data.empty()) {
+        return false;
+    }
+    switch (loadState(&data[0], data.size())) {
+        case LOAD_OK:
+            break;
+        case LOAD_OTHER_GAME:
+            printMsg(0, "the saved game has different settings\n");
+            return false;
+        case LOAD_GARBLED:
+            printWarning("the saved game is garbled; starting afresh\n");
+            fs->forgetGame(level->getKind());
+            return false;
+    }
+    printMsg(0, "carrying on with the saved game\n");
+    return true;
+}
+
+void SinglePlayerGame::saveGame()
+{
+    Uint8 buf[SAVE_MAX_SIZE];
+    int len;
+
+    /* if the disk is still busy with the last save, skip this one rather
+     * than hold up the game; the next one will be newer anyway */
+    if (save_thread && !save_done) {
+        return;
+    }
+    waitForSave();
+
+    len = saveState(buf, sizeof(buf));
+    if (len < 0) {
+        printWarning("the game is too big to save\n");
+        return;
+    }
+    save_data.assign(buf, buf + len);
+    save_kind = level->getKind();
+    save_done = false;
+    save_thread = SDL_CreateThread((int (*)(void*))saveThread, this);
+    if (!save_thread) {
+        fs->saveGame(save_kind.c_str(), &save_data[0], len);
+        save_done = true;
+    }
+}
+
+int SinglePlayerGame::saveThread(SinglePlayerGame *g)
+{
+    fs->saveGame(g->save_kind.c_str(), &g->save_data[0], g->save_data.size());
+    g->save_done = true;
+    return 0;
+}
+
+void SinglePlayerGame::waitForSave()
+{
+    if (save_thread) {
+        SDL_WaitThread(save_thread, NULL);
+        save_thread = NULL;
+    }
+}
+
 void SinglePlayerGame::handleEvent(const Event &event)
 {
     enum Key key;
@@ -25,6 +25,11 @@
 #include <Menu.h>
 #include <Game.h>
 
+/* how often a game in progress is saved, in ms. The save is removed when
+ * the game ends properly, so one that is still there when the next game
+ * starts is from a crash, and that game carries on from it. */
+#define SAVE_INTERVAL 5000
+
 class SinglePlayerGame: public TroggleGame {
     public:
         SinglePlayerGame(const GameSettings&, const Menu::VideoSettings&,
@@ -46,12 +51,30 @@ class SinglePlayerGame: public TroggleGame {
         int getScore() {return score;}
 
     protected:
-        virtual void    runLevel();
+        /* resumed is true if the level was loaded from a saved game */
+        virtual void    runLevel(bool resumed=false);
         virtual void    handleEvent(const Event&);
 
+        virtual void    writeState(BitWriter&, int now);
+        virtual bool    readState(BitReader&, int now);
+
+        /* carry on from the saved game, if there is one */
+        bool            resumeGame();
+        void            saveGame();
+
+        /* Syncing a save to the disk can take longer than a frame, so each
+         * one is written in its own thread from a copy in save_data. */
+        SDL_Thread      *save_thread;
+        volatile bool   save_done;
+        vector<Uint8>   save_data;
+        string          save_kind;
+        static int      saveThread(SinglePlayerGame*);
+        void            waitForSave();
+
         Muncher *muncher;
         int score;
         int lives;
+        bool trog_next_level;   /* bump the troggles at the next level */
 
         virtual void handleMuncherEaten(Muncher *m, Player *eater);
         virtual void handleMuncherIndigestion(Muncher *m);
@@ -0,0 +1,314 @@
+/*
+ *  Copyright (C) 2005 Joe Neeman <spuzzzzzzz@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#include "Snapshot.h"
+#include "Board.h"
+#include "Player.h"
+#include "Level.h"
+
+/* Encoded snapshots are bit-packed as follows:
+ * -------------------------------------------------------------------------
+ * | delta(1) | width(8) | height(8) | # players(8) | board | players ...
+ * -------------------------------------------------------------------------
+ *
+ * The board is the number of squares that differ from the base, followed by
+ * each of them in order:
+ * -----------------------------------------------------------------------
+ * | gap (gamma) | good(1) | 0 | text length (gamma) | text (8 each) ...
+ * | gap (gamma) | good(1) | 1 | text number (gamma)
+ * -----------------------------------------------------------------------
+ * where gap is the number of unchanged squares since the last changed one.
+ * A level only uses a handful of different numbers, so each text is spelt
+ * out the first time it appears in a snapshot and given the next number
+ * (starting at 0); after that it is written as that number. Empty texts are
+ * always spelt out, since that takes one bit anyway.
+ *
+ * Each player is a single 0 bit if it hasn't changed, and otherwise
+ * ------------------------------------------------------------------------
+ * | 1 | exists(1) | x | y | moving(1) | old x | old y | anim(3) | dir(2) |
+ * ------------------------------------------------------------------------
+ * where everything after exists is left out if it doesn't exist, and old x
+ * and old y are left out if it isn't moving. Positions are stored plus one
+ * (troggles walk on from just off the board) in as few bits as the size of
+ * the board allows.
+ *
+ * A full snapshot is a delta from an empty board with no players.
+ */
+
+Snapshot::Snapshot()
+{
+    id = 0;
+    width = height = 0;
+}
+
+void Snapshot::capture(Board *board, const vector<Player*> &p)
+{
+    width = board->getWidth();
+    height = board->getHeight();
+    good.resize(width * height);
+    text.resize(width * height);
+
+    for( int y=0; y<height; y++ ) {
+        for( int x=0; x<width; x++ ) {
+            Number *n = board->getNum(x, y);
+            good[y*width + x] = n && n->good();
+            text[y*width + x] = n ? n->getText() : "";
+        }
+    }
+
+    players.resize(p.size());
+    for( size_t i=0; i<p.size(); i++ ) {
+        PlayerSnap *s = &players[i];
+        Point pos = p[i]->getPos();
+        Point old = p[i]->getOldPos();
+
+        s->exist = p[i]->exist();
+        s->moving = p[i]->isMoving();
+        s->x = pos.x;
+        s->y = pos.y;
+        s->old_x = old.x;
+        s->old_y = old.y;
+        s->anim = p[i]->getAnimState();
+        s->dir = p[i]->getDir();
+    }
+}
+
+int Snapshot::encode(const Snapshot *base, Uint8 *buf, int max) const
+{
+    BitWriter out(buf, max);
+    int bits = bitsFor( std::max(width, height) + 2 );
+    int changed = 0, last = -1;
+    map<string, int> seen;      /* the texts written so far, by number */
+
+    /* we can only use a base of the same shape */
+    if( base && (base->width != width || base->height != height ||
+                 base->players.size() != players.size()) ) {
+        base = NULL;
+    }
+
+    out.write(base != NULL, 1);
+    out.write(width, 8);
+    out.write(height, 8);
+    out.write(players.size(), 8);
+
+    for( int i=0; i<width*height; i++ ) {
+        if( !sameCell(base, i) ) changed++;
+    }
+    out.writeGamma(changed);
+    for( int i=0; i<width*height; i++ ) {
+        if( sameCell(base, i) ) {
+            continue;
+        }
+        out.writeGamma(i - last - 1);
+        out.write(good[i], 1);
+
+        map<string, int>::iterator t = seen.find(text[i]);
+        if( t != seen.end() ) {
+            out.write(1, 1);
+            out.writeGamma(t->second);
+        } else {
+            out.write(0, 1);
+            out.writeGamma(text[i].size());
+            for( size_t c=0; c<text[i].size(); c++ ) {
+                out.write((Uint8)text[i][c], 8);
+            }
+            if( !text[i].empty() ) {
+                int n = seen.size();
+                seen[text[i]] = n;
+            }
+        }
+        last = i;
+    }
+
+    for( size_t i=0; i<players.size(); i++ ) {
+        if( base && samePlayer(players[i], base->players[i]) ) {
+            out.write(0, 1);
+        } else {
+            out.write(1, 1);
+            writePlayer(out, players[i], bits);
+        }
+    }
+
+    return out.overflow() ? -1 : out.length();
+}
+
+bool Snapshot::decode(const Snapshot *base, const Uint8 *buf, int len)
+{
+    BitReader in(buf, len);
+    bool delta = in.read(1);
+
+    width = in.read(8);
+    height = in.read(8);
+    int nplayers = in.read(8);
+    int bits = bitsFor( std::max(width, height) + 2 );
+
+    if( delta ) {
+        if( !base || base->width != width || base->height != height ||
+            (int)base->players.size() != nplayers ) {
+            return false;
+        }
+        good = base->good;
+        text = base->text;
+        players = base->players;
+    } else {
+        PlayerSnap none = {false, false, -1, -1, -1, -1, 0, 0};
+        good.assign(width * height, false);
+        text.assign(width * height, "");
+        players.assign(nplayers, none);
+    }
+
+    vector<string> seen;
+    int changed = in.readGamma();
+    int i = -1;
+    while( changed-- > 0 && !in.overflow() ) {
+        Uint32 gap = in.readGamma();
+        if( gap >= (Uint32)(width*height - i - 1) ) {
+            return false;
+        }
+        i += gap + 1;
+        good[i] = in.read(1);
+        if( in.read(1) ) {
+            Uint32 n = in.readGamma();
+            if( n >= seen.size() ) {
+                return false;
+            }
+            text[i] = seen[n];
+            continue;
+        }
+        Uint32 n = in.readGamma();
+        if( n > 255 ) {
+            return false;
+        }
+        text[i].resize(n);
+        for( Uint32 c=0; c<n; c++ ) {
+            text[i][c] = in.read(8);
+        }
+        if( n > 0 ) {
+            seen.push_back(text[i]);
+        }
+    }
+
+    for( int p=0; p<nplayers; p++ ) {
+        if( in.read(1) ) {
+            readPlayer(in, &players[p], bits);
+        }
+    }
+
+    return !in.overflow();
+}
+
+/*_________________________________private__________________________________*/
+
+bool Snapshot::sameCell(const Snapshot *base, int i) const
+{
+    if( !base ) {
+        return !good[i] && text[i].empty();
+    }
+    return good[i] == base->good[i] && text[i] == base->text[i];
+}
+
+bool Snapshot::samePlayer(const PlayerSnap &a, const PlayerSnap &b)
+{
+    if( a.exist != b.exist ) return false;
+    if( !a.exist ) return true;
+    if( a.x != b.x || a.y != b.y || a.moving != b.moving ||
+        a.anim != b.anim || a.dir != b.dir ) {
+        return false;
+    }
+    return !a.moving || (a.old_x == b.old_x && a.old_y == b.old_y);
+}
+
+void Snapshot::writePlayer(BitWriter &out, const PlayerSnap &s, int bits) const
+{
+    out.write(s.exist, 1);
+    if( !s.exist ) {
+        return;
+    }
+    out.write(s.x + 1, bits);
+    out.write(s.y + 1, bits);
+    out.write(s.moving, 1);
+    if( s.moving ) {
+        out.write(s.old_x + 1, bits);
+        out.write(s.old_y + 1, bits);
+    }
+    out.write(s.anim, 3);
+    out.write(s.dir, 2);
+}
+
+void Snapshot::readPlayer(BitReader &in, PlayerSnap *s, int bits)
+{
+    s->exist = in.read(1);
+    if( !s->exist ) {
+        return;
+    }
+    s->x = (int)in.read(bits) - 1;
+    s->y = (int)in.read(bits) - 1;
+    s->moving = in.read(1);
+    if( s->moving ) {
+        s->old_x = (int)in.read(bits) - 1;
+        s->old_y = (int)in.read(bits) - 1;
+    }
+    s->anim = in.read(3);
+    s->dir = in.read(2);
+}
+
+SnapshotHistory::SnapshotHistory()
+{
+    for( int i=0; i<SNAPSHOT_HISTORY; i++ ) {
+        snapshots[i] = NULL;
+    }
+}
+
+SnapshotHistory::~SnapshotHistory()
+{
+    for( int i=0; i<SNAPSHOT_HISTORY; i++ ) {
+        delete snapshots[i];
+    }
+}
+
+const Snapshot *SnapshotHistory::decode(Uint16 id, Uint16 base_id,
+                                        const Uint8 *data, int len)
+{
+    Snapshot *base = NULL;
+    Snapshot s;
+
+    if( Snapshot::isDelta(data, len) ) {
+        base = snapshots[base_id % SNAPSHOT_HISTORY];
+        if( !base || base->id != base_id ) {
+            printMsg(1, "no base %d for snapshot %d\n", base_id, id);
+            return NULL;
+        }
+    }
+    if( !s.decode(base, data, len) ) {
+        printMsg(1, "dropping malformed snapshot %d\n", id);
+        return NULL;
+    }
+    s.id = id;
+
+    /* decoding into s first means base can share a slot with id */
+    return add(s);
+}
+
+const Snapshot *SnapshotHistory::add(const Snapshot &s)
+{
+    Snapshot *&slot = snapshots[s.id % SNAPSHOT_HISTORY];
+    if( !slot ) {
+        slot = new Snapshot;
+    }
+    *slot = s;
+    return slot;
+}
@@ -0,0 +1,103 @@
+/*
+ *  Copyright (C) 2005 Joe Neeman <spuzzzzzzz@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "Gnumch.h"
+#include "BitStream.h"
+
+class Board;
+class Player;
+
+/* how many snapshots the server remembers to delta against, and the client
+ * remembers to decode against */
+#define SNAPSHOT_HISTORY 32
+
+/* where a Player is and what it is doing */
+typedef struct {
+    bool exist;
+    bool moving;
+    int x, y;
+    int old_x, old_y;   /* only meaningful while moving */
+    int anim;           /* AnimationType */
+    int dir;            /* AnimationDirection */
+} PlayerSnap;
+
+/* The state of a whole room at one moment: every square of the Board and
+ * every Player. The server sends these every few ticks, each one encoded
+ * as the difference from the last one the client acked, so that a client
+ * that has missed some events catches up with the next snapshot. Encoding
+ * the difference means that an idle board costs a few bytes, however big
+ * it is. */
+class Snapshot {
+    public:
+        Snapshot();
+
+        /** Record the current state of the board and the players. */
+        void    capture(Board*, const vector<Player*>&);
+
+        /** Encode this snapshot as changes from base, or all of it if base
+         *  is NULL.
+         *  @return the number of bytes written, or -1 if it didn't fit. */
+        int     encode(const Snapshot *base, Uint8 *buf, int max) const;
+
+        /** Decode a snapshot that was encoded against base.
+         *  @return false if the data is garbled. */
+        bool    decode(const Snapshot *base, const Uint8 *buf, int len);
+
+        /** @return whether data holds changes from a base snapshot. */
+        static bool isDelta(const Uint8 *buf, int len)
+            {return len > 0 && (buf[0] & 0x80);}
+
+        Uint16 id;
+        int width, height;
+        vector<bool> good;      /* indexed by y*width + x */
+        vector<string> text;    /* empty if the square has no number */
+        vector<PlayerSnap> players;
+
+    private:
+        bool    sameCell(const Snapshot *base, int i) const;
+        static bool samePlayer(const PlayerSnap&, const PlayerSnap&);
+        void    writePlayer(BitWriter&, const PlayerSnap&, int bits) const;
+        void    readPlayer(BitReader&, PlayerSnap*, int bits);
+};
+
+/* The snapshots that a client has acked, which the server may encode new
+ * ones against */
+class SnapshotHistory {
+    public:
+        SnapshotHistory();
+        ~SnapshotHistory();
+
+        /** Decode the snapshot numbered id from data, which was encoded
+         *  against the one numbered base_id, and remember it.
+         *  @return the snapshot, or NULL if it is garbled or we don't have
+         *          its base. */
+        const Snapshot *decode(Uint16 id, Uint16 base_id,
+                               const Uint8 *data, int len);
+
+        /** Remember a snapshot that came some other way, such as in a
+         *  JoinState, under its id.
+         *  @return our copy of it. */
+        const Snapshot *add(const Snapshot&);
+
+    private:
+        Snapshot *snapshots[SNAPSHOT_HISTORY];  /* by id % SNAPSHOT_HISTORY */
+};
+
+#endif
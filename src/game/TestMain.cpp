@@ -0,0 +1,558 @@
+/*
+ *  Copyright (C) 2005 Joe Neeman <spuzzzzzzz@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#include <Gnumch.h>
+#include <Game.h>
+#include <FileSys.h>
+#include <Level.h>
+#include <Board.h>
+#include <Muncher.h>
+#include <Animation.h>
+#include "BitStream.h"
+#include "Wire.h"
+#include "Snapshot.h"
+#include "JoinState.h"
+#include <time.h>
+
+extern __thread Game *game;
+extern FileSys *fs;
+
+/* where the level settings are written while testing saved games; "make
+ * clean" removes it */
+#define TEST_HOMEDIR "gnumch-test.d/"
+
+/* how many randomly garbled copies of each encoding to decode */
+#define TEST_GARBLES 2000
+
+/* Checks that everything we read from the network or from disk comes back
+ * the way it was written, and that truncated or garbled data is turned away
+ * rather than trusted. Run by "make check". */
+
+static int failures = 0;
+
+#define CHECK(cond) check((cond), #cond, __FILE__, __LINE__)
+
+static void check(bool ok, const char *what, const char *file, int line)
+{
+    if (!ok) {
+        printf("%s:%d: check failed: %s\n", file, line, what);
+        failures++;
+    }
+}
+
+/* flip between one and three random bits */
+static void garble(vector<Uint8> *buf)
+{
+    int n = 1 + rand() % 3;
+
+    for (int i=0; i<n; i++) {
+        int bit = rand() % (buf->size() * 8);
+        (*buf)[bit / 8] ^= 0x80 >> (bit % 8);
+    }
+}
+
+/*_________________________________BitStream_________________________________*/
+
+static const Uint32 test_gammas[] = {0, 1, 2, 3, 254, 255, 65535,
+                                     0x7fffffff, 0xfffffffe, 0xffffffff};
+static const Sint32 test_signed[] = {0, 1, -1, 63, -64, 0x7fffffff,
+                                     -0x7fffffff};
+#define NUM_GAMMAS (int)(sizeof(test_gammas) / sizeof(test_gammas[0]))
+#define NUM_SIGNED (int)(sizeof(test_signed) / sizeof(test_signed[0]))
+
+static Uint32 testBits(int bits)
+{
+    return bits == 32 ? 0xa5a5a5a5 : 0xa5a5a5a5 & ((1u << bits) - 1);
+}
+
+static void writeBitSample(BitWriter &out)
+{
+    for (int bits=1; bits<=32; bits++) {
+        out.write(testBits(bits), bits);
+    }
+    for (int i=0; i<NUM_GAMMAS; i++) {
+        out.writeGamma(test_gammas[i]);
+    }
+    for (int i=0; i<NUM_SIGNED; i++) {
+        out.writeSigned(test_signed[i]);
+    }
+    out.writeSigned(-0x7fffffff - 1);
+    out.writeString("");
+    out.writeString("gnumch");
+    out.writeString(string(300, 'x'));
+}
+
+/* @return whether everything read back as writeBitSample() wrote it */
+static bool readBitSample(BitReader &in)
+{
+    bool same = true;
+
+    for (int bits=1; bits<=32; bits++) {
+        same = same && in.read(bits) == testBits(bits);
+    }
+    /* the largest number has no code, so it is written as the one below */
+    for (int i=0; i<NUM_GAMMAS; i++) {
+        same = same && in.readGamma() == min(test_gammas[i], 0xfffffffeu);
+    }
+    for (int i=0; i<NUM_SIGNED; i++) {
+        same = same && in.readSigned() == test_signed[i];
+    }
+    /* and the most negative one is written as the next one up */
+    same = same && in.readSigned() == -0x7fffffff;
+    same = same && in.readString(0) == "";
+    same = same && in.readString(6) == "gnumch";
+    same = same && in.readString(300) == string(300, 'x');
+    return same;
+}
+
+static void testBitStream()
+{
+    Uint8 buf[512];
+    BitWriter out(buf, sizeof(buf));
+
+    printf("testing BitWriter and BitReader\n");
+    writeBitSample(out);
+    CHECK(!out.overflow());
+
+    BitReader in(buf, out.length());
+    CHECK(readBitSample(in));
+    CHECK(!in.overflow());
+
+    /* every byte holds part of the sample, so losing any of them shows */
+    for (int n=0; n<out.length(); n++) {
+        BitReader part(buf, n);
+        readBitSample(part);
+        CHECK(part.overflow());
+    }
+
+    /* a gamma code of more than 32 bits */
+    Uint8 zeros[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+    BitReader z(zeros, sizeof(zeros));
+    CHECK(z.readGamma() == 0);
+    CHECK(z.overflow());
+
+    /* a string longer than the reader allows */
+    BitWriter s(buf, sizeof(buf));
+    s.writeString("gnumch");
+    BitReader longer(buf, s.length());
+    CHECK(longer.readString(5) == "");
+    CHECK(longer.overflow());
+
+    /* a writer that runs out of room */
+    BitWriter small(buf, 2);
+    small.write(0, 17);
+    CHECK(small.overflow());
+}
+
+/*___________________________________Wire____________________________________*/
+
+static void testWire()
+{
+    Uint8 buf[64];
+    WireWriter out(buf, sizeof(buf));
+    WireArgs a;
+
+    printf("testing WireWriter and WireReader\n");
+    out.put("buitccs", 7, 300, -5, (int)0xdeadbeef, 3, 4, 20, -7, "gnumch");
+    out.varint(0xffffffff);
+    out.zigzag(-0x7fffffff - 1);
+    CHECK(!out.overflow());
+
+    WireReader in(buf, out.length());
+    CHECK(in.get("buitccs", &a));
+    CHECK(a.n[0] == 7 && a.n[1] == 300 && a.n[2] == -5);
+    CHECK((Uint32)a.n[3] == 0xdeadbeef);
+    CHECK(a.n[4] == 3 && a.n[5] == 4 && a.n[6] == 20 && a.n[7] == -7);
+    CHECK(a.s[0] == "gnumch");
+    CHECK(in.varint() == 0xffffffff);
+    CHECK(in.zigzag() == -0x7fffffff - 1);
+    CHECK(!in.overflow() && in.left() == 0);
+
+    for (int n=0; n<out.length(); n++) {
+        WireReader part(buf, n);
+        part.get("buitccs", &a);
+        part.varint();
+        part.zigzag();
+        CHECK(part.overflow());
+    }
+
+    /* a varint that goes on for more than 5 bytes */
+    Uint8 endless[6] = {0x80, 0x80, 0x80, 0x80, 0x80, 0x01};
+    WireReader e(endless, sizeof(endless));
+    CHECK(e.varint() == 0);
+    CHECK(e.overflow());
+
+    /* a string that is longer than what is left, or than any string */
+    Uint8 cut[3] = {5, 'a', 'b'};
+    WireReader c(cut, sizeof(cut));
+    CHECK(c.str() == "");
+    CHECK(c.overflow());
+
+    Uint8 huge[2] = {0x80, 0x02};   /* 256 */
+    WireReader h(huge, sizeof(huge));
+    CHECK(!h.get("s", &a));
+}
+
+/*_________________________________Snapshot__________________________________*/
+
+static bool sameSnapshot(const Snapshot &a, const Snapshot &b)
+{
+    if (a.width != b.width || a.height != b.height || a.good != b.good ||
+        a.text != b.text || a.players.size() != b.players.size()) {
+        return false;
+    }
+    for (size_t i=0; i<a.players.size(); i++) {
+        const PlayerSnap &p = a.players[i], &q = b.players[i];
+        if (p.exist != q.exist) {
+            return false;
+        }
+        if (p.exist && (p.x != q.x || p.y != q.y || p.moving != q.moving ||
+                        p.anim != q.anim || p.dir != q.dir ||
+                        (p.moving && (p.old_x != q.old_x ||
+                                      p.old_y != q.old_y)))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void makeSnapshot(Snapshot *s)
+{
+    static const char *texts[] = {"2", "3", "4", "12", "", "97", "4"};
+    PlayerSnap none = {false, false, -1, -1, -1, -1, 0, 0};
+
+    s->id = 1;
+    s->width = 6;
+    s->height = 5;
+    s->good.assign(30, false);
+    s->text.assign(30, "");
+    for (int i=0; i<30; i+=2) {
+        s->text[i] = texts[i % 7];
+        s->good[i] = i % 3 == 0;
+    }
+    s->players.assign(5, none);
+    PlayerSnap still = {true, false, 0, 4, -1, -1, 1, 2};
+    PlayerSnap walking = {true, true, 5, 2, 6, 2, 3, 1};
+    PlayerSnap arriving = {true, true, 0, 0, -1, 0, 2, 0};
+    s->players[0] = still;
+    s->players[2] = walking;
+    s->players[4] = arriving;
+}
+
+static void testSnapshot()
+{
+    Snapshot full, changed, got;
+    vector<Uint8> buf(1024);
+
+    printf("testing Snapshot\n");
+    makeSnapshot(&full);
+    int len = full.encode(NULL, &buf[0], buf.size());
+    CHECK(len > 0);
+    CHECK(got.decode(NULL, &buf[0], len));
+    CHECK(sameSnapshot(full, got));
+
+    for (int n=0; n<len; n++) {
+        CHECK(!got.decode(NULL, &buf[0], n));
+    }
+
+    /* changes from the first one */
+    changed = full;
+    changed.text[1] = "12";
+    changed.good[1] = true;
+    changed.text[28] = "";
+    changed.players[2].x = 4;
+    changed.players[3].exist = true;
+    changed.players[3].x = 1;
+    changed.players[3].y = 1;
+    int dlen = changed.encode(&full, &buf[0], buf.size());
+    CHECK(dlen > 0);
+    CHECK(Snapshot::isDelta(&buf[0], dlen));
+    CHECK(got.decode(&full, &buf[0], dlen));
+    CHECK(sameSnapshot(changed, got));
+    CHECK(!got.decode(NULL, &buf[0], dlen));
+
+    for (int n=0; n<dlen; n++) {
+        CHECK(!got.decode(&full, &buf[0], n));
+    }
+
+    /* nothing should be trusted, but anything may decode */
+    for (int i=0; i<TEST_GARBLES; i++) {
+        vector<Uint8> bad(buf.begin(), buf.begin() + len);
+        garble(&bad);
+        if (got.decode(NULL, &bad[0], bad.size())) {
+            CHECK((int)got.good.size() == got.width * got.height);
+            CHECK((int)got.text.size() == got.width * got.height);
+        }
+    }
+
+    /* a gap between changed squares that would take us off the start of
+     * the board */
+    BitWriter out(&buf[0], buf.size());
+    out.write(0, 1);
+    out.write(6, 8);
+    out.write(5, 8);
+    out.write(0, 8);
+    out.writeGamma(2);
+    out.writeGamma(0);
+    out.write(1, 1);
+    out.write(0, 1);
+    out.writeGamma(1);
+    out.write('7', 8);
+    out.writeGamma(0xfffffffe);
+    CHECK(!got.decode(NULL, &buf[0], out.length()));
+
+    /* a text longer than any number */
+    BitWriter longer(&buf[0], buf.size());
+    longer.write(0, 1);
+    longer.write(6, 8);
+    longer.write(5, 8);
+    longer.write(0, 8);
+    longer.writeGamma(1);
+    longer.writeGamma(0);
+    longer.write(1, 1);
+    longer.write(0, 1);
+    longer.writeGamma(0xfffffffe);
+    CHECK(!got.decode(NULL, &buf[0], longer.length()));
+}
+
+/*_________________________________JoinState_________________________________*/
+
+static void testJoinState()
+{
+    JoinState js, got;
+    vector<Uint8> buf(JOIN_MAX_FRAGMENTS * JOIN_FRAGMENT_SIZE);
+
+    printf("testing JoinState\n");
+    js.title = "Primes less than 10";
+    js.trog_warning = true;
+    js.scores.push_back(0);
+    js.scores.push_back(15);
+    js.scores.push_back(-5);
+    js.scores.push_back(100000);
+    makeSnapshot(&js.snap);
+
+    int len = js.encode(&buf[0], buf.size());
+    CHECK(len > 0);
+    CHECK(got.decode(&buf[0], len));
+    CHECK(got.title == js.title);
+    CHECK(got.trog_warning == js.trog_warning);
+    CHECK(got.scores == js.scores);
+    CHECK(sameSnapshot(got.snap, js.snap));
+
+    for (int n=0; n<len; n++) {
+        CHECK(!got.decode(&buf[0], n));
+    }
+    for (int i=0; i<TEST_GARBLES; i++) {
+        vector<Uint8> bad(buf.begin(), buf.begin() + len);
+        garble(&bad);
+        got.decode(&bad[0], bad.size());
+    }
+}
+
+/*________________________________saved games________________________________*/
+
+static Menu::VideoSettings no_video = {0, 0, 0, 0};
+
+/* A game with no screen and nobody at the keys, like a server room, just so
+ * that there is something to save and load. */
+class TestGame: public TroggleGame {
+    public:
+        TestGame(const GameSettings &set):
+            TroggleGame(set, no_video, KeyBindings(), KeyBindings()) {}
+
+        void    begin(Level*);
+        void    finish();
+        void    capture(Snapshot *s) {s->capture(board, players);}
+        string  getTitle() {return level->getLevelTitle();}
+        int     getScore() {return muncher->getScore();}
+
+        virtual void    updateLives(Player*, int) {}
+        virtual void    updateScore(Player*, int) {}
+        virtual void    end() {}
+        virtual void    win() {}
+        virtual void    run(Level*, SDL_Surface*) {}
+        virtual Player *getNearestMuncher(int, int) {return muncher;}
+
+        virtual void    showTrogWarning() {}
+        virtual void    hideTrogWarning() {}
+        virtual void    showMessage(const char*, Uint8=255, Uint8=255,
+                                    Uint8=255, Uint8=128) {}
+        virtual void    hideMessage() {}
+        virtual void    redrawSquare(int, int) {}
+        virtual void    refresh() {}
+        virtual void    redrawAll() {}
+
+    protected:
+        virtual void    handleMuncherEaten(Muncher*, Player*) {}
+        virtual void    handleMuncherIndigestion(Muncher*) {}
+
+        Muncher *muncher;
+};
+
+/* Start a level with the muncher appearing and some troggles waiting to
+ * come on, so that every part of the saved game has something in it. */
+void TestGame::begin(Level *level_)
+{
+    int now = SDL_GetTicks();
+
+    screen = NULL;
+    level = level_;
+    Animation::setHeadless(true);
+    anim.push_back(new Animation(muncher_name));
+    players.push_back( muncher = new Muncher(anim[0]) );
+    setTrogMask(0x1f);
+    setupTroggles();
+    board = new Board(set.width, set.height, players);
+
+    level->nextLevel();
+    nextTrogLevel();
+    nextTrogLevel();
+    board->reset();
+    playerSpawn(muncher, now);
+    muncher->givePoints(25);
+    for (size_t i=0; i<troggles.size(); i++) {
+        troggleNextSpawn(troggles[i], now);
+    }
+}
+
+/* free everything that begin() made */
+void TestGame::finish()
+{
+    board->unset();
+    delete board;
+    freeGame();
+    freeTroggles();
+    delete level;
+
+    board = NULL;
+    level = NULL;
+}
+
+static TestGame *startGame(const Game::GameSettings &set, LevelConfig *conf)
+{
+    TestGame *g = new TestGame(set);
+
+    game = g;
+    g->begin(conf->makeLevel());
+    return g;
+}
+
+static void endGame(TestGame *g)
+{
+    game = g;
+    g->finish();
+    delete g;
+    game = NULL;
+}
+
+/* @return whether g looks just as it did when before was taken */
+static bool unchanged(TestGame *g, const Snapshot &before,
+                      const string &title)
+{
+    Snapshot now;
+
+    g->capture(&now);
+    return sameSnapshot(before, now) && g->getTitle() == title;
+}
+
+static void testSavedGame()
+{
+    Game::GameSettings set = {3, 1000, 300, 500, 6, 5};
+    vector<LevelConfig*> levels;
+    vector<Uint8> buf(SAVE_MAX_SIZE);
+    Snapshot saved, before;
+
+    /* the troggles come from the source tree, and the level settings are
+     * written to a directory of our own rather than the user's */
+    printf("testing saved games\n");
+    fs = new FileSys(TEST_HOMEDIR, TEST_DATADIR);
+    Level::getLevelList(&levels);
+
+    TestGame *a = startGame(set, levels[0]);
+    int len = a->saveState(&buf[0], buf.size());
+    CHECK(len > 0);
+    a->capture(&saved);
+
+    TestGame *b = startGame(set, levels[0]);
+    CHECK(b->loadState(&buf[0], len) == LOAD_OK);
+    CHECK(unchanged(b, saved, a->getTitle()));
+    CHECK(b->getScore() == a->getScore());
+    endGame(b);
+
+    /* a failed load leaves the game as it was */
+    TestGame *c = startGame(set, levels[0]);
+    c->capture(&before);
+    string title = c->getTitle();
+    for (int n=0; n<len; n++) {
+        CHECK(c->loadState(&buf[0], n) == LOAD_GARBLED);
+        CHECK(unchanged(c, before, title));
+    }
+    for (int i=0; i<TEST_GARBLES; i++) {
+        vector<Uint8> bad(buf.begin(), buf.begin() + len);
+        garble(&bad);
+        if (c->loadState(&bad[0], bad.size()) == LOAD_OK) {
+            c->capture(&before);
+            title = c->getTitle();
+        } else {
+            CHECK(unchanged(c, before, title));
+        }
+    }
+    endGame(c);
+
+    /* a good save from another kind of game is told apart from a bad one */
+    TestGame *d = startGame(set, levels[1]);
+    CHECK(d->loadState(&buf[0], len) == LOAD_OTHER_GAME);
+    endGame(d);
+    set.width++;
+    TestGame *e = startGame(set, levels[0]);
+    CHECK(e->loadState(&buf[0], len) == LOAD_OTHER_GAME);
+    endGame(e);
+    endGame(a);
+
+    for (size_t i=0; i<levels.size(); i++) {
+        delete levels[i];
+    }
+    delete fs;
+    fs = NULL;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int seed = argc > 1 ? atoi(argv[1]) : time(NULL);
+
+    if(SDL_Init(SDL_INIT_TIMER | SDL_INIT_NOPARACHUTE) == -1) {
+        printError("couldn't init SDL: %s\n", SDL_GetError());
+    }
+    atexit (SDL_Quit);
+
+    /* the seed picks the garbling, so a failure can be repeated */
+    printf("random seed %u\n", seed);
+    srand(seed);
+
+    testBitStream();
+    testWire();
+    testSnapshot();
+    testJoinState();
+    testSavedGame();
+
+    if (failures) {
+        printf("%d checks failed\n", failures);
+        return 1;
+    }
+    printf("all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,63 @@
+/*
+ *  Copyright (C) 2005 Joe Neeman <spuzzzzzzz@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#include "TickScheduler.h"
+
+void addTickStats(TickStats *a, const TickStats &b)
+{
+    a->ticks += b.ticks;
+    a->busy_us += b.busy_us;
+    a->max_us = max(a->max_us, b.max_us);
+    a->overruns += b.overruns;
+    a->skipped += b.skipped;
+    a->max_late_us = max(a->max_late_us, b.max_late_us);
+}
+
+TickScheduler::TickScheduler(int rate)
+{
+    this->rate = max(rate, 1);
+    period = 1000000 / this->rate;
+    origin = 0;
+    next = 0;
+}
+
+void TickScheduler::start(Uint64 now)
+{
+    origin = now;
+    next = 0;
+}
+
+void TickScheduler::ticked(Uint64 start, Uint64 end, TickStats *stats)
+{
+    Uint64 was_due = due(next);
+    int took = end - start;
+    int late = start > was_due ? start - was_due : 0;
+
+    stats->ticks++;
+    stats->busy_us += took;
+    stats->max_us = max(stats->max_us, took);
+    stats->overruns += took > period;
+    stats->max_late_us = max(stats->max_late_us, late);
+
+    next++;
+    if (end > due(next) + (Uint64)TICK_MAX_CATCHUP * period) {
+        /* leave the next tick due now, on the same beat as before */
+        Uint64 behind = (end - due(next)) * rate / 1000000;
+        next += behind;
+        stats->skipped += behind;
+    }
+}
@@ -0,0 +1,72 @@
+/*
+ *  Copyright (C) 2005 Joe Neeman <spuzzzzzzz@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#ifndef TICKSCHEDULER_H
+#define TICKSCHEDULER_H
+
+#include "Gnumch.h"
+
+/* how many ticks a room may fall behind before it stops trying to catch up
+ * and skips the ones that it missed */
+#define TICK_MAX_CATCHUP 5
+
+/* What a run of ticks did. Times are in microseconds. */
+typedef struct {
+    Uint64 ticks;
+    Uint64 busy_us;     /* spent running ticks */
+    int max_us;         /* the longest tick */
+    Uint64 overruns;    /* ticks that took longer than the tick period */
+    Uint64 skipped;     /* ticks given up to catch up */
+    int max_late_us;    /* the latest that a tick started */
+} TickStats;
+
+/* add b to a */
+void addTickStats(TickStats *a, const TickStats &b);
+
+/* Decides when a fixed-rate loop should run its next tick. Tick n is due at
+ * n / rate seconds after start(), worked out afresh each time rather than
+ * by adding up periods, so rounding doesn't make the rate drift and a tick
+ * that starts late is made up for by starting the next one sooner. A loop
+ * that falls more than TICK_MAX_CATCHUP ticks behind skips the ones it
+ * missed, and carries on from the next tick that is due. Times are in
+ * microseconds, as from microseconds(). */
+class TickScheduler {
+    public:
+        TickScheduler(int rate);
+
+        void    start(Uint64 now);
+
+        /** @return how long until the next tick is due; it is due now if
+         *          this is 0 or less. */
+        Sint64  untilDue(Uint64 now) {return (Sint64)(due(next) - now);}
+
+        /** Note that the tick that was due ran from start to end, and add
+         *  what happened to stats. */
+        void    ticked(Uint64 start, Uint64 end, TickStats *stats);
+
+        int     getPeriod() {return period;}
+
+    private:
+        Uint64  due(Uint64 n) {return origin + n * 1000000 / rate;}
+
+        int rate;
+        int period;         /* roughly; only used for the metrics */
+        Uint64 origin;
+        Uint64 next;        /* the number of the next tick */
+};
+
+#endif
@@ -0,0 +1,76 @@
+/*
+ *  Copyright (C) 2005 Joe Neeman <spuzzzzzzz@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#include "TokenBucket.h"
+
+TokenBucket::TokenBucket(int rate, int burst)
+{
+    set(rate, burst);
+}
+
+void TokenBucket::set(int rate, int burst)
+{
+    this->rate = max(rate, 0);
+    this->burst = max(burst, 1);
+    level = (Sint64)this->burst * 1000;
+    last = SDL_GetTicks();
+}
+
+/* rate tokens a second is rate thousandths a ms, so slow rates don't round
+ * down to nothing */
+void TokenBucket::refill(Uint32 now)
+{
+    Uint32 elapsed = now - last;
+
+    if (elapsed > 0x7fffffff) {
+        /* now is older than last; the caller's clock went backwards */
+        return;
+    }
+    level = min(level + (Sint64)elapsed * rate, (Sint64)burst * 1000);
+    last = now;
+}
+
+bool TokenBucket::take(int n, Uint32 now)
+{
+    if (rate == 0) {
+        return true;
+    }
+    refill(now);
+    if (level < (Sint64)n * 1000) {
+        return false;
+    }
+    level -= (Sint64)n * 1000;
+    return true;
+}
+
+void TokenBucket::charge(int n, Uint32 now)
+{
+    if (rate == 0) {
+        return;
+    }
+    refill(now);
+    level -= (Sint64)n * 1000;
+}
+
+bool TokenBucket::empty(Uint32 now)
+{
+    if (rate == 0) {
+        return false;
+    }
+    refill(now);
+    return level <= 0;
+}
@@ -0,0 +1,54 @@
+/*
+ *  Copyright (C) 2005 Joe Neeman <spuzzzzzzz@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#ifndef TOKENBUCKET_H
+#define TOKENBUCKET_H
+
+#include "Gnumch.h"
+
+/* Lets things through at rate a second on average, and up to burst of them
+ * at once. The bucket holds up to burst tokens and fills at rate a second;
+ * each thing takes some out. A rate of 0 means no limit. Times are in ms, as
+ * from SDL_GetTicks(). */
+class TokenBucket {
+    public:
+        TokenBucket(int rate=0, int burst=0);
+
+        void    set(int rate, int burst);
+
+        /** Take n tokens, if there are that many.
+         *  @return whether there were. */
+        bool    take(int n, Uint32 now);
+
+        /** Take n tokens whether there are that many or not. What is
+         *  overdrawn has to be paid back before anything else gets
+         *  through. */
+        void    charge(int n, Uint32 now);
+
+        /** @return whether there is anything left to take. */
+        bool    empty(Uint32 now);
+
+    private:
+        void    refill(Uint32 now);
+
+        int rate;
+        int burst;
+        Sint64 level;       /* in thousandths of a token; may be below 0 */
+        Uint32 last;        /* when it was last refilled */
+};
+
+#endif
@@ -20,7 +20,7 @@
 #include <Troggle.h>
 #include <Animation.h>
 
-extern Game *game;
+extern __thread Game *game;
 
 /* a list of possible TroggleAction callbacks */
 TrogActionDef action[] = {
@@ -60,6 +60,7 @@ Troggle::Troggle()
     moving = 0;
     action_start = 0;
     exists = 0;
+    def = NULL;
     eat_offense = 3;
     eat_defense_live = eat_defense_eatback = 2;
 }
@@ -69,8 +70,8 @@ void Troggle::spawn(int time)
     int width = game->getWidth();
     int height = game->getHeight();
 
-    if(rand() % 2) {
-        if(rand() % 2) {    /* spawn from above */
+    if(gnumchRand() % 2) {
+        if(gnumchRand() % 2) {    /* spawn from above */
             old_y = -1;
             y = 0;
             anim.setDir(DIR_DOWN);
@@ -79,9 +80,9 @@ void Troggle::spawn(int time)
             y = height - 1;
             anim.setDir(DIR_UP);
         }
-        old_x = x = rand() % width;
+        old_x = x = gnumchRand() % width;
     } else {
-        if(rand() % 2) {    /* spawn from the left */
+        if(gnumchRand() % 2) {    /* spawn from the left */
             old_x = -1;
             x = 0;
             anim.setDir(DIR_RIGHT);
@@ -90,7 +91,7 @@ void Troggle::spawn(int time)
             x = width - 1;
             anim.setDir(DIR_LEFT);
         }
-        old_y = y = rand() % height;
+        old_y = y = gnumchRand() % height;
     }
     exists = 1;
     game->playerMove( this, old_x, old_y, x, y, time );
@@ -98,8 +99,12 @@ void Troggle::spawn(int time)
 
 void Troggle::queueSpawn()
 {
-    TroggleDef *def = reinterpret_cast<TroggleGame*>(game)->randomTroggle();
+    setDef( reinterpret_cast<TroggleGame*>(game)->randomTroggle() );
+}
 
+void Troggle::setDef(TroggleDef *d)
+{
+    def = d;
     anim.setAnim(def->anim);
     getMove = def->getMove;
     onMove  = def->onMove;
@@ -154,11 +159,11 @@ void getMove_straight(Troggle *trog)
 
 void getMove_random(Troggle *trog)
 {
-    if(rand()%2) {
+    if(gnumchRand()%2) {
         trog->x = 2*trog->x - trog->old_x;
         trog->y = 2*trog->y - trog->old_y;
     } else {
-        if(rand()%2) { /* turn left */
+        if(gnumchRand()%2) { /* turn left */
             int tmp = trog->x - (trog->y - trog->old_y);
             trog->y -= trog->x - trog->old_x;
             trog->x = tmp;
@@ -191,7 +196,7 @@ void getMove_chase(Troggle *trog)
 
         if( dx <= width/2 && dy <= height/2 )
         {
-            if(dx > dy || (dx == dy && rand()%2))
+            if(dx > dy || (dx == dy && gnumchRand()%2))
             {
                 trog->x += (trog->x - munch_pos.x > 0)? -1 : 1;
             }
@@ -230,7 +235,7 @@ void getMove_run(Troggle *trog)
 
         if(m->exist() && dx <= 2 && dy <= 2)
         {
-            if(dx > dy || (dx == dy && rand()%2))
+            if(dx > dy || (dx == dy && gnumchRand()%2))
             {
                 trog->x -= (trog->x - munch_pos.x > 0)? -1 : 1;
             }
@@ -20,6 +20,8 @@
 
 #include <Player.h>
 
+class TroggleDef;
+
 class Troggle: public Player {
     typedef void (*TroggleAction)(Troggle*);
 
@@ -28,6 +30,10 @@ class Troggle: public Player {
 
         void die(int time);
         void queueSpawn();
+
+        /* what kind of troggle this is, or NULL before it first spawns */
+        TroggleDef *getDef() { return def; }
+        void setDef(TroggleDef*);
         void spawn(int time);
         void update();
 
@@ -40,6 +46,7 @@ class Troggle: public Player {
     protected:
         void calculateMove();
         void calculateSpawn();
+        TroggleDef *def;
         TroggleAction getMove;
         TroggleAction onMove;
         TroggleAction onStop;
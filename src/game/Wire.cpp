@@ -0,0 +1,215 @@
+/*
+ *  Copyright (C) 2005 Joe Neeman <spuzzzzzzz@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#include "Wire.h"
+
+WireWriter::WireWriter(Uint8 *buf, int max)
+{
+    this->buf = buf;
+    this->max = max;
+    pos = 0;
+    over = false;
+}
+
+void WireWriter::byte(Uint8 val)
+{
+    if( pos >= max ) {
+        over = true;
+        return;
+    }
+    buf[pos++] = val;
+}
+
+void WireWriter::varint(Uint32 val)
+{
+    while( val >= 0x80 ) {
+        byte( (val & 0x7f) | 0x80 );
+        val >>= 7;
+    }
+    byte(val);
+}
+
+void WireWriter::fixed32(Uint32 val)
+{
+    for( int i=24; i>=0; i-=8 ) {
+        byte(val >> i);
+    }
+}
+
+void WireWriter::cell(int x, int y)
+{
+    if( x >= -1 && x < 14 && y >= -1 && y < 14 ) {
+        byte( ((x + 1) << 4) | (y + 1) );
+    } else {
+        byte(0xff);
+        zigzag(x);
+        zigzag(y);
+    }
+}
+
+void WireWriter::str(const char *s)
+{
+    int n = min( (int)strlen(s), WIRE_STRING_MAX );
+
+    varint(n);
+    if( pos + n > max ) {
+        over = true;
+        return;
+    }
+    memcpy( &buf[pos], s, n );
+    pos += n;
+}
+
+void WireWriter::put(const char *format, ...)
+{
+    va_list ap;
+    va_start(ap, format);
+    vput(format, ap);
+    va_end(ap);
+}
+
+void WireWriter::vput(const char *format, va_list ap)
+{
+    for( const char *f = format; *f; f++ ) {
+        switch( *f ) {
+            case 'b':
+                byte( va_arg(ap, int) );
+                break;
+            case 'u':
+                varint( va_arg(ap, int) );
+                break;
+            case 'i':
+                zigzag( va_arg(ap, int) );
+                break;
+            case 't':
+                fixed32( va_arg(ap, int) );
+                break;
+            case 'c': {
+                int x = va_arg(ap, int);
+                cell( x, va_arg(ap, int) );
+                break;
+            }
+            case 's':
+                str( va_arg(ap, const char*) );
+                break;
+            default:
+                assert(0);
+        }
+    }
+}
+
+WireReader::WireReader(const Uint8 *buf, int len)
+{
+    this->buf = buf;
+    this->len = len;
+    pos = 0;
+    over = false;
+}
+
+Uint8 WireReader::byte()
+{
+    if( pos >= len ) {
+        over = true;
+        return 0;
+    }
+    return buf[pos++];
+}
+
+Uint32 WireReader::varint()
+{
+    Uint32 ret = 0;
+
+    for( int shift = 0; shift < 35; shift += 7 ) {
+        Uint8 b = byte();
+        ret |= (Uint32)(b & 0x7f) << shift;
+        if( !(b & 0x80) ) {
+            return ret;
+        }
+    }
+    /* more than 5 bytes can't be a 32-bit number */
+    over = true;
+    return 0;
+}
+
+Uint32 WireReader::fixed32()
+{
+    Uint32 ret = 0;
+
+    for( int i=0; i<4; i++ ) {
+        ret = (ret << 8) | byte();
+    }
+    return ret;
+}
+
+void WireReader::cell(Sint32 *x, Sint32 *y)
+{
+    Uint8 b = byte();
+
+    if( b == 0xff ) {
+        *x = zigzag();
+        *y = zigzag();
+    } else {
+        *x = (b >> 4) - 1;
+        *y = (b & 0x0f) - 1;
+    }
+}
+
+string WireReader::str()
+{
+    Uint32 n = varint();
+
+    if( over || n > WIRE_STRING_MAX || (int)n > len - pos ) {
+        over = true;
+        return "";
+    }
+    pos += n;
+    return string( (const char*)&buf[pos - n], n );
+}
+
+bool WireReader::get(const char *format, WireArgs *args)
+{
+    int n = 0, s = 0;
+
+    for( const char *f = format; *f && !over; f++ ) {
+        assert( *f == 's' ? s < WIRE_MAX_STRS
+                          : n + (*f == 'c' ? 2 : 1) <= WIRE_MAX_NUMS );
+        switch( *f ) {
+            case 'b':
+                args->n[n++] = byte();
+                break;
+            case 'u':
+                args->n[n++] = varint();
+                break;
+            case 'i':
+                args->n[n++] = zigzag();
+                break;
+            case 't':
+                args->n[n++] = fixed32();
+                break;
+            case 'c':
+                cell( &args->n[n], &args->n[n+1] );
+                n += 2;
+                break;
+            case 's':
+                args->s[s++] = str();
+                break;
+            default:
+                assert(0);
+        }
+    }
+    return !over;
+}
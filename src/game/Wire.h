@@ -0,0 +1,121 @@
+/*
+ *  Copyright (C) 2005 Joe Neeman <spuzzzzzzz@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#ifndef WIRE_H
+#define WIRE_H
+
+#include "Gnumch.h"
+
+/* Goes in the first byte of every packet. Bump it whenever a packet or
+ * event format changes, so that peers running different versions drop
+ * each other's packets instead of misreading them. Version 0 was the old
+ * fixed-offset format, whose first byte was always 0. Version 2 numbered
+ * the texts in snapshots and added the join state, and version 3 added
+ * spectators to registration. */
+#define NET_PROTOCOL_VERSION 3
+
+/* the most numbers and strings that one format can hold */
+#define WIRE_MAX_NUMS 8
+#define WIRE_MAX_STRS 2
+
+/* the longest string that can be sent */
+#define WIRE_STRING_MAX 255
+
+/* The values read by WireReader::get, each kind in the order that they came.
+ * A cell counts as two numbers, x then y. */
+typedef struct {
+    Sint32 n[WIRE_MAX_NUMS];
+    string s[WIRE_MAX_STRS];
+} WireArgs;
+
+/* Packet fields are described by format strings, with one letter for each
+ * field:
+ *   b  a byte (0 to 255)
+ *   u  an unsigned varint: 7 bits a byte, low bits first, and the top bit
+ *      set if another byte follows
+ *   i  a signed varint, zigzagged first so that small negative numbers are
+ *      small too (0, -1, 1, -2... become 0, 1, 2, 3...)
+ *   t  a 32-bit number, most significant byte first; for timestamps, which
+ *      would take 5 bytes as varints
+ *   c  a board square, as two numbers x and y. If both are between -1 and
+ *      13 (troggles walk on from just off the board) it is one byte,
+ *      (x+1) << 4 | (y+1); otherwise it is 0xff and two signed varints.
+ *   s  a string of at most WIRE_STRING_MAX bytes, after its length as an
+ *      unsigned varint
+ */
+
+/* Writes fields into a buffer. If it fills up, the rest is dropped and
+ * overflow() becomes true. */
+class WireWriter {
+    public:
+        WireWriter(Uint8 *buf, int max);
+
+        void    byte(Uint8 val);
+        void    varint(Uint32 val);
+        void    zigzag(Sint32 val)
+            {varint( ((Uint32)val << 1) ^ (Uint32)(val >> 31) );}
+        void    fixed32(Uint32 val);
+        void    cell(int x, int y);
+        void    str(const char *s);
+
+        /** Write the arguments as described by format. Cells take two int
+         *  arguments, strings take a const char*, and everything else takes
+         *  an int. */
+        void    put(const char *format, ...);
+        void    vput(const char *format, va_list);
+
+        int     length()   {return pos;}
+        bool    overflow() {return over;}
+
+    private:
+        Uint8 *buf;
+        int max;
+        int pos;
+        bool over;
+};
+
+/* The other end of WireWriter. Reading past the end, or a varint or string
+ * that is too long, gives zeros and makes overflow() true. */
+class WireReader {
+    public:
+        WireReader(const Uint8 *buf, int len);
+
+        Uint8   byte();
+        Uint32  varint();
+        Sint32  zigzag()
+            {Uint32 v = varint(); return (Sint32)(v >> 1) ^ -(Sint32)(v & 1);}
+        Uint32  fixed32();
+        void    cell(Sint32 *x, Sint32 *y);
+        string  str();
+
+        /** Read the fields described by format into args.
+         *  @return false if they were garbled. */
+        bool    get(const char *format, WireArgs *args);
+
+        /* the number of bytes read so far */
+        int     position() {return pos;}
+        int     left()     {return len - pos;}
+        bool    overflow() {return over;}
+
+    private:
+        const Uint8 *buf;
+        int len;
+        int pos;
+        bool over;
+};
+
+#endif
@@ -25,7 +25,7 @@
 #include "ScoresMenu.h"
 #include "SinglePlayMenu.h"
 
-extern Game *game;
+extern __thread Game *game;
 
 static void resumeGame(Clickable *a, void *b)
 {
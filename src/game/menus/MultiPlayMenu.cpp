@@ -27,7 +27,7 @@ extern Menu::VideoSettings video_settings;
 extern KeyBindings bindings1;
 extern KeyBindings bindings2;
 extern int trog_mask;
-extern Game *game;
+extern __thread Game *game;
 
 MultiPlayMenu::MultiPlayMenu():
     target_spin(1000),
@@ -34,7 +34,7 @@ extern KeyBindings bindings1;
 extern KeyBindings bindings2;
 extern int trog_mask;
 extern FileSys *fs;
-extern Game *game;
+extern __thread Game *game;
 
 static char *key_names[KEY_NUM] = {"Up", "Down", "Left", "Right", "Munch",
                                    "Respawn", "Exit"};
@@ -26,7 +26,7 @@ extern Menu::VideoSettings video_settings;
 extern KeyBindings bindings1;
 extern KeyBindings bindings2;
 extern int trog_mask;
-extern Game *game;
+extern __thread Game *game;
 extern FileSys *fs;
 
 void SinglePlayMenu::showDesc(Spinner<string> *spin, void *playmenu)
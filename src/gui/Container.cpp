@@ -115,6 +115,7 @@ void Container::add(Widget *child)
     }
     child->setParent(this);
     setChanged(1);
+    Menu::layoutChanged();
 }
 
 void Container::remove(Widget* child)
@@ -130,6 +131,7 @@ void Container::remove(Widget* child)
         children.erase(i);
     }
     setChanged(1);
+    Menu::layoutChanged();
 }
 
 void Container::insert(Widget *child, Widget *before)
@@ -147,6 +149,7 @@ void Container::insert(Widget *child, Widget *before)
     children.insert(i, child);
     child->setParent(this);
     setChanged(1);
+    Menu::layoutChanged();
 }
 
 void Container::clear()
@@ -159,6 +162,7 @@ void Container::clear()
     }
     children.clear();
     setChanged(1);
+    Menu::layoutChanged();
 }
 
 void Container::setAlign(Align new_align)
@@ -641,6 +645,7 @@ void Column2::add(Widget *w1, Widget *w2)
     children.push_back(w2);
     w1->setParent(this);
     w2->setParent(this);
+    Menu::layoutChanged();
 }
 
 void Column2::draw(bool update)
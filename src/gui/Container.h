@@ -83,6 +83,9 @@ class Container: public Widget {
 
         /* return true if at least one child allows keyboard focus */
         virtual bool    getAllowKeyFocus();
+        virtual bool    isContainer() {return true;}
+
+        friend class FocusIndex;
 
     protected:
         vector<Widget*> children;
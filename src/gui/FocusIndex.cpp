@@ -0,0 +1,206 @@
+/*
+ *  Copyright (C) 2005 Joe Neeman <spuzzzzzzz@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#include "FocusIndex.h"
+#include "Container.h"
+#include <algorithm>
+
+FocusIndex::FocusIndex()
+{
+    root = NULL;
+    valid = false;
+    last_widget = NULL;
+}
+
+void FocusIndex::build(Container *root_)
+{
+    vector<Entry> entries;
+    vector<int> ys;
+    Rectangle screen;
+
+    root = root_;
+    bands.clear();
+    key_order.clear();
+    key_pos.clear();
+    last_widget = NULL;
+
+    root->getPosition(&screen);
+    collect(root, screen, entries);
+
+    /* every top or bottom edge of a widget starts a new band */
+    for (size_t i=0; i<entries.size(); i++) {
+        ys.push_back(entries[i].rect.y);
+        ys.push_back(entries[i].rect.y + entries[i].rect.h);
+    }
+    sort(ys.begin(), ys.end());
+    ys.erase(unique(ys.begin(), ys.end()), ys.end());
+
+    for (size_t i=0; i+1<ys.size(); i++) {
+        Band b;
+        b.y1 = ys[i];
+        b.y2 = ys[i+1];
+        buildBand(b, entries);
+        if (!b.spans.empty()) {
+            bands.push_back(b);
+        }
+    }
+    valid = true;
+
+    printMsg(2, "focus index: %d widgets, %d bands, %d keyboard stops\n",
+             (int)entries.size(), (int)bands.size(), (int)key_order.size());
+}
+
+/* Add w and all its children to dest, in the same order that
+ * Container::handleFocus would visit them. Each rectangle is clipped to its
+ * parent's, since handleFocus never looks at a child outside its parent. */
+void FocusIndex::collect(Widget *w, const Rectangle &clip,
+                         vector<Entry> &dest)
+{
+    Entry e;
+    size_t pos = dest.size();
+    bool added = false;
+
+    w->getPosition(&e.rect);
+    e.rect.intersectSelf(clip);
+    e.widget = w;
+    e.end = pos + 1;
+    if (e.rect.w > 0 && e.rect.h > 0) {
+        dest.push_back(e);
+        added = true;
+    }
+
+    if (w->isContainer()) {
+        vector<Widget*> &children = ((Container*)w)->children;
+        for (size_t i=0; i<children.size(); i++) {
+            if (children[i]) {
+                collect(children[i], e.rect, dest);
+            }
+        }
+        if (added) {
+            dest[pos].end = dest.size();
+        }
+    } else if (w->getAllowKeyFocus()) {
+        key_pos[w] = key_order.size();
+        key_order.push_back(w);
+    }
+}
+
+void FocusIndex::buildBand(Band &band, const vector<Entry> &entries)
+{
+    vector<size_t> cover;
+    vector<int> xs;
+
+    for (size_t i=0; i<entries.size(); i++) {
+        const Rectangle &r = entries[i].rect;
+        if (r.y <= band.y1 && r.y + r.h >= band.y2) {
+            cover.push_back(i);
+            xs.push_back(r.x);
+            xs.push_back(r.x + r.w);
+        }
+    }
+    sort(xs.begin(), xs.end());
+    xs.erase(unique(xs.begin(), xs.end()), xs.end());
+
+    /* Like handleFocus, go into the first child that covers the span, then
+     * its first child that covers it, and so on. The entries are in tree
+     * order, so the first covering entry among best's descendants is that
+     * child, and siblings that overlap it never get a look in. */
+    for (size_t j=0; j+1<xs.size(); j++) {
+        const Entry *best = NULL;
+        for (size_t i=0; i<cover.size(); i++) {
+            const Entry *e = &entries[cover[i]];
+            if (e->rect.x <= xs[j] && e->rect.x + e->rect.w >= xs[j+1]
+                    && (!best || cover[i] < best->end)) {
+                best = e;
+            }
+        }
+        if (!best) {
+            continue;
+        }
+        if (!band.spans.empty() && band.spans.back().x2 == xs[j]
+                && band.spans.back().widget == best->widget) {
+            band.spans.back().x2 = xs[j+1];
+        } else {
+            Span s = { xs[j], xs[j+1], best->widget };
+            band.spans.push_back(s);
+        }
+    }
+}
+
+Widget *FocusIndex::lookup(int x, int y)
+{
+    int lo, hi, mid;
+
+    if (last_widget && x >= last_cell.x && x < last_cell.x + last_cell.w
+                    && y >= last_cell.y && y < last_cell.y + last_cell.h) {
+        return last_widget;
+    }
+
+    /* find the last band starting at or above y */
+    lo = 0;
+    hi = bands.size();
+    while (lo < hi) {
+        mid = (lo + hi) / 2;
+        if (bands[mid].y1 <= y) lo = mid + 1;
+        else                    hi = mid;
+    }
+    if (lo == 0 || y >= bands[lo-1].y2) {
+        return root;
+    }
+    const Band &band = bands[lo-1];
+
+    /* and the last span in it starting at or left of x */
+    lo = 0;
+    hi = band.spans.size();
+    while (lo < hi) {
+        mid = (lo + hi) / 2;
+        if (band.spans[mid].x1 <= x) lo = mid + 1;
+        else                         hi = mid;
+    }
+    if (lo == 0 || x >= band.spans[lo-1].x2) {
+        return root;
+    }
+    const Span &span = band.spans[lo-1];
+
+    last_cell = Rectangle(span.x1, band.y1, span.x2 - span.x1,
+                          band.y2 - band.y1);
+    last_widget = span.widget;
+    return last_widget;
+}
+
+bool FocusIndex::hover(int x, int y, Widget *cur, Widget **foc)
+{
+    *foc = lookup(x, y);
+    return *foc != cur;
+}
+
+Widget *FocusIndex::nextKeyFocus(Widget *from, int dir)
+{
+    if (from == root) {
+        if (key_order.empty()) {
+            return root;
+        }
+        return (dir > 0) ? key_order.front() : key_order.back();
+    }
+
+    map<Widget*, int>::iterator i = key_pos.find(from);
+    if (i == key_pos.end()) {
+        return NULL;
+    }
+    int n = key_order.size();
+    return key_order[((i->second + dir) % n + n) % n];
+}
@@ -0,0 +1,95 @@
+/*
+ *  Copyright (C) 2005 Joe Neeman <spuzzzzzzz@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#ifndef FOCUSINDEX_H
+#define FOCUSINDEX_H
+
+#include "Widget.h"
+#include <map>
+
+/// A spatial index of the widgets in a menu.
+
+/** Rather than walking the widget tree on every mouse motion event, we
+ *  flatten it after layout into horizontal bands. Each band is split into
+ *  spans, and each span belongs to the widget that
+ *  Container::handleFocus would pick there, so finding the widget under the
+ *  pointer is two binary searches. The index
+ *  also stores the keyboard focus order, so moving the keyboard focus is a
+ *  map lookup.
+ *
+ *  The index doesn't notice layout changes by itself: call invalidate()
+ *  whenever a widget moves or the tree changes and it will be rebuilt on the
+ *  next lookup.
+ */
+class FocusIndex {
+    public:
+        FocusIndex();
+
+        void build(Container *root);
+        void invalidate()   {valid = false;}
+        bool isValid()      {return valid;}
+
+        /// Find the widget under the point (x, y).
+        Widget *lookup(int x, int y);
+
+        /// Find the widget under the point (x, y) and store it in \p foc.
+
+        /** \return true if the widget is different from \p cur, in which
+         *  case both of them need to have their focus repainted.
+         */
+        bool hover(int x, int y, Widget *cur, Widget **foc);
+
+        /// Find the next widget that accepts keyboard focus.
+
+        /** \return the next widget after \p from in direction \p dir,
+         *  wrapping around at the ends, or NULL if \p from is not a leaf of
+         *  the index (in which case the caller should fall back to
+         *  Widget::handleKeyFocus).
+         */
+        Widget *nextKeyFocus(Widget *from, int dir);
+
+    protected:
+        struct Entry {
+            Rectangle rect;
+            Widget *widget;
+            size_t end;     /* the index just past its descendants */
+        };
+        struct Span {
+            int x1, x2;
+            Widget *widget;
+        };
+        struct Band {
+            int y1, y2;
+            vector<Span> spans;
+        };
+
+        Container *root;
+        bool valid;
+        vector<Band> bands;
+
+        vector<Widget*> key_order;
+        map<Widget*, int> key_pos;
+
+        /* the span that was hit by the last lookup */
+        Rectangle last_cell;
+        Widget *last_widget;
+
+        void collect(Widget *w, const Rectangle &clip, vector<Entry> &dest);
+        void buildBand(Band &band, const vector<Entry> &entries);
+};
+
+#endif
@@ -78,6 +78,11 @@ void Label::getMinSize(int *w_, int *h_)
 {
     int w_text, h_text;
     Menu::getStringSize(text, &w_text, &h_text);
+    getTextMinSize(w_text, h_text, w_, h_);
+}
+
+void Label::getTextMinSize(int w_text, int h_text, int *w_, int *h_)
+{
     *w_ = max(w_text, h_text) + h_text;
     *h_ = h_text * 2;
 }
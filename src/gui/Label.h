@@ -28,6 +28,9 @@ class Label: public Widget, public TextWidget {
         virtual void    getMinSize  (int *w, int *h);
         void            setText     (const string&);
 
+        /// Work out the minimum size of a Label whose text is w by h.
+        static void     getTextMinSize(int w, int h, int *w_, int *h_);
+
     protected:
 };
 
@@ -18,10 +18,15 @@
 #include "Menu.h"
 #include <FileSys.h>
 #include <signal.h>
+#include <poll.h>
+#include <SDL_syswm.h>
 
 #define CLICK_REPEAT_PAUSE 500
 #define CLICK_REPEAT_INTERVAL 100 // milliseconds
 
+/* user event code pushed by the wakeup timer */
+#define MENU_WAKEUP 0x4d57
+
 #define ROUND_CORNER_RATIO 64 // divide the screen height by this to determine
                               // the radius of the rounded corners on buttons
 
@@ -57,6 +62,11 @@ int Menu::mid_click_button;
 Widget *Menu::focused_widget;
 Widget *Menu::keyboard_focused_widget;
 
+FocusIndex Menu::focus_index;
+SDL_TimerID Menu::wakeup_timer;
+int Menu::wakeup_time = -1;
+size_t Menu::wakeup_gen;
+
 const static Uint32 gfx_black = 0x000000FF;
 
 SDL_Rect default_modes[] = {
@@ -185,6 +195,7 @@ void Menu::setRoot(Container *cont, bool delete_old)
 
 void Menu::setRootForReal() {
   root = pending_root;
+  focus_index.invalidate();
   root->unfocus();
   root->keyboardUnfocus();
   root->setSize(-1, -1);  // force the whole widget tree to resize
@@ -247,8 +258,9 @@ void Menu::setBackground(SDL_Surface *s)
 void Menu::run()
 {
   SDL_Event event;
-  int last = SDL_GetTicks();
-  int now;
+  int now, deadline;
+  bool got_event;
+  int fd = displayFd();
 
   if (!root) {
     printError("Cannot run a menu without a root widget\n");
@@ -259,47 +271,20 @@ void Menu::run()
   SDL_Flip(screen);
   running = 1;
   while(running) {
-    while(SDL_PollEvent(&event)) {
-      if(event.type == SDL_QUIT) {
-	exit(0);
-      } else if(event.type == SDL_MOUSEMOTION
-		|| event.type == SDL_MOUSEBUTTONDOWN
-		|| event.type == SDL_MOUSEBUTTONUP) {
-	if (focused_widget && focused_widget->getRawEvents()
-	    && focused_widget->handleEvent(&event)) {
-	  /* nothing */
-	} else if (event.type == SDL_MOUSEMOTION) {
-	  updateFocus(event);
-	} else {
-	  handleClick(event);
-	}
-      } else if(event.type == SDL_KEYDOWN) {
-	if (!keyboard_focused_widget) {
-	  keyboard_focused_widget = root;
-	}
-	Widget *foc = keyboard_focused_widget;
-	int direction = getNavKey(event.key.keysym);
-
-	if (foc->getRawKeyEvents() && foc->handleRawKey(&event)) {
-	  /* nothing */
-	} else if (direction) {
-	  if (foc->hasKeyboardFocus()) {
-	    foc = foc->handleKeyFocus(direction, foc);
-	  } else {
-	    foc = foc->handleKeyFocus(direction, NULL);
-	  }
-	  if (foc != keyboard_focused_widget) {
-	    keyboard_focused_widget->keyboardUnfocus(true);
-	    foc->keyboardFocus(true);
-	    keyboard_focused_widget = foc;
-	  }
-	} else {
-	  foc->handleKey(&event);
-	}
-      }
+    /* sleep until something happens: either an event arrives or one of our
+     * deadlines comes up */
+    deadline = nextDeadline();
+    now = SDL_GetTicks();
+    if (deadline >= 0 && deadline <= now) {
+      got_event = SDL_PollEvent(&event);
+    } else {
+      got_event = waitEvent(&event, deadline, fd);
+    }
 
-      if (pending_root) {
-	break;
+    if (got_event) {
+      handleEvent(event);
+      while(!pending_root && SDL_PollEvent(&event)) {
+	handleEvent(event);
       }
     }
 
@@ -314,9 +299,9 @@ void Menu::run()
 
     /* send repeated clicks if they are holding the mouse button down */
     if(     (click_repeat_state == CLICK_REPEAT_ACTIVE &&
-	     click_repeat_time + CLICK_REPEAT_INTERVAL < now)
+	     click_repeat_time + CLICK_REPEAT_INTERVAL <= now)
             ||  (click_repeat_state == CLICK_REPEAT_PAUSED &&
-                 click_repeat_time + CLICK_REPEAT_PAUSE < now)) {
+                 click_repeat_time + CLICK_REPEAT_PAUSE <= now)) {
       if (focused_widget != mid_click_widget) {
 	click_repeat_state = CLICK_REPEAT_IDLE;
 	click_repeat_time = 0;
@@ -331,16 +316,191 @@ void Menu::run()
 	click_repeat_state = CLICK_REPEAT_IDLE;
       }
     }
-    Menu::refresh();
+
+    /* only touch the screen if something has actually changed */
+    if (root->getChanged() || num_update_rects) {
+      Menu::refresh();
+    }
     if (pending_root) {
       setRootForReal();
       redrawAll();
     }
-    if(now < last + 20) {
-      SDL_Delay(last + 20 - now);
+  }
+}
+
+void Menu::handleEvent(const SDL_Event &event)
+{
+  if(event.type == SDL_QUIT) {
+    exit(0);
+  } else if(event.type == SDL_MOUSEMOTION
+	    || event.type == SDL_MOUSEBUTTONDOWN
+	    || event.type == SDL_MOUSEBUTTONUP) {
+    if (focused_widget && focused_widget->getRawEvents()
+	&& focused_widget->handleEvent(&event)) {
+      /* nothing */
+    } else if (event.type == SDL_MOUSEMOTION) {
+      updateFocus(event);
+    } else {
+      handleClick(event);
     }
-    last = now;
+  } else if(event.type == SDL_KEYDOWN) {
+    if (!keyboard_focused_widget) {
+      keyboard_focused_widget = root;
+    }
+    Widget *foc = keyboard_focused_widget;
+    int direction = getNavKey(event.key.keysym);
+
+    if (foc->getRawKeyEvents() && foc->handleRawKey(&event)) {
+      /* nothing */
+    } else if (direction) {
+      Widget *next = getFocusIndex().nextKeyFocus(foc, direction);
+      if (next) {
+	foc = next;
+      } else if (foc->hasKeyboardFocus()) {
+	foc = foc->handleKeyFocus(direction, foc);
+      } else {
+	foc = foc->handleKeyFocus(direction, NULL);
+      }
+      if (foc != keyboard_focused_widget) {
+	keyboard_focused_widget->keyboardUnfocus(true);
+	foc->keyboardFocus(true);
+	keyboard_focused_widget = foc;
+      }
+    } else {
+      foc->handleKey(&event);
+    }
+  } else if(event.type == SDL_USEREVENT && event.user.code == MENU_WAKEUP
+	    && (size_t)event.user.data1 == wakeup_gen) {
+    /* the timer has fired and removed itself; the deadline itself is
+     * handled back in run(). A wakeup from a timer that armWakeup() has
+     * since replaced may still have been queued, so it has to be from the
+     * current one. */
+    wakeup_timer = NULL;
+    wakeup_time = -1;
+  }
+}
+
+int Menu::nextDeadline()
+{
+  int ret = -1;
+
+  if (click_repeat_state == CLICK_REPEAT_ACTIVE) {
+    ret = click_repeat_time + CLICK_REPEAT_INTERVAL;
+  } else if (click_repeat_state == CLICK_REPEAT_PAUSED) {
+    ret = click_repeat_time + CLICK_REPEAT_PAUSE;
   }
+  return ret;
+}
+
+/* SDL_WaitEvent checks for events every 10ms rather than sleeping, so if
+ * the video driver talks to an X server we sleep on its connection instead.
+ * This returns -1 for any other driver. */
+int Menu::displayFd()
+{
+#ifdef SDL_VIDEO_DRIVER_X11
+  SDL_SysWMinfo info;
+
+  SDL_VERSION(&info.version);
+  if (SDL_GetWMInfo(&info) > 0 && info.subsystem == SDL_SYSWM_X11) {
+    return ConnectionNumber(info.info.x11.display);
+  }
+#endif
+  return -1;
+}
+
+/* Sleep until an event arrives or the deadline (-1 for none) comes up.
+ * SDL makes key repeats when it pumps events, not when the X server sends
+ * anything, so we keep waking up while a key is held down. */
+bool Menu::waitEvent(SDL_Event *event, int deadline, int fd)
+{
+  if (fd < 0) {
+    armWakeup(deadline, SDL_GetTicks());
+    return SDL_WaitEvent(event);
+  }
+
+  /* pumping reads everything that Xlib has buffered, so once the queue is
+   * empty, anything new makes the connection readable */
+  while (!SDL_PollEvent(event)) {
+    int timeout = -1;
+    if (deadline >= 0) {
+      timeout = deadline - (int)SDL_GetTicks();
+      if (timeout <= 0) {
+	return false;
+      }
+    }
+    if (keyHeld() && (timeout < 0 || timeout > SDL_DEFAULT_REPEAT_INTERVAL)) {
+      timeout = SDL_DEFAULT_REPEAT_INTERVAL;
+    }
+
+    struct pollfd p;
+    p.fd = fd;
+    p.events = POLLIN;
+    p.revents = 0;
+    if (poll(&p, 1, timeout) < 0 && errno != EINTR) {
+      printWarning("couldn't wait for events: %s\n", strerror(errno));
+      return SDL_WaitEvent(event);
+    }
+  }
+  return true;
+}
+
+bool Menu::keyHeld()
+{
+  int n;
+  Uint8 *keys = SDL_GetKeyState(&n);
+
+  for (int i=0; i<n; i++) {
+    if (keys[i]) {
+      return true;
+    }
+  }
+  return false;
+}
+
+Uint32 Menu::wakeupCallback(Uint32, void *data)
+{
+  /* this runs in the timer thread, so don't touch anything but the event
+   * queue */
+  SDL_Event event;
+  event.type = SDL_USEREVENT;
+  event.user.code = MENU_WAKEUP;
+  event.user.data1 = data;
+  event.user.data2 = NULL;
+  SDL_PushEvent(&event);
+  return 0;
+}
+
+void Menu::armWakeup(int deadline, int now)
+{
+  if (deadline == wakeup_time) {
+    return;
+  }
+  if (wakeup_timer) {
+    SDL_RemoveTimer(wakeup_timer);
+    wakeup_timer = NULL;
+  }
+  wakeup_time = deadline;
+  wakeup_gen++;
+  if (deadline >= 0) {
+    wakeup_timer = SDL_AddTimer(deadline - now, wakeupCallback,
+				(void*)wakeup_gen);
+    if (!wakeup_timer) {
+      printWarning("couldn't add menu timer: %s\n", SDL_GetError());
+    }
+  }
+}
+
+void Menu::layoutChanged()
+{
+  focus_index.invalidate();
+}
+
+FocusIndex &Menu::getFocusIndex()
+{
+  if (!focus_index.isValid()) {
+    focus_index.build(root);
+  }
+  return focus_index;
 }
 
 void Menu::stop()
@@ -678,9 +838,9 @@ void Menu::changeVideoSettings(const VideoSettings &newset)
 
   vset = newset;
   screen = SDL_SetVideoMode(vset.w, vset.h, vset.bpp, vset.flags);
-  if (font_button)
-    TTF_CloseFont(font_button);
+  TTF_Font *old_font = font_button;
   init(screen);
+  fs->closeFont(old_font);
 
   if (background) {
     if (background_file.empty()) {
@@ -830,8 +990,12 @@ void Menu::updateFocus(const SDL_Event &event)
 {
     Widget *oldfoc = focused_widget;
 
-    focused_widget = root->handleFocus(event.motion.x, event.motion.y);
-    if (oldfoc && focused_widget != oldfoc) {
+    /* most motion events don't leave the widget they started in */
+    if (!getFocusIndex().hover(event.motion.x, event.motion.y,
+                               oldfoc, &focused_widget)) {
+        return;
+    }
+    if (oldfoc) {
         oldfoc->unfocus(true);
     }
     if (focused_widget) {
@@ -23,6 +23,7 @@
 #include <map>
 #include "Widget.h"
 #include "Container.h"
+#include "FocusIndex.h"
 
 /* used with qsort to sort integers in descending order */
 int intdescend(const void*, const void*);
@@ -127,6 +128,10 @@ class Menu {
 
   static void setKeyboardFocus(Widget*);
 
+  /// Tell the menu that widgets have moved, so that the focus index needs
+  /// to be rebuilt.
+  static void layoutChanged();
+
  protected:
   static VideoSettings vset;
   static SoundSettings sset;
@@ -175,6 +180,31 @@ class Menu {
   /* the last button number that was pressed */
   static int     mid_click_button;
 
+  /* hit-testing and keyboard navigation for the current root */
+  static FocusIndex focus_index;
+  static FocusIndex &getFocusIndex();
+
+  /* Menu::run sleeps on the X server's connection until the next
+   * click-repeat deadline. Other video drivers have no connection to sleep
+   * on, so it uses SDL_WaitEvent, and this timer pushes a MENU_WAKEUP event
+   * when the deadline comes up. Each timer's events carry wakeup_gen as it
+   * was when the timer was armed. */
+  static SDL_TimerID wakeup_timer;
+  static int wakeup_time;
+  static size_t wakeup_gen;
+  static Uint32 wakeupCallback(Uint32, void*);
+
+  /// Return the time of the next click-repeat, or -1
+  /// if there is nothing to wait for but events.
+  static int nextDeadline();
+  static void armWakeup(int deadline, int now);
+  static int displayFd();
+  static bool waitEvent(SDL_Event*, int deadline, int fd);
+  static bool keyHeld();
+
+  /// Dispatch a single event to the focused widgets.
+  static void handleEvent(const SDL_Event &event);
+
   static void combineAlphaSurfaces(SDL_Surface *src, SDL_Surface *dest, int, int);
 
   /// Given a MOUSEMOTION event, check for a change in widget focus.
@@ -29,24 +29,35 @@ template<class T> void spinnerUp(Clickable*, void*);
 template<class T> void spinnerDown(Clickable*, void*);
 template<class T> string toString(T);
 
+template<class T> T spinnerRange(int, void*);
+
 /// A spinner widget
+
+/** The items in a Spinner either live in a vector (see addItem() and
+ *  reset()) or are produced on demand by a generator function (see
+ *  setGenerator() and setRange()). Only the current item is ever turned
+ *  into a label; the size of the widest label is worked out lazily, from a
+ *  size hint or an Estimator if one is set.
+ */
 template <class T>
 class Spinner: public HBox {
     public:
         typedef void (*Callback)(Spinner*, void*);
 
+        /// Return item number \p index.
+        typedef T (*Generator)(int index, void *data);
+
+        /// Work out the size of the largest item's text.
+        typedef void (*Estimator)(Spinner*, int *w, int *h);
+
         Spinner(T initial, bool wrap_ = false):
             up("up_arrow.png", "up_arrow_foc.png"),
             down("down_arrow.png", "down_arrow_foc.png")
         {
+            commonInit(wrap_);
             cur = sticky = 0;
-            data = NULL;
-            callback = NULL;
-            wrap = wrap_;
-	    label_min_width = 0;
-	    label_min_height = 0;
 
-	    addItem (initial);
+            addItem (initial);
 
             initChildren();
         }
@@ -55,15 +66,38 @@ class Spinner: public HBox {
             up("up_arrow.png", "up_arrow_foc.png"),
             down("down_arrow.png", "down_arrow_foc.png")
         {
+            commonInit(wrap_);
             cur = sticky = cur_;
-            data = NULL;
-            callback = NULL;
-            wrap = wrap_;
-	    label_min_width = 0;
-	    label_min_height = 0;
+            values = copy;
+            num_items = values.size();
 
-	    for (int i = 0; i < (int)copy.size (); i++)
-	      addItem (copy[i]);
+            initChildren();
+        }
+
+        Spinner(Generator gen, void *gen_data, int count, int cur_,
+                bool wrap_ = false):
+            up("up_arrow.png", "up_arrow_foc.png"),
+            down("down_arrow.png", "down_arrow_foc.png")
+        {
+            commonInit(wrap_);
+            cur = sticky = cur_;
+            setGenerator(gen, gen_data, count);
+
+            initChildren();
+        }
+
+        /**
+         * Create a Spinner containing every value from \p first to \p last
+         * (inclusive), counting up or down as necessary. This only works
+         * for types with integer arithmetic.
+         */
+        Spinner(T first, T last, int cur_, bool wrap_ = false):
+            up("up_arrow.png", "up_arrow_foc.png"),
+            down("down_arrow.png", "down_arrow_foc.png")
+        {
+            commonInit(wrap_);
+            cur = sticky = cur_;
+            setRange(first, last);
 
             initChildren();
         }
@@ -78,14 +112,62 @@ class Spinner: public HBox {
          */
         void reset(const vector<T> &copy, int cur)
         {
-	    label_min_width = 0;
-	    label_min_height = 0;
-	    values.clear ();
-	    for (int i = 0; i < (int)copy.size (); i++)
-	      addItem (copy[i]);
+            generator = NULL;
+            dropRangeEstimator();
+            values = copy;
+            num_items = values.size();
+            sizeChanged();
             setItem(cur);
         }
 
+        /**
+         * Take items from \p gen instead of a vector. \p gen will only be
+         * called for the current item, and for whatever items the
+         * Estimator wants to look at. The Estimator that setRange() put
+         * in is dropped, since it only suits ranges of integers.
+         */
+        void setGenerator(Generator gen, void *gen_data, int count)
+        {
+            values.clear();
+            dropRangeEstimator();
+            generator = gen;
+            generator_data = gen_data;
+            num_items = count;
+            if (cur >= num_items) {
+                cur = sticky = 0;
+            }
+            sizeChanged();
+        }
+
+        void setRange(T first, T last)
+        {
+            range_first = first;
+            range_step = (last < first) ? -1 : 1;
+            setGenerator(spinnerRange<T>, this, (last - first)*range_step + 1);
+            if (!estimator) {
+                estimator = estimateEnds;
+                range_estimator = true;
+            }
+        }
+
+        void setEstimator(Estimator e)
+        {
+            estimator = e;
+            range_estimator = false;
+            sizeChanged();
+        }
+
+        /**
+         * Set the size of the largest item's text, so that we don't need to
+         * look at the items at all. A width or height of -1 removes the hint.
+         */
+        void setSizeHint(int w, int h)
+        {
+            hint_w = w;
+            hint_h = h;
+            sizeChanged();
+        }
+
         void draw(bool update=0)
         {
             if (!changed) return;
@@ -114,32 +196,35 @@ class Spinner: public HBox {
 
         void setItem(int i)
         {
-            if (i>=0 && i<(int)values.size()) {
+            if (i>=0 && i<num_items) {
                 cur = sticky = i;
             }
             saveMinSize();
-            label.setText( toString(values[cur]) );
+            label.setText( toString(itemAt(cur)) );
             setChanged(1);
             resize();
         }
 
         void addItem(T item)
         {
-	    string text = label.getText ();
-
+            if (generator) {
+                printWarning("can't add items to a generated Spinner\n");
+                return;
+            }
             values.push_back(item);
-
-	    int w, h;
-	    label.setText( toString(item) );
-	    label.getMinSize (&w, &h);
-	    label_min_width = max( label_min_width, w );
-	    label_min_height = max (label_min_height, h );
-	    label.setText (text);
+            num_items = values.size();
+            sizeChanged();
         }
 
         T getItem()
         {
-            return values[cur];
+            return itemAt(cur);
+        }
+
+        /// Return item number \p i.
+        T itemAt(int i)
+        {
+            return generator ? (*generator)(i, generator_data) : values[i];
         }
 
         int  getIndex()
@@ -147,11 +232,16 @@ class Spinner: public HBox {
             return cur;
         }
 
+        int  getCount()
+        {
+            return num_items;
+        }
+
         void setIndex(int i) {
-            if (i >= 0 && i < (int)values.size()) {
+            if (i >= 0 && i < num_items) {
                 saveMinSize();
                 cur = i;
-                label.setText(toString(values[cur]));
+                label.setText(toString(itemAt(cur)));
                 if(callback) (*callback)(this, data);
                 resize();
                 setChanged(1);
@@ -161,8 +251,12 @@ class Spinner: public HBox {
 
         void clearItems()
         {
+            generator = NULL;
+            dropRangeEstimator();
             values.clear();
+            num_items = 0;
             cur = 0;
+            sizeChanged();
         }
 
         void save()
@@ -174,7 +268,7 @@ class Spinner: public HBox {
         {
             cur = sticky;
             saveMinSize();
-            label.setText(toString(values[cur]));
+            label.setText(toString(itemAt(cur)));
             setChanged(1);
             resize();
         }
@@ -189,14 +283,60 @@ class Spinner: public HBox {
 	{
             int pics_w, pics_h;
 	    buttons.getMinSize (&pics_w, &pics_h);
+            if (label_min_width < 0) {
+                measureLabel();
+            }
 	    *w = pics_w + label_min_width;
 	    *h = max (pics_h, label_min_height);
 	}
 
+        /// Get the size of the text of item number \p i.
+        void measureItem(int i, int *w, int *h)
+        {
+            Menu::getStringSize(toString(itemAt(i)), w, h);
+        }
+
+        /**
+         * An Estimator for ranges of integers. No item in between can have
+         * more digits than the longer end, so it measures the ends with
+         * each of their digits replaced by each digit in turn, which covers
+         * fonts whose digits aren't all the same width.
+         */
+        static void estimateEnds(Spinner *spin, int *w, int *h)
+        {
+            *w = *h = 0;
+            for (int end=0; end<2; end++) {
+                string s = toString(spin->itemAt(end ? spin->num_items-1 : 0));
+                for (char d='0'; d<='9'; d++) {
+                    string sample = s;
+                    for (unsigned i=0; i<sample.length(); i++) {
+                        if (sample[i] >= '0' && sample[i] <= '9') {
+                            sample[i] = d;
+                        }
+                    }
+                    int w2, h2;
+                    Menu::getStringSize(sample, &w2, &h2);
+                    *w = max(*w, w2);
+                    *h = max(*h, h2);
+                }
+            }
+        }
+
     protected:
         vector<T> values;
+        Generator generator;
+        void *generator_data;
+        Estimator estimator;
+        bool range_estimator;   /* whether setRange() set estimator */
+        int num_items;
+        T range_first;
+        int range_step;
+
+        /* the minimum size of the label, or -1 if it needs to be measured */
 	int label_min_width;
 	int label_min_height;
+        int hint_w, hint_h;
+
         int cur, sticky;
         Label label;
         PicButton up, down;
@@ -207,6 +347,20 @@ class Spinner: public HBox {
         Callback callback;
         void *data;
 
+        void commonInit(bool wrap_)
+        {
+            data = NULL;
+            callback = NULL;
+            wrap = wrap_;
+            generator = NULL;
+            generator_data = NULL;
+            estimator = NULL;
+            range_estimator = false;
+            num_items = 0;
+            hint_w = hint_h = -1;
+            label_min_width = label_min_height = -1;
+        }
+
         void initChildren()
         {
             up.setRepeating(true);
@@ -215,7 +369,7 @@ class Spinner: public HBox {
             up.setCallback(spinnerUp<T>, this);
             down.setCallback(spinnerDown<T>, this);
 
-            label.setText(toString(values[cur]));
+            label.setText(toString(itemAt(cur)));
             buttons.add(&up);
             buttons.add(&down);
 
@@ -223,9 +377,47 @@ class Spinner: public HBox {
             add(&buttons);
         }
 
+        /* forget the label size; it will be measured again the next time
+         * someone asks for our size */
+        void sizeChanged()
+        {
+            label_min_width = label_min_height = -1;
+            setChanged(1);
+        }
+
+        /* stop using the Estimator that setRange() put in */
+        void dropRangeEstimator()
+        {
+            if (range_estimator) {
+                estimator = NULL;
+                range_estimator = false;
+            }
+        }
+
+        void measureLabel()
+        {
+            int w = 0, h = 0;
+
+            if (hint_w >= 0 && hint_h >= 0) {
+                w = hint_w;
+                h = hint_h;
+            } else if (estimator && num_items) {
+                (*estimator)(this, &w, &h);
+            } else {
+                for (int i=0; i<num_items; i++) {
+                    int w_item, h_item;
+                    measureItem(i, &w_item, &h_item);
+                    w = max(w, w_item);
+                    h = max(h, h_item);
+                }
+            }
+            Label::getTextMinSize(w, h, &label_min_width, &label_min_height);
+        }
+
         friend string toString<T> (T);
         friend void spinnerUp<T>   (Clickable*, void*);
         friend void spinnerDown<T> (Clickable*, void*);
+        friend T spinnerRange<T>   (int, void*);
 };
 
 template<class T> string toString(T unknown)
@@ -233,6 +425,13 @@ template<class T> string toString(T unknown)
     return "unable to convert to string";
 }
 
+template<class T> T spinnerRange(int index, void *spinner)
+{
+    Spinner<T> *spin = (Spinner<T>*)spinner;
+
+    return spin->range_first + index * spin->range_step;
+}
+
 template<class T> void spinnerUp(Clickable *ignored, void *spinner)
 {
     Spinner<T> *spin = (Spinner<T>*)spinner;
@@ -240,7 +439,7 @@ template<class T> void spinnerUp(Clickable *ignored, void *spinner)
     if(spin->cur > 0) {
         spin->setIndex(spin->cur - 1);
     } else if (spin->wrap) {
-        spin->setIndex(spin->values.size() - 1);
+        spin->setIndex(spin->num_items - 1);
     }
 }
 
@@ -248,7 +447,7 @@ template<class T> void spinnerDown(Clickable *ignored, void *spinner)
 {
     Spinner<T> *spin = (Spinner<T>*)spinner;
 
-    if(spin->cur + 1 < (int)spin->values.size()) {
+    if(spin->cur + 1 < spin->num_items) {
         spin->setIndex(spin->cur + 1);
     } else if (spin->wrap) {
         spin->setIndex(0);
@@ -40,6 +40,9 @@ Widget::~Widget()
 void Widget::cleanDraw()
 {
     getSize(&pos.w, &pos.h);
+    if (drawn_pos != pos) {
+        Menu::layoutChanged();
+    }
     if (drawn_pos.x != -1 && drawn_pos != pos) {
         if (parent) {
             parent->drawBackground(drawn_pos);
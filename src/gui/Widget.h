@@ -341,6 +341,12 @@ class Widget {
         /// Mark this widget (and all its parents) as changed.
         void setChanged(bool);
 
+        /// Return whether this widget needs to be redrawn.
+        bool getChanged() {return changed;}
+
+        /// Return whether this widget is a Container.
+        virtual bool isContainer() {return false;}
+
         /// Mark this widget (and all its children, if it is a Container) as
         /// changed.
         virtual void setAllChanged(bool b);